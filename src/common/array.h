@@ -132,6 +132,14 @@ class array<const T> final
     {
     }
 
+    // Read-only view which shares ownership of the storage of a mutable array.
+    explicit array(const array<T>& other)
+        : ptr_(other.ptr_)
+        , size_(other.size_)
+        , storage_(other.storage_)
+    {
+    }
+
     array(array<T>&& other)
         : ptr_(other.ptr_)
         , size_(other.size_)
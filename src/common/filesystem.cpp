@@ -39,21 +39,9 @@ probe_path(const boost::filesystem::path&                             full_path,
     if (!parent)
         return {};
 
-    auto dir = boost::filesystem::path(*parent);
-    auto loc = std::locale(""); // Use system locale
-
-    auto leaf_name     = full_path.filename().stem().wstring();
-    auto has_extension = !full_path.filename().extension().wstring().empty();
-    auto leaf_filename = full_path.filename().wstring();
-
-    for (auto it = boost::filesystem::directory_iterator(dir); it != boost::filesystem::directory_iterator(); ++it) {
-        if (has_extension) {
-            auto it_path = it->path().filename().wstring();
-            if (boost::iequals(it_path, leaf_filename, loc) && is_valid_file(it->path().wstring()))
-                return it->path();
-        }
-        if (boost::iequals(it->path().stem().wstring(), leaf_filename, loc) && is_valid_file(it->path().wstring()))
-            return it->path();
+    for (auto& match : find_files_case_insensitive(*parent, full_path.filename().wstring())) {
+        if (is_valid_file(match.wstring()))
+            return match;
     }
 
     return {};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace caspar {
+
+// Reports changes below a folder from a background thread. Changed paths are collected until nothing has changed
+// for settle_time and then reported together. They may be files or folders, and may have been created, modified,
+// renamed or removed.
+//
+// On Linux every sub folder is watched with inotify. An empty list means that changes may have been missed, e.g. when
+// the inotify queue overflowed, and the whole folder should be scanned again. While any folder cannot be watched,
+// because inotify is not available or its watch failed (typically ENOSPC), an empty list is also reported every
+// poll_interval, if it is non-zero, and failed watches are retried.
+class directory_watcher
+{
+  public:
+    using callback_t = std::function<void(const std::vector<boost::filesystem::path>& paths)>;
+
+    directory_watcher(boost::filesystem::path   folder,
+                      std::chrono::milliseconds settle_time,
+                      std::chrono::seconds      poll_interval,
+                      callback_t                callback);
+    ~directory_watcher();
+
+    directory_watcher(const directory_watcher&)            = delete;
+    directory_watcher& operator=(const directory_watcher&) = delete;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+} // namespace caspar
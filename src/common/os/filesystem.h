@@ -21,13 +21,29 @@
 
 #pragma once
 
+#include <boost/filesystem/path.hpp>
+
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace caspar {
 
+// Lets find_case_insensitive and find_files_case_insensitive look names up in a cached listing of each folder below
+// folder instead of reading the folder every time. Listings are dropped when their folder changes.
+void add_case_insensitive_index(const std::wstring& folder);
+
+// Tells the index about changes below folder that a directory_watcher has seen, so that the listings they affect are
+// dropped right away. No paths means that anything below folder may have changed.
+void case_insensitive_index_changed(const boost::filesystem::path&              folder,
+                                    const std::vector<boost::filesystem::path>& paths);
+
 std::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive);
 
+// The files in folder whose name, or name without extension, equals name ignoring case.
+std::vector<boost::filesystem::path> find_files_case_insensitive(const boost::filesystem::path& folder,
+                                                                 const std::wstring&            name);
+
 std::wstring clean_path(std::wstring path);
 
 std::wstring ensure_trailing_slash(std::wstring folder);
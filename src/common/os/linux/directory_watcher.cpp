@@ -0,0 +1,282 @@
+#include "../../stdafx.h"
+
+#include "../directory_watcher.h"
+#include "../thread.h"
+
+#include "../../log.h"
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <set>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace caspar {
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                            IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+} // namespace
+
+struct directory_watcher::impl
+{
+    const boost::filesystem::path   folder_;
+    const std::chrono::milliseconds settle_time_;
+    const std::chrono::seconds      poll_interval_;
+    const callback_t                callback_;
+
+    int                                    fd_       = -1;
+    int                                    event_fd_ = -1;
+    std::map<int, boost::filesystem::path> watches_;
+    std::set<boost::filesystem::path>      unwatched_; // Folders whose watch failed, polled instead
+
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
+
+    impl(boost::filesystem::path   folder,
+         std::chrono::milliseconds settle_time,
+         std::chrono::seconds      poll_interval,
+         callback_t                callback)
+        : folder_(std::move(folder))
+        , settle_time_(settle_time)
+        , poll_interval_(poll_interval)
+        , callback_(std::move(callback))
+        , fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+        , event_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (fd_ < 0) {
+            CASPAR_LOG(warning) << L"[directory_watcher] inotify is not available (" << std::strerror(errno)
+                                << L"), " << folder_.wstring() << L" is rescanned periodically.";
+        }
+
+        thread_ = std::thread([this] {
+            set_thread_name(L"directory-watcher");
+            try {
+                if (fd_ >= 0) {
+                    watch(folder_);
+                }
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        abort_request_ = true;
+        uint64_t one   = 1;
+        if (::write(event_fd_, &one, sizeof(one)) < 0) {
+            CASPAR_LOG(warning) << L"[directory_watcher] Failed to wake watcher thread.";
+        }
+        thread_.join();
+
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        ::close(event_fd_);
+    }
+
+    // Watches the folder and every folder below it.
+    void watch(const boost::filesystem::path& folder)
+    {
+        add_watch(folder);
+
+        boost::system::error_code ec;
+        for (auto it = boost::filesystem::recursive_directory_iterator(folder, ec);
+             !ec && it != boost::filesystem::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (boost::filesystem::is_directory(it->path(), ec)) {
+                add_watch(it->path());
+            }
+        }
+    }
+
+    void add_watch(const boost::filesystem::path& folder)
+    {
+        auto wd = inotify_add_watch(fd_, folder.c_str(), WATCH_MASK);
+        if (wd < 0) {
+            // Typically ENOSPC, fs.inotify.max_user_watches is too low for the number of folders.
+            if (unwatched_.insert(folder).second) {
+                CASPAR_LOG(warning) << L"[directory_watcher] Failed to watch " << folder.wstring() << L" ("
+                                    << std::strerror(errno) << L"), it is rescanned periodically.";
+            }
+            return;
+        }
+        watches_[wd] = folder;
+        unwatched_.erase(folder);
+    }
+
+    // Retries the folders whose watch failed, e.g. after fs.inotify.max_user_watches was raised.
+    void retry_watches()
+    {
+        const auto folders = unwatched_;
+        for (auto& folder : folders) {
+            boost::system::error_code ec;
+            if (boost::filesystem::is_directory(folder, ec)) {
+                add_watch(folder);
+            } else {
+                unwatched_.erase(folder);
+            }
+        }
+    }
+
+    void unwatch(const boost::filesystem::path& folder)
+    {
+        const auto prefix = folder.string() + "/";
+        for (auto it = unwatched_.begin(); it != unwatched_.end();) {
+            if (*it == folder || it->string().compare(0, prefix.size(), prefix) == 0) {
+                it = unwatched_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto it = watches_.begin(); it != watches_.end();) {
+            if (it->second == folder || it->second.string().compare(0, prefix.size(), prefix) == 0) {
+                inotify_rm_watch(fd_, it->first);
+                it = watches_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void run()
+    {
+        using clock = std::chrono::steady_clock;
+
+        std::set<boost::filesystem::path> changed;
+        auto                              rescan = false;
+        clock::time_point                 first_change;
+        auto                              next_poll = clock::now() + poll_interval_;
+
+        while (!abort_request_) {
+            const auto pending = rescan || !changed.empty();
+            // Without inotify everything is polled, otherwise only the folders whose watch failed need to be.
+            const auto polling = poll_interval_.count() > 0 && (fd_ < 0 || !unwatched_.empty());
+
+            auto timeout = -1;
+            if (pending) {
+                timeout = static_cast<int>(settle_time_.count());
+            } else if (polling) {
+                timeout = static_cast<int>(std::max<int64_t>(
+                    0,
+                    std::chrono::duration_cast<std::chrono::milliseconds>(next_poll - clock::now()).count()));
+            }
+
+            pollfd fds[2] = {{event_fd_, POLLIN, 0}, {fd_, POLLIN, 0}};
+            auto   ret    = ::poll(fds, fd_ < 0 ? 1 : 2, timeout);
+            if (abort_request_) {
+                return;
+            }
+            if (ret < 0 && errno != EINTR) {
+                CASPAR_LOG(error) << L"[directory_watcher] poll failed (" << std::strerror(errno) << L").";
+                return;
+            }
+
+            if (ret > 0 && (fds[1].revents & POLLIN) != 0) {
+                if (!pending) {
+                    first_change = clock::now();
+                }
+                rescan = read_events(changed) || rescan;
+            }
+
+            if (polling && clock::now() >= next_poll) {
+                if (!pending) {
+                    first_change = clock::now();
+                }
+                next_poll = clock::now() + poll_interval_;
+                if (fd_ >= 0) {
+                    retry_watches();
+                }
+                rescan = true;
+            }
+
+            // Files that keep changing are reported at least every ten settle times.
+            const auto settled = ret == 0 || clock::now() - first_change > settle_time_ * 10;
+
+            if (settled && (rescan || !changed.empty())) {
+                std::vector<boost::filesystem::path> paths;
+                if (!rescan) {
+                    paths.assign(changed.begin(), changed.end());
+                }
+                changed.clear();
+                rescan = false;
+
+                callback_(paths);
+            }
+        }
+    }
+
+    // Returns true if events were lost.
+    bool read_events(std::set<boost::filesystem::path>& changed)
+    {
+        auto lost = false;
+
+        alignas(inotify_event) char buffer[64 * 1024];
+        while (true) {
+            auto len = ::read(fd_, buffer, sizeof(buffer));
+            if (len <= 0) {
+                break;
+            }
+
+            for (auto ptr = buffer; ptr < buffer + len;) {
+                const auto event = reinterpret_cast<const inotify_event*>(ptr);
+                ptr += sizeof(inotify_event) + event->len;
+
+                if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                    lost = true;
+                    continue;
+                }
+
+                auto it = watches_.find(event->wd);
+                if (it == watches_.end()) {
+                    continue;
+                }
+
+                if ((event->mask & IN_IGNORED) != 0) {
+                    watches_.erase(it);
+                    continue;
+                }
+
+                auto path = event->len > 0 ? it->second / event->name : it->second;
+
+                if ((event->mask & IN_ISDIR) != 0 && (event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+                    // The watches below a renamed folder still have the old path.
+                    unwatch(path);
+                }
+                if ((event->mask & IN_ISDIR) != 0 && (event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+                    // Files created before the watch was added are only seen by scanning the new folder.
+                    watch(path);
+                }
+
+                changed.insert(std::move(path));
+            }
+        }
+
+        return lost;
+    }
+};
+
+directory_watcher::directory_watcher(boost::filesystem::path   folder,
+                                     std::chrono::milliseconds settle_time,
+                                     std::chrono::seconds      poll_interval,
+                                     callback_t                callback)
+    : impl_(new impl(std::move(folder), settle_time, poll_interval, std::move(callback)))
+{
+}
+
+directory_watcher::~directory_watcher() {}
+
+} // namespace caspar
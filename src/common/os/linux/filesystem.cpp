@@ -23,13 +23,245 @@
 
 #include "../filesystem.h"
 
+#include "../../utf.h"
+
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#include <time.h>
+
 using namespace boost::filesystem;
 
 namespace caspar {
 
+namespace {
+
+const std::locale& system_locale()
+{
+    static const std::locale loc(""); // Use system locale
+    return loc;
+}
+
+std::wstring to_lower(const std::wstring& str) { return boost::algorithm::to_lower_copy(str, system_locale()); }
+
+// "/media/./Folder/" => "/media/Folder"
+std::wstring folder_key(const path& folder)
+{
+    auto key = absolute(folder).lexically_normal().generic_wstring();
+    while (boost::algorithm::ends_with(key, L"/.") || (key.size() > 1 && key.back() == L'/')) {
+        key.resize(key.size() - (key.back() == L'/' ? 1 : 2));
+    }
+    return key;
+}
+
+bool is_below(const std::wstring& key, const std::wstring& folder)
+{
+    return key == folder || (key.size() > folder.size() && boost::algorithm::starts_with(key, folder) &&
+                             (folder.back() == L'/' || key[folder.size()] == L'/'));
+}
+
+// The names in a folder by their lower case name and lower case name without extension.
+struct folder_listing
+{
+    std::unordered_multimap<std::wstring, std::wstring> names;
+    std::unordered_multimap<std::wstring, std::wstring> stems;
+    timespec                                            mtime;
+};
+
+bool modification_time(const std::wstring& folder, timespec& mtime)
+{
+    struct stat st;
+    if (::stat(u8(folder).c_str(), &st) != 0) {
+        return false;
+    }
+    mtime = st.st_mtim;
+    return true;
+}
+
+bool same_time(const timespec& lhs, const timespec& rhs)
+{
+    return lhs.tv_sec == rhs.tv_sec && lhs.tv_nsec == rhs.tv_nsec;
+}
+
+// A listing is only used while its folder has the modification time it was read at. Names found in it are still
+// checked to exist, and names that are not, or missing ones, are looked for in the folder itself, so that a listing
+// which is not up to date never gives a wrong answer. Changes seen by other watchers of the folders, such as the
+// media index, drop listings without waiting for the next lookup.
+class case_insensitive_index
+{
+    std::mutex                                                              mutex_;
+    std::vector<std::wstring>                                               roots_;
+    std::unordered_map<std::wstring, std::shared_ptr<const folder_listing>> listings_;
+    uint64_t                                                                generation_ = 0;
+
+  public:
+    static case_insensitive_index& instance()
+    {
+        static case_insensitive_index index;
+        return index;
+    }
+
+    void add(const path& folder)
+    {
+        auto key = folder_key(folder);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto& root : roots_) {
+            if (is_below(key, root)) {
+                return;
+            }
+        }
+        roots_.push_back(key);
+    }
+
+    // nullptr if the folder is not indexed.
+    std::shared_ptr<const folder_listing> listing(const path& folder)
+    {
+        auto key = folder_key(folder);
+
+        timespec mtime;
+        if (!modification_time(key, mtime)) {
+            return nullptr;
+        }
+
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = listings_.find(key);
+            if (it != listings_.end()) {
+                if (same_time(it->second->mtime, mtime)) {
+                    return it->second;
+                }
+                listings_.erase(it);
+            }
+
+            auto indexed = false;
+            for (auto& root : roots_) {
+                indexed = indexed || is_below(key, root);
+            }
+            if (!indexed) {
+                return nullptr;
+            }
+            generation = generation_;
+        }
+
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        auto result   = std::make_shared<folder_listing>();
+        result->mtime = mtime;
+
+        boost::system::error_code ec;
+        for (auto it = directory_iterator(key, ec); !ec && it != directory_iterator(); it.increment(ec)) {
+            auto name = it->path().filename().wstring();
+            result->names.emplace(to_lower(name), name);
+            result->stems.emplace(to_lower(it->path().stem().wstring()), name);
+        }
+        if (ec) {
+            return nullptr;
+        }
+
+        // Modification times are coarse, so a folder changed within the last second may change again without its
+        // modification time changing. Such listings are used once but not kept.
+        timespec after;
+        if (!modification_time(key, after) || !same_time(after, mtime) || mtime.tv_sec + 1 >= now.tv_sec) {
+            return result;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (generation == generation_) {
+            listings_[key] = result;
+        }
+        return result;
+    }
+
+    // Drops the listings of paths, the folders they are in and, for folders, everything below them. No paths means
+    // that anything below folder may have changed.
+    void invalidate(const path& folder, const std::vector<path>& paths)
+    {
+        std::vector<std::wstring> parents;
+        std::vector<std::wstring> folders;
+        if (paths.empty()) {
+            folders.push_back(folder_key(folder));
+        }
+        for (auto& p : paths) {
+            parents.push_back(folder_key(p.parent_path()));
+            folders.push_back(folder_key(p));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        ++generation_;
+
+        for (auto it = listings_.begin(); it != listings_.end();) {
+            auto changed = std::find(parents.begin(), parents.end(), it->first) != parents.end();
+            for (auto& f : folders) {
+                changed = changed || is_below(it->first, f);
+            }
+            it = changed ? listings_.erase(it) : std::next(it);
+        }
+    }
+};
+
+std::vector<std::wstring> find_names(const folder_listing& listing, const std::wstring& name, bool stems)
+{
+    std::vector<std::wstring> result;
+
+    const auto lower = to_lower(name);
+    for (auto range = listing.names.equal_range(lower); range.first != range.second; ++range.first) {
+        result.push_back(range.first->second);
+    }
+    if (stems) {
+        for (auto range = listing.stems.equal_range(lower); range.first != range.second; ++range.first) {
+            if (std::find(result.begin(), result.end(), range.first->second) == result.end()) {
+                result.push_back(range.first->second);
+            }
+        }
+    }
+    return result;
+}
+
+std::optional<path> find_in_folder(const path& folder, const path& part)
+{
+    auto& index   = case_insensitive_index::instance();
+    auto  listing = index.listing(folder);
+    if (listing) {
+        for (auto& name : find_names(*listing, part.wstring(), false)) {
+            if (exists(folder / name)) {
+                return folder / name;
+            }
+            index.invalidate(folder, {folder / name});
+        }
+    }
+
+    for (auto it = directory_iterator(absolute(folder)); it != directory_iterator(); ++it) {
+        auto leaf = it->path().filename();
+
+        if (boost::algorithm::iequals(part.wstring(), leaf.wstring(), system_locale())) {
+            return folder / leaf;
+        }
+    }
+
+    return {};
+}
+
+} // namespace
+
+void add_case_insensitive_index(const std::wstring& folder) { case_insensitive_index::instance().add(folder); }
+
+void case_insensitive_index_changed(const boost::filesystem::path& folder, const std::vector<path>& paths)
+{
+    case_insensitive_index::instance().invalidate(folder, paths);
+}
+
 std::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive)
 {
     path p(case_insensitive);
@@ -40,34 +272,55 @@ std::optional<std::wstring> find_case_insensitive(const std::wstring& case_insen
     p = absolute(p);
     path result;
 
-    auto loc = std::locale(""); // Use system locale
-
     for (auto part : p) {
         auto concatenated = result / part;
 
         if (exists(concatenated)) {
             result = concatenated;
         } else {
-            bool found = false;
-
-            for (auto it = directory_iterator(absolute(result)); it != directory_iterator(); ++it) {
-                auto leaf = it->path().filename();
-
-                if (boost::algorithm::iequals(part.wstring(), leaf.wstring(), loc)) {
-                    result = result / leaf;
-                    found  = true;
-                    break;
-                }
-            }
+            auto found = find_in_folder(result, part);
 
             if (!found)
                 return {};
+
+            result = *found;
         }
     }
 
     return result.wstring();
 }
 
+std::vector<path> find_files_case_insensitive(const path& folder, const std::wstring& name)
+{
+    std::vector<path> result;
+
+    auto& index   = case_insensitive_index::instance();
+    auto  listing = index.listing(folder);
+    if (listing) {
+        auto stale = false;
+        for (auto& match : find_names(*listing, name, true)) {
+            stale = stale || !exists(folder / match);
+            result.push_back(folder / match);
+        }
+        if (!stale && !result.empty()) {
+            return result;
+        }
+        if (stale) {
+            index.invalidate(folder, {folder / name});
+        }
+        result.clear();
+    }
+
+    for (auto it = directory_iterator(folder); it != directory_iterator(); ++it) {
+        if (boost::algorithm::iequals(it->path().filename().wstring(), name, system_locale()) ||
+            boost::algorithm::iequals(it->path().stem().wstring(), name, system_locale())) {
+            result.push_back(it->path());
+        }
+    }
+
+    return result;
+}
+
 std::wstring clean_path(std::wstring path)
 {
     boost::replace_all(path, L"\\\\", L"/");
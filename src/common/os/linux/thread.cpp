@@ -18,4 +18,11 @@ void set_thread_realtime_priority()
     pthread_setschedparam(handle, SCHED_FIFO, &param);
 }
 
+void set_thread_background_priority()
+{
+    struct sched_param param;
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+}
+
 } // namespace caspar
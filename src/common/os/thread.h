@@ -6,4 +6,7 @@ namespace caspar {
 
 void set_thread_name(const std::wstring& name);
 void set_thread_realtime_priority();
+
+// Only runs the calling thread when no other thread wants the cpu.
+void set_thread_background_priority();
 } // namespace caspar
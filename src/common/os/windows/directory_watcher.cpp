@@ -0,0 +1,81 @@
+#include "../../stdafx.h"
+
+#include "../directory_watcher.h"
+#include "../thread.h"
+
+#include "../../log.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace caspar {
+
+// There is no recursive change notification here yet, so the folder is only rescanned periodically.
+struct directory_watcher::impl
+{
+    const boost::filesystem::path folder_;
+    const std::chrono::seconds    poll_interval_;
+    const callback_t              callback_;
+
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    bool                    abort_request_ = false;
+    std::thread             thread_;
+
+    impl(boost::filesystem::path folder, std::chrono::seconds poll_interval, callback_t callback)
+        : folder_(std::move(folder))
+        , poll_interval_(poll_interval)
+        , callback_(std::move(callback))
+    {
+        thread_ = std::thread([this] {
+            set_thread_name(L"directory-watcher");
+            try {
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!abort_request_) {
+            if (poll_interval_.count() <= 0) {
+                cond_.wait(lock, [&] { return abort_request_; });
+                continue;
+            }
+
+            if (cond_.wait_for(lock, poll_interval_, [&] { return abort_request_; })) {
+                return;
+            }
+
+            lock.unlock();
+            callback_({});
+            lock.lock();
+        }
+    }
+};
+
+directory_watcher::directory_watcher(boost::filesystem::path   folder,
+                                     std::chrono::milliseconds settle_time,
+                                     std::chrono::seconds      poll_interval,
+                                     callback_t                callback)
+    : impl_(new impl(std::move(folder), poll_interval, std::move(callback)))
+{
+}
+
+directory_watcher::~directory_watcher() {}
+
+} // namespace caspar
@@ -23,11 +23,19 @@
 
 #include "../filesystem.h"
 
-#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
 namespace caspar {
 
+// Names are looked up by the file system, which is case insensitive, so there is nothing to index.
+void add_case_insensitive_index(const std::wstring& folder) {}
+
+void case_insensitive_index_changed(const boost::filesystem::path&              folder,
+                                    const std::vector<boost::filesystem::path>& paths)
+{
+}
+
 std::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive)
 {
     if (boost::filesystem::exists(case_insensitive))
@@ -36,6 +44,23 @@ std::optional<std::wstring> find_case_insensitive(const std::wstring& case_insen
     return {};
 }
 
+std::vector<boost::filesystem::path> find_files_case_insensitive(const boost::filesystem::path& folder,
+                                                                 const std::wstring&            name)
+{
+    std::vector<boost::filesystem::path> result;
+
+    auto loc = std::locale(""); // Use system locale
+
+    for (auto it = boost::filesystem::directory_iterator(folder); it != boost::filesystem::directory_iterator(); ++it) {
+        if (boost::iequals(it->path().filename().wstring(), name, loc) ||
+            boost::iequals(it->path().stem().wstring(), name, loc)) {
+            result.push_back(it->path());
+        }
+    }
+
+    return result;
+}
+
 std::wstring clean_path(std::wstring path) { return path; }
 
 std::wstring ensure_trailing_slash(std::wstring folder)
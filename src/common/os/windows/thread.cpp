@@ -35,4 +35,6 @@ void set_thread_name(const std::wstring& name) { SetThreadName(GetCurrentThreadI
 
 void set_thread_realtime_priority() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL); }
 
+void set_thread_background_priority() { SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN); }
+
 } // namespace caspar
@@ -30,6 +30,7 @@
 #include <common/diagnostics/graph.h>
 #include <common/executor.h>
 #include <common/future.h>
+#include <common/scope_exit.h>
 
 #include <core/frame/frame_transform.h>
 #include <core/producer/route/route_producer.h>
@@ -57,6 +58,7 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     executor   executor_{L"stage " + std::to_wstring(channel_index_)};
     std::mutex lock_;
+    bool       batch_ = false;
 
   private:
     void orderSourceLayers(std::vector<std::pair<int, bool>>&        layerVec,
@@ -99,6 +101,19 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         }
     }
 
+    // Operations of a batch run inline, so that the whole batch is applied within a single stage task.
+    template <typename Func>
+    auto dispatch(Func&& func)
+    {
+        if (executor_.is_current() && batch_) {
+            std::packaged_task<decltype(func())()> task(std::forward<Func>(func));
+            task();
+            return task.get_future();
+        }
+
+        return executor_.begin_invoke(std::forward<Func>(func));
+    }
+
     layer& get_layer(int index)
     {
         auto it = layers_.find(index);
@@ -243,7 +258,7 @@ struct stage::impl : public std::enable_shared_from_this<impl>
     std::future<void>
     apply_transforms(const std::vector<std::tuple<int, stage::transform_func_t, unsigned int, tweener>>& transforms)
     {
-        return executor_.begin_invoke([=] {
+        return dispatch([=] {
             for (auto& transform : transforms) {
                 auto& tween = tweens_[std::get<0>(transform)];
                 auto  src   = tween.fetch();
@@ -259,7 +274,7 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                                       unsigned int                   mix_duration,
                                       const tweener&                 tween)
     {
-        return executor_.begin_invoke([=] {
+        return dispatch([=] {
             auto src       = tweens_[index].fetch();
             auto dst       = transform(src);
             tweens_[index] = tweened_transform(src, dst, mix_duration, tween);
@@ -268,57 +283,57 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> clear_transforms(int index)
     {
-        return executor_.begin_invoke([=] { tweens_.erase(index); });
+        return dispatch([=] { tweens_.erase(index); });
     }
 
     std::future<void> clear_transforms()
     {
-        return executor_.begin_invoke([=] { tweens_.clear(); });
+        return dispatch([=] { tweens_.clear(); });
     }
 
     std::future<frame_transform> get_current_transform(int index)
     {
-        return executor_.begin_invoke([=] { return tweens_[index].fetch(); });
+        return dispatch([=] { return tweens_[index].fetch(); });
     }
 
     std::future<void> load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview, bool auto_play)
     {
-        return executor_.begin_invoke([=] { get_layer(index).load(producer, preview, auto_play); });
+        return dispatch([=] { get_layer(index).load(producer, preview, auto_play); });
     }
 
     std::future<void> preview(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).preview(); });
+        return dispatch([=] { get_layer(index).preview(); });
     }
 
     std::future<void> pause(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).pause(); });
+        return dispatch([=] { get_layer(index).pause(); });
     }
 
     std::future<void> resume(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).resume(); });
+        return dispatch([=] { get_layer(index).resume(); });
     }
 
     std::future<void> play(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).play(); });
+        return dispatch([=] { get_layer(index).play(); });
     }
 
     std::future<void> stop(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).stop(); });
+        return dispatch([=] { get_layer(index).stop(); });
     }
 
     std::future<void> clear(int index)
     {
-        return executor_.begin_invoke([=] { layers_.erase(index); });
+        return dispatch([=] { layers_.erase(index); });
     }
 
     std::future<void> clear()
     {
-        return executor_.begin_invoke([=] { layers_.clear(); });
+        return dispatch([=] { layers_.clear(); });
     }
 
     std::future<void> swap_layers(const std::shared_ptr<stage>& other, bool swap_transforms)
@@ -344,7 +359,7 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> swap_layer(int index, int other_index, bool swap_transforms)
     {
-        return executor_.begin_invoke([=] {
+        return dispatch([=] {
             std::swap(get_layer(index), get_layer(other_index));
 
             if (swap_transforms)
@@ -379,35 +394,47 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         auto other_impl = other->impl_;
 
         if (other_impl->channel_index_ < channel_index_) {
-            return other_impl->executor_.begin_invoke([=] { executor_.invoke(func); });
+            return other_impl->dispatch([=] { executor_.invoke(func); });
         }
 
-        return executor_.begin_invoke([=] { other_impl->executor_.invoke(func); });
+        return dispatch([=] { other_impl->executor_.invoke(func); });
     }
 
     std::future<std::shared_ptr<frame_producer>> foreground(int index)
     {
-        return executor_.begin_invoke(
+        return dispatch(
             [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).foreground(); });
     }
 
     std::future<std::shared_ptr<frame_producer>> background(int index)
     {
-        return executor_.begin_invoke(
+        return dispatch(
             [=]() -> std::shared_ptr<frame_producer> { return get_layer(index).background(); });
     }
 
     std::future<std::wstring> call(int index, const std::vector<std::wstring>& params)
     {
-        return flatten(executor_.begin_invoke([=] { return get_layer(index).foreground()->call(params).share(); }));
+        return flatten(dispatch([=] { return get_layer(index).foreground()->call(params).share(); }));
     }
     std::future<std::wstring> callbg(int index, const std::vector<std::wstring>& params)
     {
-        return flatten(executor_.begin_invoke([=] { return get_layer(index).background()->call(params).share(); }));
+        return flatten(dispatch([=] { return get_layer(index).background()->call(params).share(); }));
     }
 
     std::unique_lock<std::mutex> get_lock() { return std::move(std::unique_lock<std::mutex>(lock_)); }
 
+    std::future<void> apply_batch(std::vector<std::function<void()>> operations)
+    {
+        return executor_.begin_invoke([=] {
+            batch_ = true;
+            CASPAR_SCOPE_EXIT { batch_ = false; };
+
+            for (auto& operation : operations) {
+                operation();
+            }
+        });
+    }
+
     core::video_format_desc video_format_desc() const
     {
         std::lock_guard<std::mutex> lock(format_desc_mutex_);
@@ -494,6 +521,10 @@ std::future<void>       stage::video_format_desc(const core::video_format_desc&
     return impl_->video_format_desc(format_desc);
 }
 std::unique_lock<std::mutex> stage::get_lock() const { return impl_->get_lock(); }
+std::future<void>            stage::apply_batch(std::vector<std::function<void()>> operations)
+{
+    return impl_->apply_batch(std::move(operations));
+}
 std::future<void>            stage::execute(std::function<void()> func)
 {
     func();
@@ -501,25 +532,40 @@ std::future<void>            stage::execute(std::function<void()> func)
 }
 
 // STAGE DELAYED (For batching operations)
-stage_delayed::stage_delayed(std::shared_ptr<stage>& st, int index)
-    : executor_{L"batch stage " + boost::lexical_cast<std::wstring>(index)}
-    , stage_(st)
+stage_delayed::stage_delayed(std::shared_ptr<stage>& st)
+    : stage_(st)
+{
+}
+
+template <typename Func>
+auto stage_delayed::record(Func&& func)
+{
+    using result_type = decltype(func().get());
+
+    // The stage future is passed on rather than waited for, as it may complete after the batch task.
+    auto task = std::make_shared<std::packaged_task<std::shared_future<result_type>()>>(
+        [func = std::forward<Func>(func)] { return func().share(); });
+    operations_.push_back([task] { (*task)(); });
+
+    return flatten(task->get_future());
+}
+
+std::future<void> stage_delayed::release()
 {
-    // Start the executor blocked on a future that will complete when we are ready for it to execute
-    executor_.begin_invoke([=]() -> void { waiter_.get_future().get(); });
+    return stage_->apply_batch(std::move(operations_));
 }
 
 std::future<std::wstring> stage_delayed::call(int index, const std::vector<std::wstring>& params)
 {
-    return executor_.begin_invoke([=]() -> std::wstring { return stage_->call(index, params).get(); });
+    return record([=] { return stage_->call(index, params); });
 }
 std::future<std::wstring> stage_delayed::callbg(int index, const std::vector<std::wstring>& params)
 {
-    return executor_.begin_invoke([=]() -> std::wstring { return stage_->callbg(index, params).get(); });
+    return record([=] { return stage_->callbg(index, params); });
 }
 std::future<void> stage_delayed::apply_transforms(const std::vector<stage_delayed::transform_tuple_t>& transforms)
 {
-    return executor_.begin_invoke([=]() { return stage_->apply_transforms(transforms).get(); });
+    return record([=] { return stage_->apply_transforms(transforms); });
 }
 std::future<void>
 stage_delayed::apply_transform(int                                                                index,
@@ -527,62 +573,65 @@ stage_delayed::apply_transform(int
                                unsigned int                                                       mix_duration,
                                const tweener&                                                     tween)
 {
-    return executor_.begin_invoke(
-        [=]() { return stage_->apply_transform(index, transform, mix_duration, tween).get(); });
+    return record([=] { return stage_->apply_transform(index, transform, mix_duration, tween); });
 }
 std::future<void> stage_delayed::clear_transforms(int index)
 {
-    return executor_.begin_invoke([=]() { return stage_->clear_transforms(index).get(); });
+    return record([=] { return stage_->clear_transforms(index); });
 }
 std::future<void> stage_delayed::clear_transforms()
 {
-    return executor_.begin_invoke([=]() { return stage_->clear_transforms().get(); });
+    return record([=] { return stage_->clear_transforms(); });
 }
 std::future<frame_transform> stage_delayed::get_current_transform(int index)
 {
-    return executor_.begin_invoke([=]() { return stage_->get_current_transform(index).get(); });
+    return record([=] { return stage_->get_current_transform(index); });
 }
 std::future<void>
 stage_delayed::load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview, bool auto_play)
 {
-    return executor_.begin_invoke([=]() { return stage_->load(index, producer, preview, auto_play).get(); });
+    return record([=] { return stage_->load(index, producer, preview, auto_play); });
 }
 std::future<void> stage_delayed::preview(int index)
 {
-    return executor_.begin_invoke([=]() { return stage_->preview(index).get(); });
+    return record([=] { return stage_->preview(index); });
 }
 std::future<void> stage_delayed::pause(int index)
 {
-    return executor_.begin_invoke([=]() { return stage_->pause(index).get(); });
+    return record([=] { return stage_->pause(index); });
 }
 std::future<void> stage_delayed::resume(int index)
 {
-    return executor_.begin_invoke([=]() { return stage_->resume(index).get(); });
+    return record([=] { return stage_->resume(index); });
 }
 std::future<void> stage_delayed::play(int index)
 {
-    return executor_.begin_invoke([=]() { return stage_->play(index).get(); });
+    return record([=] { return stage_->play(index); });
 }
 std::future<void> stage_delayed::stop(int index)
 {
-    return executor_.begin_invoke([=]() { return stage_->stop(index).get(); });
+    return record([=] { return stage_->stop(index); });
 }
 std::future<void> stage_delayed::clear(int index)
 {
-    return executor_.begin_invoke([=]() { return stage_->clear(index).get(); });
+    return record([=] { return stage_->clear(index); });
 }
 std::future<void> stage_delayed::clear()
 {
-    return executor_.begin_invoke([=]() { return stage_->clear().get(); });
+    return record([=] { return stage_->clear(); });
 }
 std::future<void> stage_delayed::swap_layers(const std::shared_ptr<stage_base>& other, bool swap_transforms)
 {
     const auto other2 = std::static_pointer_cast<stage_delayed>(other);
-    return executor_.begin_invoke([=]() { return stage_->swap_layers(other2->stage_, swap_transforms).get(); });
+
+    // Something so that we know to lock the channel
+    other2->operations_.push_back([] {});
+
+    return record([=] { return stage_->swap_layers(other2->stage_, swap_transforms); });
 }
 std::future<void> stage_delayed::swap_layer(int index, int other_index, bool swap_transforms)
 {
-    return executor_.begin_invoke([=]() { return stage_->swap_layer(index, other_index, swap_transforms).get(); });
+    return record([=] { return stage_->swap_layer(index, other_index, swap_transforms); });
 }
 std::future<void>
 stage_delayed::swap_layer(int index, int other_index, const std::shared_ptr<stage_base>& other, bool swap_transforms)
@@ -590,24 +639,23 @@ stage_delayed::swap_layer(int index, int other_index, const std::shared_ptr<stag
     const auto other2 = std::static_pointer_cast<stage_delayed>(other);
 
     // Something so that we know to lock the channel
-    other2->executor_.begin_invoke([]() {});
+    other2->operations_.push_back([] {});
 
-    return executor_.begin_invoke(
-        [=]() { return stage_->swap_layer(index, other_index, other2->stage_, swap_transforms).get(); });
+    return record([=] { return stage_->swap_layer(index, other_index, other2->stage_, swap_transforms); });
 }
 
 std::future<std::shared_ptr<frame_producer>> stage_delayed::foreground(int index)
 {
-    return executor_.begin_invoke([=]() -> std::shared_ptr<frame_producer> { return stage_->foreground(index).get(); });
+    return record([=] { return stage_->foreground(index); });
 }
 std::future<std::shared_ptr<frame_producer>> stage_delayed::background(int index)
 {
-    return executor_.begin_invoke([=]() -> std::shared_ptr<frame_producer> { return stage_->background(index).get(); });
+    return record([=] { return stage_->background(index); });
 }
 
 std::future<void> stage_delayed::execute(std::function<void()> func)
 {
-    return executor_.begin_invoke([=]() { return stage_->execute(func).get(); });
+    return record([=] { return stage_->execute(func); });
 }
 
 }} // namespace caspar::core
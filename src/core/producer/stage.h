@@ -154,6 +154,10 @@ class stage final : public stage_base
     std::future<void>            execute(std::function<void()> k) override;
     std::unique_lock<std::mutex> get_lock() const;
 
+    // Runs the operations in a single task, so that they all take effect on the same frame. Stage operations invoked
+    // from within the task are applied immediately rather than queued.
+    std::future<void> apply_batch(std::vector<std::function<void()>> operations);
+
     core::video_format_desc video_format_desc() const;
     std::future<void>       video_format_desc(const core::video_format_desc& format_desc);
 
@@ -169,12 +173,13 @@ class stage final : public stage_base
 class stage_delayed final : public stage_base
 {
   public:
-    stage_delayed(std::shared_ptr<stage>& st, int index);
+    explicit stage_delayed(std::shared_ptr<stage>& st);
+
+    int64_t count_queued() const { return static_cast<int64_t>(operations_.size()); }
+    void    abort() { operations_.clear(); }
 
-    int64_t count_queued() const { return executor_.size(); }
-    void    release() { waiter_.set_value(); }
-    void    abort() { executor_.clear(); }
-    void    wait() { executor_.stop_and_wait(); }
+    // Applies the recorded operations to the stage in a single task.
+    std::future<void> release();
 
     std::future<void>            apply_transforms(const std::vector<transform_tuple_t>& transforms) override;
     std::future<void>            apply_transform(int                     index,
@@ -211,9 +216,11 @@ class stage_delayed final : public stage_base
     std::unique_lock<std::mutex> get_lock() const { return stage_->get_lock(); }
 
   private:
-    std::promise<void>      waiter_;
-    std::shared_ptr<stage>& stage_;
-    executor                executor_;
+    template <typename Func>
+    auto record(Func&& func);
+
+    std::vector<std::function<void()>> operations_;
+    std::shared_ptr<stage>&            stage_;
 };
 
 }} // namespace caspar::core
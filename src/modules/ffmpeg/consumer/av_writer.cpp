@@ -0,0 +1,432 @@
+#include "av_writer.h"
+
+#include "../util/av_assert.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavformat/version.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#ifdef _MSC_VER
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const int         IO_BUFFER_SIZE = 256 * 1024;
+const std::size_t ALIGNMENT      = 4096;
+
+std::size_t align(std::size_t size) { return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+double smooth(double prev, double value) { return prev > 0.0 ? prev * 0.9 + value * 0.1 : value; }
+
+std::shared_ptr<std::uint8_t> alloc_aligned(std::size_t size)
+{
+#ifdef _MSC_VER
+    auto ptr = static_cast<std::uint8_t*>(_aligned_malloc(size, ALIGNMENT));
+    if (!ptr) {
+        FF_RET(AVERROR(ENOMEM), "_aligned_malloc");
+    }
+    return std::shared_ptr<std::uint8_t>(ptr, [](std::uint8_t* p) { _aligned_free(p); });
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, ALIGNMENT, size) != 0) {
+        FF_RET(AVERROR(ENOMEM), "posix_memalign");
+    }
+    return std::shared_ptr<std::uint8_t>(static_cast<std::uint8_t*>(ptr), [](std::uint8_t* p) { std::free(p); });
+#endif
+}
+
+int open_file(const std::string& filename, bool direct)
+{
+#ifdef _MSC_VER
+    int fd = -1;
+    _wsopen_s(&fd,
+              u16(filename).c_str(),
+              _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+              _SH_DENYNO,
+              _S_IREAD | _S_IWRITE);
+    return fd;
+#else
+    auto flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (direct) {
+        flags |= O_DIRECT;
+    }
+#endif
+    return ::open(filename.c_str(), flags, 0644);
+#endif
+}
+
+int write_at(int fd, const std::uint8_t* data, std::size_t size, std::int64_t offset)
+{
+    while (size > 0) {
+#ifdef _MSC_VER
+        if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+            return AVERROR(errno);
+        }
+        const auto count = _write(fd, data, static_cast<unsigned int>(std::min<std::size_t>(size, INT_MAX)));
+#else
+        const auto count = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+#endif
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return AVERROR(errno);
+        }
+        data += count;
+        size -= static_cast<std::size_t>(count);
+        offset += count;
+    }
+    return 0;
+}
+
+// Reserves disk space ahead of the writes without changing the file size, so that the file system does not have
+// to allocate extents while a block is written.
+void preallocate(int fd, std::int64_t offset, std::int64_t len)
+{
+#ifdef __linux__
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(len)) != 0 &&
+        errno != EOPNOTSUPP) {
+        CASPAR_LOG(warning) << L"[ffmpeg] fallocate failed: " << errno;
+    }
+#endif
+}
+
+void truncate_file(int fd, std::int64_t size)
+{
+#ifdef _MSC_VER
+    _chsize_s(fd, size);
+#else
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        CASPAR_LOG(warning) << L"[ffmpeg] ftruncate failed: " << errno;
+    }
+#endif
+}
+
+void close_file(int fd)
+{
+#ifdef _MSC_VER
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+} // namespace
+
+FileWriter::FileWriter(const std::string&                  filename,
+                       std::size_t                         block_size,
+                       std::size_t                         block_count,
+                       std::int64_t                        preallocate,
+                       std::shared_ptr<diagnostics::graph> graph,
+                       std::shared_ptr<WriteStats>         stats)
+    : filename_(filename)
+    , block_size_(align(std::max<std::size_t>(block_size, ALIGNMENT)))
+    , preallocate_(preallocate)
+    , graph_(std::move(graph))
+    , stats_(std::move(stats))
+{
+    fd_ = open_file(filename_, true);
+    if (fd_ < 0 && errno == EINVAL) {
+        // O_DIRECT is not supported by every file system, e.g. tmpfs.
+        CASPAR_LOG(warning) << L"[ffmpeg] " << u16(filename_) << L" does not support direct I/O.";
+        fd_ = open_file(filename_, false);
+    }
+    if (fd_ < 0) {
+        FF_RET(AVERROR(errno), "open");
+    }
+
+    patch_fd_ = open_file(filename_, false);
+    if (patch_fd_ < 0) {
+        const auto error = AVERROR(errno);
+        close_file(fd_);
+        FF_RET(error, "open");
+    }
+
+    // The whole ring is allocated up front so that recording never allocates.
+    block_count_ = std::max<std::size_t>(block_count, 2);
+    for (auto n = 0ULL; n < block_count_; ++n) {
+        free_.push_back(Block{alloc_aligned(block_size_)});
+    }
+    current_ = std::move(free_.back());
+    free_.pop_back();
+    std::memset(current_.data.get(), 0, block_size_);
+
+    graph_->set_color("write-ring", diagnostics::color(0.9f, 0.6f, 0.4f));
+    graph_->set_color("write-stall", diagnostics::color(0.9f, 0.2f, 0.2f));
+
+    auto buffer = static_cast<std::uint8_t*>(av_malloc(IO_BUFFER_SIZE));
+    if (!buffer) {
+        close_file(fd_);
+        close_file(patch_fd_);
+        FF_RET(AVERROR(ENOMEM), "av_malloc");
+    }
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    using buf_t = const std::uint8_t*;
+#else
+    using buf_t = std::uint8_t*;
+#endif
+
+    auto ctx = avio_alloc_context(
+        buffer,
+        IO_BUFFER_SIZE,
+        1,
+        this,
+        nullptr,
+        [](void* opaque, buf_t buf, int buf_size) { return static_cast<FileWriter*>(opaque)->write(buf, buf_size); },
+        &FileWriter::seek_packet);
+    if (!ctx) {
+        av_free(buffer);
+        close_file(fd_);
+        close_file(patch_fd_);
+        FF_RET(AVERROR(ENOMEM), "avio_alloc_context");
+    }
+
+    ctx_ = std::shared_ptr<AVIOContext>(ctx, [](AVIOContext* ptr) {
+        av_freep(&ptr->buffer);
+        avio_context_free(&ptr);
+    });
+
+    thread_ = std::thread([this] {
+        try {
+            set_thread_name(L"[ffmpeg::consumer::FileWriter]");
+            run();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+FileWriter::~FileWriter()
+{
+    try {
+        close();
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+}
+
+void FileWriter::close()
+{
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        // The final block is padded to the direct I/O alignment and the file truncated afterwards.
+        const auto size = tail_ - current_.offset;
+        if (size > 0) {
+            submit(lock, align(static_cast<std::size_t>(size)));
+        }
+        wait_idle(lock);
+
+        abort_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+
+    truncate_file(patch_fd_, tail_);
+    close_file(fd_);
+    close_file(patch_fd_);
+
+    if (error_ != 0) {
+        FF_RET(error_, "write");
+    }
+}
+
+int64_t FileWriter::seek_packet(void* opaque, int64_t offset, int whence)
+{
+    return static_cast<FileWriter*>(opaque)->seek(offset, whence);
+}
+
+int FileWriter::write(const std::uint8_t* buf, int buf_size)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto done = std::size_t{0};
+    while (done < static_cast<std::size_t>(buf_size)) {
+        if (error_ != 0) {
+            return error_;
+        }
+
+        const auto remaining = static_cast<std::size_t>(buf_size) - done;
+
+        if (pos_ < current_.offset) {
+            // Already handed to the writer, patch it once those writes have completed.
+            wait_idle(lock);
+
+            const auto count = std::min<std::size_t>(remaining, static_cast<std::size_t>(current_.offset - pos_));
+            const auto error = write_at(patch_fd_, buf + done, count, pos_);
+            if (error != 0) {
+                return error;
+            }
+            pos_ += count;
+            done += count;
+            continue;
+        }
+
+        const auto offset = static_cast<std::size_t>(pos_ - current_.offset);
+        if (offset >= block_size_) {
+            submit(lock, block_size_);
+            continue;
+        }
+
+        const auto count = std::min(remaining, block_size_ - offset);
+        std::memcpy(current_.data.get() + offset, buf + done, count);
+        pos_ += count;
+        done += count;
+        tail_ = std::max(tail_, pos_);
+    }
+
+    return buf_size;
+}
+
+int64_t FileWriter::seek(int64_t offset, int whence)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (whence & AVSEEK_SIZE) {
+        return tail_;
+    }
+
+    std::int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = pos_ + offset;
+            break;
+        case SEEK_END:
+            pos = tail_ + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    pos_ = pos;
+    return pos;
+}
+
+// Hands the current block to the writer and continues in a free one, waiting for one if the ring is full.
+void FileWriter::submit(std::unique_lock<std::mutex>& lock, std::size_t size)
+{
+    const auto offset = current_.offset + static_cast<std::int64_t>(block_size_);
+
+    current_.size = size;
+    pending_.push_back(std::move(current_));
+    cond_.notify_all();
+
+    graph_->set_value("write-ring", static_cast<double>(pending_.size()) / static_cast<double>(block_count_));
+
+    if (free_.empty()) {
+        stats_->stalls += 1;
+        graph_->set_tag(diagnostics::tag_severity::WARNING, "write-stall");
+        cond_.wait(lock, [&] { return !free_.empty(); });
+    }
+
+    current_ = std::move(free_.back());
+    free_.pop_back();
+
+    current_.offset = offset;
+    current_.size   = 0;
+    std::memset(current_.data.get(), 0, block_size_);
+}
+
+void FileWriter::wait_idle(std::unique_lock<std::mutex>& lock)
+{
+    cond_.wait(lock, [&] { return (pending_.empty() && !writing_) || error_ != 0; });
+}
+
+void FileWriter::run()
+{
+    while (true) {
+        Block block;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return abort_ || !pending_.empty(); });
+
+            if (pending_.empty()) {
+                return;
+            }
+
+            block = std::move(pending_.front());
+            pending_.pop_front();
+            writing_ = true;
+        }
+
+        const auto end = block.offset + static_cast<std::int64_t>(block.size);
+        if (preallocate_ > 0 && end > allocated_) {
+            const auto len = std::max(preallocate_, end - allocated_);
+            preallocate(fd_, allocated_, len);
+            allocated_ += len;
+        }
+
+        const auto start   = std::chrono::steady_clock::now();
+        const auto error   = write_at(fd_, block.data.get(), block.size, block.offset);
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        stats_->bytes_written += error == 0 ? static_cast<std::int64_t>(block.size) : 0;
+        stats_->latency     = smooth(stats_->latency, elapsed * 1000.0);
+        stats_->max_latency = std::max(stats_->max_latency.load(), elapsed * 1000.0);
+        if (elapsed > 0.0) {
+            stats_->throughput = smooth(stats_->throughput, block.size / (1024.0 * 1024.0) / elapsed);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (error != 0 && error_ == 0) {
+                CASPAR_LOG(error) << L"[ffmpeg] Failed to write " << u16(filename_) << L".";
+                error_ = error;
+            }
+            writing_ = false;
+            free_.push_back(std::move(block));
+
+            graph_->set_value("write-ring", static_cast<double>(pending_.size()) / static_cast<double>(block_count_));
+        }
+        cond_.notify_all();
+    }
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <common/diagnostics/graph.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+struct WriteStats
+{
+    std::atomic<std::int64_t> bytes_written{0};
+    std::atomic<double>       throughput{0.0};  // MiB/s
+    std::atomic<double>       latency{0.0};     // ms per block
+    std::atomic<double>       max_latency{0.0}; // ms per block
+    std::atomic<std::int64_t> stalls{0};
+};
+
+// Custom AVIOContext for recording to local files. The muxer output is collected in a ring of large aligned
+// blocks which a background thread writes with O_DIRECT, bypassing the page cache, while the file is grown
+// ahead of the writes with fallocate. Writes behind the ring, e.g. a muxer patching its header in
+// av_write_trailer, go through a second, buffered descriptor.
+class FileWriter
+{
+  public:
+    FileWriter(const std::string&                  filename,
+               std::size_t                         block_size,
+               std::size_t                         block_count,
+               std::int64_t                        preallocate,
+               std::shared_ptr<diagnostics::graph> graph,
+               std::shared_ptr<WriteStats>         stats);
+    ~FileWriter();
+
+    FileWriter(const FileWriter&)            = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    AVIOContext* context() const { return ctx_.get(); }
+
+    // Writes out everything still buffered and truncates the file to the size written by the muxer.
+    void close();
+
+  private:
+    struct Block
+    {
+        std::shared_ptr<std::uint8_t> data;
+        std::int64_t                  offset = 0;
+        std::size_t                   size   = 0;
+    };
+
+    static int64_t seek_packet(void* opaque, int64_t offset, int whence);
+
+    int     write(const std::uint8_t* buf, int buf_size);
+    int64_t seek(int64_t offset, int whence);
+    void    submit(std::unique_lock<std::mutex>& lock, std::size_t size);
+    void    wait_idle(std::unique_lock<std::mutex>& lock);
+    void    run();
+
+    const std::string                   filename_;
+    const std::size_t                   block_size_;
+    const std::int64_t                  preallocate_;
+    std::shared_ptr<diagnostics::graph> graph_;
+    std::shared_ptr<WriteStats>         stats_;
+
+    int  fd_       = -1;
+    int  patch_fd_ = -1;
+    bool closed_   = false;
+
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    std::deque<Block>       pending_;
+    std::vector<Block>      free_;
+    Block                   current_;
+    std::size_t             block_count_ = 0;
+    std::int64_t            pos_         = 0;
+    std::int64_t            tail_        = 0;
+    std::int64_t            allocated_   = 0;
+    bool                    writing_     = false;
+    int                     error_       = 0;
+    bool                    abort_       = false;
+
+    std::shared_ptr<AVIOContext> ctx_;
+    std::thread                  thread_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -21,6 +21,8 @@
 
 #include "ffmpeg_consumer.h"
 
+#include "av_writer.h"
+
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
@@ -32,14 +34,17 @@
 #include <common/memory.h>
 #include <common/scope_exit.h>
 #include <common/timer.h>
+#include <common/utf.h>
 
 #include <core/consumer/channel_info.h>
 #include <core/frame/frame.h>
 #include <core/video_format.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/regex.hpp>
 
@@ -74,15 +79,18 @@ extern "C" {
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
 
+#include <algorithm>
+#include <ctime>
+#include <functional>
+#include <map>
 #include <memory>
 #include <optional>
+#include <string>
 #include <thread>
+#include <vector>
 
 namespace caspar { namespace ffmpeg {
 
-// TODO multiple output streams
-// TODO multiple output files
-// TODO run video filter, video encoder, audio filter, audio encoder in separate threads.
 // TODO realtime with smaller buffer?
 
 struct Stream
@@ -94,14 +102,14 @@ struct Stream
     std::shared_ptr<AVCodecContext> enc = nullptr;
     AVStream*                       st  = nullptr;
 
-    tbb::concurrent_bounded_queue<std::shared_ptr<SwsContext>> sws_;
-
     int64_t pts = 0;
 
     Stream(AVFormatContext*                    oc,
            std::string                         suffix,
            AVCodecID                           codec_id,
            const core::video_format_desc&      format_desc,
+           int                                 width,
+           int                                 height,
            bool                                realtime,
            common::bit_depth                   depth,
            std::map<std::string, std::string>& options)
@@ -180,12 +188,12 @@ struct Stream
 
             if (codec->type == AVMEDIA_TYPE_VIDEO) {
                 const auto sar = boost::rational<int>(format_desc.square_width, format_desc.square_height) /
-                                 boost::rational<int>(format_desc.width, format_desc.height);
+                                 boost::rational<int>(width, height);
 
                 const auto pix_fmt = (depth == common::bit_depth::bit8) ? AV_PIX_FMT_YUVA422P : AV_PIX_FMT_YUVA422P10;
 
                 auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:sar=%d/%d:frame_rate=%d/%d") %
-                             format_desc.width % format_desc.height % pix_fmt % format_desc.duration %
+                             width % height % pix_fmt % format_desc.duration %
                              (format_desc.time_scale * format_desc.field_count) % sar.numerator() % sar.denominator() %
                              (format_desc.framerate.numerator() * format_desc.field_count) %
                              format_desc.framerate.denominator())
@@ -340,14 +348,161 @@ struct Stream
         }
     }
 
+    // Feeds a frame, or nullptr to flush, through the filter graph and passes on every filtered frame.
+    // nullptr is passed on once the graph has been drained.
+    void filter(std::shared_ptr<AVFrame> frame, const std::function<void(std::shared_ptr<AVFrame>)>& cb)
+    {
+        if (frame) {
+            frame->pts = pts;
+            if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+                pts += 1;
+            } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
+                pts += frame->nb_samples;
+            }
+            FF(av_buffersrc_write_frame(source, frame.get()));
+        } else {
+            FF(av_buffersrc_close(source, pts, 0));
+        }
+
+        while (true) {
+            auto filtered = alloc_frame();
+            int  ret      = av_buffersink_get_frame(sink, filtered.get());
+            if (ret == AVERROR(EAGAIN)) {
+                return;
+            }
+            if (ret == AVERROR_EOF) {
+                cb(nullptr);
+                return;
+            }
+            FF_RET(ret, "av_buffersink_get_frame");
+            cb(std::move(filtered));
+        }
+    }
+
+    // Encodes a filtered frame, or drains the encoder on nullptr.
+    void encode(const std::shared_ptr<AVFrame>& frame, const std::function<void(std::shared_ptr<AVPacket>)>& cb)
+    {
+        FF(avcodec_send_frame(enc.get(), frame.get()));
+
+        while (true) {
+            auto pkt = alloc_packet();
+            int  ret = avcodec_receive_packet(enc.get(), pkt.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return;
+            }
+            FF_RET(ret, "avcodec_receive_packet");
+            pkt->stream_index = st->index;
+            av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
+            cb(std::move(pkt));
+        }
+    }
+};
+
+// Converts each channel frame from BGRA once and derives every rendition from it by cascaded downscaling,
+// so that a ladder costs a single colour conversion.
+class VideoConverter
+{
+    tbb::concurrent_bounded_queue<std::shared_ptr<SwsContext>> sws_;
+    std::vector<std::shared_ptr<SwsContext>>                   scalers_;
+
+  public:
+    std::shared_ptr<AVFrame> convert(const core::const_frame& in_frame, const core::video_format_desc& format_desc)
+    {
+        auto frame = make_av_video_frame(in_frame, format_desc);
+
+        auto frame2                 = alloc_frame();
+        frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
+        frame2->width               = frame->width;
+        frame2->height              = frame->height;
+        frame2->format              = AV_PIX_FMT_YUVA422P;
+        frame2->colorspace          = AVCOL_SPC_BT709;
+        frame2->color_primaries     = AVCOL_PRI_BT709;
+        frame2->color_range         = AVCOL_RANGE_MPEG;
+        frame2->color_trc           = AVCOL_TRC_BT709;
+        av_frame_get_buffer(frame2.get(), 64);
+
+        // YUVA422P has no vertical subsampling, so rows can be converted in independent slices.
+        auto convert_rows = [&](SwsContext* sws, int y, int rows) {
+            uint8_t* src[4] = {};
+            src[0]          = frame->data[0] + frame->linesize[0] * y;
+
+            uint8_t* dst[4] = {};
+            dst[0]          = frame2->data[0] + frame2->linesize[0] * y;
+            dst[1]          = frame2->data[1] + frame2->linesize[1] * y;
+            dst[2]          = frame2->data[2] + frame2->linesize[2] * y;
+            dst[3]          = frame2->data[3] + frame2->linesize[3] * y;
+
+            sws_scale(sws, src, frame->linesize, 0, rows, dst, frame2->linesize);
+        };
+
+        int h = frame->height / 8;
+        tbb::parallel_for(0, 8, [&](int i) { convert_rows(get_sws(frame->width, h).get(), i * h, h); });
+
+        // The rows left over when the height is not a multiple of 8, e.g. 6 rows of 486.
+        const int rest = frame->height - h * 8;
+        if (rest > 0) {
+            convert_rows(make_sws(frame->width, rest).get(), h * 8, rest);
+        }
+
+        return frame2;
+    }
+
+    // Scales an already converted frame for the rendition at index, keeping the display aspect ratio.
+    std::shared_ptr<AVFrame> scale(std::size_t index, const std::shared_ptr<AVFrame>& src, int width, int height)
+    {
+        if (src->width == width && src->height == height) {
+            return src;
+        }
+
+        if (scalers_.size() <= index) {
+            scalers_.resize(index + 1);
+        }
+
+        auto& sws = scalers_[index];
+        if (!sws) {
+            const auto format = static_cast<AVPixelFormat>(src->format);
+            sws.reset(sws_getContext(
+                          src->width, src->height, format, width, height, format, SWS_AREA, nullptr, nullptr, nullptr),
+                      [](SwsContext* ptr) { sws_freeContext(ptr); });
+            if (!sws) {
+                CASPAR_THROW_EXCEPTION(caspar_exception());
+            }
+        }
+
+        auto dst                 = alloc_frame();
+        dst->width               = width;
+        dst->height              = height;
+        dst->format              = src->format;
+        dst->colorspace          = src->colorspace;
+        dst->color_primaries     = src->color_primaries;
+        dst->color_range         = src->color_range;
+        dst->color_trc           = src->color_trc;
+        dst->sample_aspect_ratio = av_mul_q(src->sample_aspect_ratio.num ? src->sample_aspect_ratio : AVRational{1, 1},
+                                            AVRational{src->width * height, width * src->height});
+        FF(av_frame_get_buffer(dst.get(), 64));
+
+        sws_scale(sws.get(), src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+
+        return dst;
+    }
+
+  private:
+    // Contexts for the 8 equal slices of a frame are pooled, they all have the same size.
     std::shared_ptr<SwsContext> get_sws(int width, int height)
     {
         std::shared_ptr<SwsContext> sws;
 
-        if (sws_.try_pop(sws)) {
-            return sws;
+        if (!sws_.try_pop(sws)) {
+            sws = make_sws(width, height);
         }
 
+        return std::shared_ptr<SwsContext>(sws.get(), [this, sws](SwsContext*) { sws_.push(sws); });
+    }
+
+    static std::shared_ptr<SwsContext> make_sws(int width, int height)
+    {
+        std::shared_ptr<SwsContext> sws;
+
         sws.reset(sws_getContext(
                       width, height, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_YUVA422P, 0, nullptr, nullptr, nullptr),
                   [](SwsContext* ptr) { sws_freeContext(ptr); });
@@ -375,98 +530,499 @@ struct Stream
 
         sws_setColorspaceDetails(sws.get(), inv_table, in_full, table, out_full, brigthness, contrast, saturation);
 
-        return std::shared_ptr<SwsContext>(sws.get(), [this, sws](SwsContext*) { sws_.push(sws); });
+        return sws;
     }
+};
 
-    void send(core::const_frame&                             in_frame,
-              const core::video_format_desc&                 format_desc,
-              std::function<void(std::shared_ptr<AVPacket>)> cb)
+// Rolling recording. Packets are split into segments of a fixed duration or size, always starting on a video key
+// frame, and every segment is named by the time of day of its first frame, e.g. "rec_2024-01-31_14-03-22-12.mov".
+// Segments are opened ahead of time under a temporary name, and finished, renamed and expired on a separate thread,
+// so that file system latency never reaches the encoders.
+class SegmentWriter
+{
+  public:
+    struct Config
     {
-        std::shared_ptr<AVFrame>  frame;
-        std::shared_ptr<AVPacket> pkt;
+        int64_t duration  = 0; // AV_TIME_BASE units
+        int64_t size      = 0; // bytes
+        int64_t retention = 0; // seconds
 
-        if (in_frame) {
-            if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
-                frame = make_av_video_frame(in_frame, format_desc);
+        bool enabled() const { return duration > 0 || size > 0; }
+    };
 
-                {
-                    auto frame2                 = alloc_frame();
-                    frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
-                    frame2->width               = frame->width;
-                    frame2->height              = frame->height;
-                    frame2->format              = AV_PIX_FMT_YUVA422P;
-                    frame2->colorspace          = AVCOL_SPC_BT709;
-                    frame2->color_primaries     = AVCOL_PRI_BT709;
-                    frame2->color_range         = AVCOL_RANGE_MPEG;
-                    frame2->color_trc           = AVCOL_TRC_BT709;
-                    av_frame_get_buffer(frame2.get(), 64);
-
-                    int h = frame->height / 8;
-                    tbb::parallel_for(0, 8, [&](int i) {
-                        auto sws = get_sws(frame->width, h);
-
-                        uint8_t* src[4] = {};
-                        src[0]          = frame->data[0] + frame->linesize[0] * (i * h);
-
-                        uint8_t* dst[4] = {};
-                        dst[0]          = frame2->data[0] + frame2->linesize[0] * (i * h);
-                        dst[1]          = frame2->data[1] + frame2->linesize[1] * (i * h);
-                        dst[2]          = frame2->data[2] + frame2->linesize[2] * (i * h);
-                        dst[3]          = frame2->data[3] + frame2->linesize[3] * (i * h);
-
-                        sws_scale(sws.get(), src, frame->linesize, 0, h, dst, frame2->linesize);
-                    });
-
-                    int i = frame->height - h;
-                    if (i > 0) {
-                        // TODO
-                    }
+  private:
+    struct Segment
+    {
+        AVFormatContext*        oc = nullptr;
+        boost::filesystem::path tmp_path;
+        std::map<int, int64_t>  count;
+        int64_t                 start = 0;
+        int64_t                 bytes = 0;
 
-                    frame = std::move(frame2);
+        ~Segment()
+        {
+            if (oc) {
+                avio_closep(&oc->pb);
+                avformat_free_context(oc);
+            }
+        }
+    };
+
+    AVFormatContext* const                   template_;
+    const boost::filesystem::path            path_;
+    const Config                             config_;
+    const double                             fps_;
+    const std::map<std::string, std::string> options_;
+    const int                                video_index_;
+
+    boost::posix_time::ptime              start_time_;
+    int64_t                               start_pts_ = AV_NOPTS_VALUE;
+    int                                   number_    = 0;
+    std::shared_ptr<Segment>              segment_;
+    std::future<std::shared_ptr<Segment>> next_;
+
+    executor io_{L"ffmpeg-segment"};
+
+  public:
+    // Every segment gets a copy of the streams of oc, which is never opened itself.
+    SegmentWriter(AVFormatContext*                   oc,
+                  boost::filesystem::path            path,
+                  Config                             config,
+                  double                             fps,
+                  std::map<std::string, std::string> options,
+                  int                                video_index)
+        : template_(oc)
+        , path_(std::move(path))
+        , config_(config)
+        , fps_(fps)
+        , options_(std::move(options))
+        , video_index_(video_index)
+    {
+        next_ = open();
+    }
+
+    ~SegmentWriter()
+    {
+        try {
+            finish();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+
+    SegmentWriter(const SegmentWriter&)            = delete;
+    SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+    void write(std::shared_ptr<AVPacket> pkt)
+    {
+        const auto index = pkt->stream_index;
+        const auto tb    = template_->streams[index]->time_base;
+        const auto ts    = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        const auto pts   = av_rescale_q(ts, tb, AVRational{1, AV_TIME_BASE});
+        const auto key   = video_index_ < 0 || (index == video_index_ && (pkt->flags & AV_PKT_FLAG_KEY));
+
+        if (segment_ && key &&
+            ((config_.duration > 0 && pts - segment_->start >= config_.duration) ||
+             (config_.size > 0 && segment_->bytes >= config_.size))) {
+            close(std::move(segment_));
+        }
+
+        if (!segment_) {
+            if (start_pts_ == AV_NOPTS_VALUE) {
+                start_pts_  = pts;
+                start_time_ = boost::posix_time::microsec_clock::local_time();
+            }
+            segment_        = next_.get();
+            segment_->start = pts;
+            next_           = open();
+        }
+
+        segment_->count[index] += 1;
+        segment_->bytes += pkt->size;
+
+        av_packet_rescale_ts(pkt.get(), tb, segment_->oc->streams[index]->time_base);
+        FF(av_interleaved_write_frame(segment_->oc, pkt.get()));
+    }
+
+    // Finishes the current segment and drops the one opened ahead.
+    void finish()
+    {
+        if (segment_) {
+            close(std::move(segment_));
+        }
+
+        if (next_.valid()) {
+            auto next = next_.get();
+            io_.begin_invoke([next]() mutable {
+                const auto tmp_path = next->tmp_path;
+                next.reset();
+                boost::system::error_code ec;
+                boost::filesystem::remove(tmp_path, ec);
+            });
+        }
+    }
+
+  private:
+    std::future<std::shared_ptr<Segment>> open()
+    {
+        const auto number = number_++;
+
+        return io_.begin_invoke([this, number] {
+            auto segment      = std::make_shared<Segment>();
+            segment->tmp_path = path_.parent_path() / (path_.stem().string() + ".part" + std::to_string(number) +
+                                                       path_.extension().string());
+
+            const auto tmp_path = segment->tmp_path.string();
+
+            FF(avformat_alloc_output_context2(&segment->oc, template_->oformat, nullptr, tmp_path.c_str()));
+
+            for (auto n = 0U; n < template_->nb_streams; ++n) {
+                auto st = avformat_new_stream(segment->oc, nullptr);
+                if (!st) {
+                    FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
                 }
+                FF(avcodec_parameters_copy(st->codecpar, template_->streams[n]->codecpar));
+                st->time_base = template_->streams[n]->time_base;
+            }
 
-                frame->pts = pts;
-                pts += 1;
-            } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
-                frame      = make_av_audio_frame(in_frame, format_desc);
-                frame->pts = pts;
-                pts += frame->nb_samples;
-            } else {
-                // TODO
+            auto dict = to_dict(std::map<std::string, std::string>(options_));
+            CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+            FF(avio_open2(&segment->oc->pb, tmp_path.c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
+            FF(avformat_write_header(segment->oc, &dict));
+
+            if (number == 0) {
+                for (auto& p : to_map(&dict)) {
+                    CASPAR_LOG(warning) << L"[ffmpeg] Unused option " << u16(p.first) << L"=" << u16(p.second);
+                }
             }
-            FF(av_buffersrc_write_frame(source, frame.get()));
-        } else {
-            FF(av_buffersrc_close(source, pts, 0));
+
+            return segment;
+        });
+    }
+
+    void close(std::shared_ptr<Segment> segment)
+    {
+        auto path = segment_path(segment->start);
+
+        io_.begin_invoke([this, segment = std::move(segment), path = std::move(path)]() mutable {
+            try {
+                auto complete = true;
+                for (auto n = 0U; n < segment->oc->nb_streams; ++n) {
+                    complete = complete && segment->count[static_cast<int>(n)] > 0;
+                }
+                if (complete) {
+                    FF(av_write_trailer(segment->oc));
+                }
+                FF(avio_closep(&segment->oc->pb));
+
+                const auto tmp_path = segment->tmp_path;
+                segment.reset();
+                boost::filesystem::rename(tmp_path, path);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            remove_expired();
+        });
+    }
+
+    boost::filesystem::path segment_path(int64_t start) const
+    {
+        const auto time = start_time_ + boost::posix_time::microseconds(start - start_pts_);
+        const auto date = time.date();
+        const auto tod  = time.time_of_day();
+
+        const auto frame = static_cast<int>(static_cast<double>(tod.fractional_seconds()) * fps_ /
+                                            static_cast<double>(boost::posix_time::time_duration::ticks_per_second()));
+
+        const auto name = (boost::format("%s_%04d-%02d-%02d_%02d-%02d-%02d-%02d%s") % path_.stem().string() %
+                           static_cast<int>(date.year()) % static_cast<int>(date.month()) %
+                           static_cast<int>(date.day()) % tod.hours() % tod.minutes() % tod.seconds() % frame %
+                           path_.extension().string())
+                              .str();
+
+        return path_.parent_path() / name;
+    }
+
+    void remove_expired()
+    {
+        if (config_.retention <= 0) {
+            return;
         }
 
-        while (true) {
-            pkt     = alloc_packet();
-            int ret = avcodec_receive_packet(enc.get(), pkt.get());
+        static const boost::regex time_exp("_\\d{4}-\\d{2}-\\d{2}_\\d{2}-\\d{2}-\\d{2}-\\d{2}");
 
-            if (ret == AVERROR(EAGAIN)) {
-                frame = alloc_frame();
-                ret   = av_buffersink_get_frame(sink, frame.get());
-                if (ret == AVERROR(EAGAIN)) {
+        const auto stem      = path_.stem().string();
+        const auto extension = path_.extension().string();
+        const auto limit     = std::time(nullptr) - config_.retention;
+
+        try {
+            for (auto& entry : boost::filesystem::directory_iterator(path_.parent_path())) {
+                const auto name = entry.path().filename().string();
+                if (name.size() <= stem.size() + extension.size() || !boost::algorithm::starts_with(name, stem) ||
+                    !boost::algorithm::ends_with(name, extension) ||
+                    !boost::regex_match(name.substr(stem.size(), name.size() - stem.size() - extension.size()),
+                                        time_exp)) {
+                    continue;
+                }
+
+                if (boost::filesystem::last_write_time(entry.path()) < limit) {
+                    CASPAR_LOG(info) << L"[ffmpeg] Removing expired segment " << entry.path().wstring();
+                    boost::filesystem::remove(entry.path());
+                }
+            }
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+};
+
+struct Rendition
+{
+    int width;
+    int height;
+};
+
+// A single muxer with its own packet thread. Every rendition is written to its own output.
+struct Output
+{
+    std::string                        path;
+    AVFormatContext*                   oc = nullptr;
+    std::map<std::string, std::string> options;
+    std::optional<Stream>              video_stream;
+    AVStream*                          audio_st = nullptr;
+
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer;
+    std::thread                                              packet_thread;
+
+    std::unique_ptr<SegmentWriter> segments;
+    std::unique_ptr<FileWriter>    writer;
+    std::shared_ptr<WriteStats>    write_stats;
+
+    Output() = default;
+
+    Output(const Output&)            = delete;
+    Output& operator=(const Output&) = delete;
+
+    ~Output()
+    {
+        if (packet_thread.joinable()) {
+            // TODO Is nullptr needed?
+            packet_buffer.try_push(nullptr);
+            packet_buffer.abort();
+            packet_thread.join();
+        }
+        segments.reset();
+        video_stream.reset();
+        avformat_free_context(oc);
+    }
+
+    void start()
+    {
+        packet_thread = std::thread([this] {
+            try {
+                CASPAR_SCOPE_EXIT
+                {
+                    if (writer) {
+                        avio_flush(oc->pb);
+                        oc->pb = nullptr;
+                        writer->close();
+                    } else if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                        FF(avio_closep(&oc->pb));
+                    }
+                };
+
+                std::map<int, int64_t> count;
+
+                std::shared_ptr<AVPacket> pkt;
+                while (true) {
+                    packet_buffer.pop(pkt);
+                    if (!pkt) {
+                        break;
+                    }
+                    if (segments) {
+                        segments->write(std::move(pkt));
+                        continue;
+                    }
+                    count[pkt->stream_index] += 1;
+                    FF(av_interleaved_write_frame(oc, pkt.get()));
+                }
+
+                if (segments) {
+                    segments->finish();
                     return;
                 }
-                if (ret == AVERROR_EOF) {
-                    FF(avcodec_send_frame(enc.get(), nullptr));
-                } else {
-                    FF_RET(ret, "av_buffersink_get_frame");
-                    FF(avcodec_send_frame(enc.get(), frame.get()));
+
+                auto video_st = video_stream ? video_stream->st : nullptr;
+
+                if ((!video_st || count[video_st->index]) && (!audio_st || count[audio_st->index])) {
+                    FF(av_write_trailer(oc));
                 }
-            } else if (ret == AVERROR_EOF) {
-                return;
-            } else {
-                FF_RET(ret, "avcodec_receive_packet");
-                pkt->stream_index = st->index;
-                av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
-                cb(std::move(pkt));
+
+            } catch (tbb::user_abort&) {
+                // The queue is aborted when another stage has failed or the consumer is destroyed.
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                // Unblocks the encoders pushing packets.
+                packet_buffer.abort();
             }
+        });
+    }
+};
+
+// A single step of the encoding pipeline running on its own thread, so that a slow video encode does not hold
+// up audio and vice versa. An empty item is processed last and ends the stage. Processing time and queue depth
+// are reported to the consumer graph under the stage name, unless the name is empty.
+template <typename T>
+class Stage
+{
+    const std::string                   name_;
+    const double                        fps_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    tbb::concurrent_bounded_queue<T>    queue_;
+    std::thread                         thread_;
+
+  public:
+    Stage(std::string                             name,
+          spl::shared_ptr<diagnostics::graph>     graph,
+          double                                  fps,
+          int                                     capacity,
+          std::function<void(T)>                  func,
+          std::function<void(std::exception_ptr)> on_error)
+        : name_(std::move(name))
+        , fps_(fps)
+        , graph_(std::move(graph))
+    {
+        queue_.set_capacity(capacity);
+        thread_ = std::thread([this, func = std::move(func), on_error = std::move(on_error)] {
+            try {
+                while (true) {
+                    T item;
+                    queue_.pop(item);
+                    const bool last = !item;
+
+                    caspar::timer timer;
+                    func(std::move(item));
+                    if (!name_.empty()) {
+                        graph_->set_value(name_, timer.elapsed() * fps_ * 0.5);
+                        graph_->set_value(name_ + "-queue",
+                                          static_cast<double>(queue_.size() + 0.001) / queue_.capacity());
+                    }
+
+                    if (last) {
+                        break;
+                    }
+                }
+            } catch (tbb::user_abort&) {
+                // Another stage failed.
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                on_error(std::current_exception());
+            }
+        });
+    }
+
+    ~Stage()
+    {
+        if (thread_.joinable()) {
+            queue_.abort();
+            thread_.join();
         }
     }
+
+    Stage(const Stage&)            = delete;
+    Stage& operator=(const Stage&) = delete;
+
+    void push(T item) { queue_.push(std::move(item)); }
+
+    void abort() { queue_.abort(); }
+
+    void join() { thread_.join(); }
 };
 
+// Removes a numeric option, e.g. "-segment_duration 600", which is handled by the consumer rather than ffmpeg.
+double take_option(std::map<std::string, std::string>& options, const std::string& name)
+{
+    const auto it = options.find(name);
+    if (it == options.end()) {
+        return 0.0;
+    }
+
+    double value = 0.0;
+    if (!boost::conversion::try_lexical_convert(it->second, value) || value < 0.0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid value for " + name + ": " + it->second));
+    }
+    options.erase(it);
+    return value;
+}
+
+// "-renditions 1920x1080,1280x720,854x480"
+std::vector<Rendition> parse_renditions(const std::string& str)
+{
+    std::vector<Rendition> result;
+
+    std::vector<std::string> items;
+    boost::split(items, str, boost::is_any_of(","), boost::token_compress_on);
+    for (auto& item : items) {
+        static const boost::regex size_exp("^(\\d+)x(\\d+)$");
+
+        boost::smatch what;
+        if (!boost::regex_match(item, what, size_exp)) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid rendition " + item));
+        }
+        result.push_back(Rendition{std::stoi(what[1].str()), std::stoi(what[2].str())});
+    }
+
+    // Largest first, so that every rendition can be scaled from the previous one.
+    std::stable_sort(result.begin(), result.end(), [](const Rendition& lhs, const Rendition& rhs) {
+        return lhs.width * lhs.height > rhs.width * rhs.height;
+    });
+
+    return result;
+}
+
+// With more than one rendition, "%d" in the path is replaced by the rendition height, otherwise "_<height>p" is
+// appended to the name. A single output keeps its path, so that e.g. image2 patterns such as "frame%d.png" still work.
+std::string rendition_path(const std::string& path, const Rendition& rendition, std::size_t count)
+{
+    if (count < 2) {
+        return path;
+    }
+
+    const auto height = std::to_string(rendition.height);
+
+    if (boost::contains(path, "%d")) {
+        return boost::replace_all_copy(path, "%d", height);
+    }
+
+    const auto slash = path.find_last_of("/\\");
+    const auto dot   = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return path + "_" + height + "p";
+    }
+    return path.substr(0, dot) + "_" + height + "p" + path.substr(dot);
+}
+
+// Options suffixed with "@<height>" only apply to that rendition and override the shared ones.
+std::map<std::string, std::string> rendition_options(const std::map<std::string, std::string>& options,
+                                                     const Rendition&                          rendition)
+{
+    const auto suffix = "@" + std::to_string(rendition.height);
+
+    std::map<std::string, std::string> result;
+    for (auto& p : options) {
+        if (p.first.find('@') == std::string::npos) {
+            result.insert(p);
+        }
+    }
+    for (auto& p : options) {
+        if (boost::algorithm::ends_with(p.first, suffix)) {
+            result[p.first.substr(0, p.first.size() - suffix.size())] = p.second;
+        }
+    }
+    return result;
+}
+
 struct ffmpeg_consumer : public core::frame_consumer
 {
     core::monitor::state    state_;
@@ -505,7 +1061,14 @@ struct ffmpeg_consumer : public core::frame_consumer
         frame_buffer_.set_capacity(realtime_ ? 1 : 64);
 
         diagnostics::register_graph(graph_);
-        graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph_->set_color("video-filter", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph_->set_color("video-filter-queue", diagnostics::color(0.1f, 0.6f, 0.1f));
+        graph_->set_color("video-encode", diagnostics::color(0.1f, 1.0f, 1.0f));
+        graph_->set_color("video-encode-queue", diagnostics::color(0.1f, 0.6f, 0.6f));
+        graph_->set_color("audio-filter", diagnostics::color(1.0f, 1.0f, 0.1f));
+        graph_->set_color("audio-filter-queue", diagnostics::color(0.6f, 0.6f, 0.1f));
+        graph_->set_color("audio-encode", diagnostics::color(1.0f, 0.5f, 0.1f));
+        graph_->set_color("audio-encode-queue", diagnostics::color(0.6f, 0.3f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
     }
@@ -544,132 +1107,302 @@ struct ffmpeg_consumer : public core::frame_consumer
                     }
                 }
 
-                boost::filesystem::path full_path = path_;
-
-                static boost::regex prot_exp("^.+:.*");
-                if (!boost::regex_match(path_, prot_exp)) {
-                    if (!full_path.is_absolute()) {
-                        full_path = u8(env::media_folder()) + path_;
+                std::vector<Rendition> renditions;
+                {
+                    const auto renditions_it = options.find("renditions");
+                    if (renditions_it != options.end()) {
+                        renditions = parse_renditions(renditions_it->second);
+                        options.erase(renditions_it);
+                    } else {
+                        renditions.push_back(Rendition{format_desc.width, format_desc.height});
                     }
+                }
 
-                    // TODO -y?
-                    if (boost::filesystem::exists(full_path)) {
-                        boost::filesystem::remove(full_path);
+                std::string format;
+                {
+                    const auto format_it = options.find("format");
+                    if (format_it != options.end()) {
+                        format = std::move(format_it->second);
+                        options.erase(format_it);
                     }
-
-                    boost::filesystem::create_directories(full_path.parent_path());
                 }
 
-                AVFormatContext* oc = nullptr;
+                std::vector<std::unique_ptr<Output>> outputs;
+                std::optional<Stream>                audio_stream;
 
-                {
-                    std::string format;
-                    {
-                        const auto format_it = options.find("format");
-                        if (format_it != options.end()) {
-                            format = std::move(format_it->second);
-                            options.erase(format_it);
+                for (auto& rendition : renditions) {
+                    auto output     = std::make_unique<Output>();
+                    output->path    = rendition_path(path_, rendition, renditions.size());
+                    output->options = rendition_options(options, rendition);
+
+                    SegmentWriter::Config segment_config;
+                    segment_config.duration =
+                        static_cast<int64_t>(take_option(output->options, "segment_duration") * AV_TIME_BASE);
+                    segment_config.size =
+                        static_cast<int64_t>(take_option(output->options, "segment_size") * 1024 * 1024);
+                    segment_config.retention = static_cast<int64_t>(take_option(output->options, "segment_retention"));
+
+                    const auto direct_io    = take_option(output->options, "direct_io") > 0.0;
+                    const auto write_buffer = take_option(output->options, "write_buffer");
+                    const auto preallocate  = take_option(output->options, "preallocate");
+
+                    boost::filesystem::path full_path = output->path;
+
+                    static boost::regex prot_exp("^.+:.*");
+                    if (!boost::regex_match(output->path, prot_exp)) {
+                        if (!full_path.is_absolute()) {
+                            full_path = u8(env::media_folder()) + output->path;
                         }
+
+                        // TODO -y?
+                        if (!segment_config.enabled() && boost::filesystem::exists(full_path)) {
+                            boost::filesystem::remove(full_path);
+                        }
+
+                        boost::filesystem::create_directories(full_path.parent_path());
+                    } else if (segment_config.enabled()) {
+                        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Segmented recording requires a file path."));
                     }
 
-                    FF(avformat_alloc_output_context2(
-                        &oc, nullptr, !format.empty() ? format.c_str() : nullptr, path_.c_str()));
-                }
+                    FF(avformat_alloc_output_context2(&output->oc,
+                                                      nullptr,
+                                                      !format.empty() ? format.c_str() : nullptr,
+                                                      output->path.c_str()));
 
-                CASPAR_SCOPE_EXIT { avformat_free_context(oc); };
+                    auto oc = output->oc;
 
-                std::optional<Stream> video_stream;
-                if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
-                    if (oc->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end()) {
-                        options["preset:v"] = "veryfast";
+                    if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
+                        if (oc->oformat->video_codec == AV_CODEC_ID_H264 &&
+                            output->options.find("preset:v") == output->options.end()) {
+                            output->options["preset:v"] = "veryfast";
+                        }
+                        output->video_stream.emplace(oc,
+                                                     ":v",
+                                                     oc->oformat->video_codec,
+                                                     format_desc,
+                                                     rendition.width,
+                                                     rendition.height,
+                                                     realtime_,
+                                                     depth_,
+                                                     output->options);
                     }
-                    video_stream.emplace(oc, ":v", oc->oformat->video_codec, format_desc, realtime_, depth_, options);
 
-                    {
-                        std::lock_guard<std::mutex> lock(state_mutex_);
-                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(video_stream->sink));
+                    // Audio is encoded once and its packets are copied to every output.
+                    if (oc->oformat->audio_codec != AV_CODEC_ID_NONE) {
+                        if (!audio_stream) {
+                            audio_stream.emplace(oc,
+                                                 ":a",
+                                                 oc->oformat->audio_codec,
+                                                 format_desc,
+                                                 format_desc.width,
+                                                 format_desc.height,
+                                                 realtime_,
+                                                 depth_,
+                                                 output->options);
+                            output->audio_st = audio_stream->st;
+                        } else {
+                            output->audio_st = avformat_new_stream(oc, nullptr);
+                            if (!output->audio_st) {
+                                FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
+                            }
+                            output->audio_st->time_base = audio_stream->st->time_base;
+                            FF(avcodec_parameters_from_context(output->audio_st->codecpar, audio_stream->enc.get()));
+                        }
                     }
-                }
 
-                std::optional<Stream> audio_stream;
-                if (oc->oformat->audio_codec != AV_CODEC_ID_NONE) {
-                    audio_stream.emplace(oc, ":a", oc->oformat->audio_codec, format_desc, realtime_, depth_, options);
-                }
+                    if (segment_config.enabled()) {
+                        if (direct_io) {
+                            CASPAR_LOG(warning) << print() << L" Direct I/O is not used for segmented recording.";
+                        }
+                        if (oc->oformat->flags & AVFMT_NOFILE) {
+                            CASPAR_THROW_EXCEPTION(user_error()
+                                                   << msg_info("Segmented recording requires a file format."));
+                        }
+                        output->segments = std::make_unique<SegmentWriter>(
+                            oc,
+                            full_path,
+                            segment_config,
+                            format_desc.fps,
+                            std::move(output->options),
+                            output->video_stream ? output->video_stream->st->index : -1);
+                        output->options.clear();
+                    } else if (direct_io && !boost::regex_match(output->path, prot_exp) &&
+                               !(oc->oformat->flags & AVFMT_NOFILE)) {
+                        // 4 MiB blocks keep the number of write calls low while the ring stays responsive.
+                        const auto buffer_size =
+                            static_cast<std::size_t>((write_buffer > 0.0 ? write_buffer : 64.0) * 1024 * 1024);
+                        const auto block_size = std::size_t{4 * 1024 * 1024};
+
+                        output->write_stats = std::make_shared<WriteStats>();
+                        output->writer      = std::make_unique<FileWriter>(
+                            full_path.string(),
+                            block_size,
+                            (buffer_size + block_size - 1) / block_size,
+                            static_cast<std::int64_t>((preallocate > 0.0 ? preallocate : 1024.0) * 1024 * 1024),
+                            graph_,
+                            output->write_stats);
+
+                        oc->pb = output->writer->context();
+                        oc->flags |= AVFMT_FLAG_CUSTOM_IO;
+                    } else if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                        // TODO (fix) interrupt_cb
+                        auto dict = to_dict(std::move(output->options));
+                        CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+                        FF(avio_open2(&oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
+                        output->options = to_map(&dict);
+                    }
 
-                if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                    // TODO (fix) interrupt_cb
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avio_open2(&oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
-                    options = to_map(&dict);
+                    outputs.push_back(std::move(output));
                 }
 
-                {
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avformat_write_header(oc, &dict));
-                    options = to_map(&dict);
-                }
+                for (auto& output : outputs) {
+                    if (!output->segments) {
+                        auto dict = to_dict(std::move(output->options));
+                        CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+                        FF(avformat_write_header(output->oc, &dict));
+                        output->options = to_map(&dict);
+                    }
 
-                {
-                    for (auto& p : options) {
+                    for (auto& p : output->options) {
                         CASPAR_LOG(warning) << print() << " Unused option " << p.first << "=" << p.second;
                     }
-                }
 
-                tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer;
-                packet_buffer.set_capacity(realtime_ ? 1 : 128);
-                auto packet_thread = std::thread([&] {
-                    try {
-                        CASPAR_SCOPE_EXIT
-                        {
-                            if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                                FF(avio_closep(&oc->pb));
-                            }
-                        };
+                    output->packet_buffer.set_capacity(realtime_ ? 1 : 128);
+                    output->start();
+                }
 
-                        std::map<int, int64_t> count;
+                {
+                    std::lock_guard<std::mutex> lock(state_mutex_);
+                    if (outputs[0]->video_stream) {
+                        state_["file/fps"] = av_q2d(av_buffersink_get_frame_rate(outputs[0]->video_stream->sink));
+                    }
+                    if (outputs.size() > 1) {
+                        for (auto n = 0ULL; n < outputs.size(); ++n) {
+                            state_["renditions"][n]["path"] = outputs[n]->path;
+                            state_["renditions"][n]["size"] = {renditions[n].width, renditions[n].height};
+                        }
+                    }
+                }
 
-                        std::shared_ptr<AVPacket> pkt;
-                        while (true) {
-                            packet_buffer.pop(pkt);
-                            if (!pkt) {
-                                break;
-                            }
-                            count[pkt->stream_index] += 1;
-                            FF(av_interleaved_write_frame(oc, pkt.get()));
+                auto audio_cb = [&](std::shared_ptr<AVPacket>&& pkt) {
+                    for (auto& output : outputs) {
+                        auto copy = std::shared_ptr<AVPacket>(av_packet_clone(pkt.get()),
+                                                              [](AVPacket* ptr) { av_packet_free(&ptr); });
+                        if (!copy) {
+                            FF_RET(AVERROR(ENOMEM), "av_packet_clone");
                         }
+                        copy->stream_index = output->audio_st->index;
+                        av_packet_rescale_ts(copy.get(), audio_stream->st->time_base, output->audio_st->time_base);
+                        output->packet_buffer.push(std::move(copy));
+                    }
+                };
 
-                        auto video_st = video_stream ? video_stream->st : nullptr;
-                        auto audio_st = audio_stream ? audio_stream->st : nullptr;
+                using frame_stage_t    = Stage<core::const_frame>;
+                using av_frame_stage_t = Stage<std::shared_ptr<AVFrame>>;
 
-                        if ((!video_st || count[video_st->index]) && (!audio_st || count[audio_st->index])) {
-                            FF(av_write_trailer(oc));
-                        }
+                std::vector<std::unique_ptr<av_frame_stage_t>> video_encoders;
+                std::unique_ptr<frame_stage_t>                 video_filter;
+                std::unique_ptr<av_frame_stage_t>              audio_encoder;
+                std::unique_ptr<frame_stage_t>                 audio_filter;
 
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
-                        // TODO
-                        packet_buffer.abort();
+                auto on_error = [&](std::exception_ptr e) {
+                    set_exception(std::move(e));
+                    for (auto& encoder : video_encoders) {
+                        encoder->abort();
                     }
-                });
-                CASPAR_SCOPE_EXIT
-                {
-                    if (packet_thread.joinable()) {
-                        // TODO Is nullptr needed?
-                        packet_buffer.push(nullptr);
-                        packet_buffer.abort();
-                        packet_thread.join();
+                    if (video_filter) {
+                        video_filter->abort();
+                    }
+                    if (audio_encoder) {
+                        audio_encoder->abort();
+                    }
+                    if (audio_filter) {
+                        audio_filter->abort();
+                    }
+                    for (auto& output : outputs) {
+                        output->packet_buffer.abort();
                     }
                 };
 
-                auto packet_cb = [&](std::shared_ptr<AVPacket>&& pkt) { packet_buffer.push(std::move(pkt)); };
+                const auto capacity = realtime_ ? 4 : 16;
+
+                if (outputs[0]->video_stream) {
+                    // Only the primary rendition is graphed.
+                    for (auto n = 0ULL; n < outputs.size(); ++n) {
+                        auto& output = *outputs[n];
+                        video_encoders.push_back(std::make_unique<av_frame_stage_t>(
+                            n == 0 ? "video-encode" : "",
+                            graph_,
+                            format_desc.fps,
+                            capacity,
+                            [&output](std::shared_ptr<AVFrame> frame) {
+                                output.video_stream->encode(frame, [&](std::shared_ptr<AVPacket>&& pkt) {
+                                    output.packet_buffer.push(std::move(pkt));
+                                });
+                            },
+                            on_error));
+                    }
+
+                    video_filter = std::make_unique<frame_stage_t>(
+                        "video-filter",
+                        graph_,
+                        format_desc.fps,
+                        capacity,
+                        [&, converter = std::make_shared<VideoConverter>()](core::const_frame frame) {
+                            std::vector<std::shared_ptr<AVFrame>> frames(outputs.size());
+                            if (frame) {
+                                auto src = converter->convert(frame, format_desc);
+                                for (auto n = 0ULL; n < outputs.size(); ++n) {
+                                    frames[n] = converter->scale(n, src, renditions[n].width, renditions[n].height);
+                                    src       = frames[n];
+                                }
+                            }
+
+                            tbb::parallel_for(std::size_t{0}, outputs.size(), [&](std::size_t n) {
+                                outputs[n]->video_stream->filter(frames[n], [&](std::shared_ptr<AVFrame>&& filtered) {
+                                    video_encoders[n]->push(std::move(filtered));
+                                });
+                            });
+                        },
+                        on_error);
+                }
+
+                if (audio_stream) {
+                    audio_encoder = std::make_unique<av_frame_stage_t>(
+                        "audio-encode",
+                        graph_,
+                        format_desc.fps,
+                        capacity,
+                        [&](std::shared_ptr<AVFrame> frame) { audio_stream->encode(frame, audio_cb); },
+                        on_error);
+
+                    audio_filter = std::make_unique<frame_stage_t>(
+                        "audio-filter",
+                        graph_,
+                        format_desc.fps,
+                        capacity,
+                        [&](core::const_frame frame) {
+                            audio_stream->filter(frame ? make_av_audio_frame(frame, format_desc) : nullptr,
+                                                 [&](std::shared_ptr<AVFrame>&& filtered) {
+                                                     audio_encoder->push(std::move(filtered));
+                                                 });
+                        },
+                        on_error);
+                }
 
                 std::int32_t frame_number = 0;
                 while (true) {
                     {
                         std::lock_guard<std::mutex> lock(state_mutex_);
                         state_["file/frame"] = frame_number++;
+
+                        if (const auto stats = outputs[0]->write_stats) {
+                            state_["file/io/bytes"]       = stats->bytes_written.load();
+                            state_["file/io/throughput"]  = stats->throughput.load();
+                            state_["file/io/latency"]     = stats->latency.load();
+                            state_["file/io/max-latency"] = stats->max_latency.load();
+                            state_["file/io/stalls"]      = stats->stalls.load();
+                        }
                     }
 
                     core::const_frame frame;
@@ -677,30 +1410,38 @@ struct ffmpeg_consumer : public core::frame_consumer
                     graph_->set_value("input",
                                       static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
 
-                    caspar::timer frame_timer;
-                    tbb::parallel_invoke(
-                        [&] {
-                            if (video_stream) {
-                                video_stream->send(frame, format_desc, packet_cb);
-                            }
-                        },
-                        [&] {
-                            if (audio_stream) {
-                                audio_stream->send(frame, format_desc, packet_cb);
-                            }
-                        });
-                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
+                    if (video_filter) {
+                        video_filter->push(frame);
+                    }
+                    if (audio_filter) {
+                        audio_filter->push(frame);
+                    }
 
                     if (!frame) {
-                        packet_buffer.push(nullptr);
                         break;
                     }
                 }
 
-                packet_thread.join();
+                // Every stage ends after passing on the final empty item.
+                if (video_filter) {
+                    video_filter->join();
+                }
+                for (auto& encoder : video_encoders) {
+                    encoder->join();
+                }
+                if (audio_filter) {
+                    audio_filter->join();
+                }
+                if (audio_encoder) {
+                    audio_encoder->join();
+                }
+
+                for (auto& output : outputs) {
+                    output->packet_buffer.push(nullptr);
+                    output->packet_thread.join();
+                }
             } catch (...) {
-                std::lock_guard<std::mutex> lock(exception_mutex_);
-                exception_ = std::current_exception();
+                set_exception(std::current_exception());
             }
         });
     }
@@ -737,6 +1478,16 @@ struct ffmpeg_consumer : public core::frame_consumer
         std::lock_guard<std::mutex> lock(state_mutex_);
         return state_;
     }
+
+  private:
+    // Keeps the first error, later ones are usually caused by the pipeline being aborted.
+    void set_exception(std::exception_ptr e)
+    {
+        std::lock_guard<std::mutex> lock(exception_mutex_);
+        if (!exception_) {
+            exception_ = std::move(e);
+        }
+    }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
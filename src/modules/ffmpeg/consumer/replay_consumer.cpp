@@ -0,0 +1,325 @@
+#include "replay_consumer.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_replay.h"
+#include "../util/av_util.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <core/consumer/channel_info.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace ffmpeg {
+
+class replay_consumer : public core::frame_consumer
+{
+    const std::wstring name_;
+    const int          index_;
+    const double       seconds_;
+    const std::string  codec_;
+    const int          quality_;
+
+    core::video_format_desc       format_desc_;
+    int                           channel_index_ = -1;
+    std::shared_ptr<ReplayBuffer> buffer_;
+    int64_t                       number_ = 0;
+
+    std::shared_ptr<AVCodecContext>         enc_;
+    std::shared_ptr<SwsContext>             sws_;
+    std::map<int64_t, std::vector<int32_t>> audio_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+    executor                            executor_{L"replay_consumer"};
+
+  public:
+    replay_consumer(std::wstring name, double seconds, std::string codec, int quality)
+        : name_(std::move(name))
+        , index_(index_for(name_))
+        , seconds_(seconds)
+        , codec_(std::move(codec))
+        , quality_(quality)
+    {
+        executor_.set_capacity(8);
+
+        diagnostics::register_graph(graph_);
+        graph_->set_color("encode-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+    }
+
+    ~replay_consumer() { executor_.stop_and_wait(); }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc,
+                    const core::channel_info&      channel_info,
+                    int                            port_index) override
+    {
+        executor_.invoke([&] {
+            format_desc_   = format_desc;
+            channel_index_ = channel_info.index;
+            number_        = 0;
+            audio_.clear();
+            sws_.reset();
+
+            std::shared_ptr<AVCodecParameters> codecpar;
+            if (!codec_.empty()) {
+                open_encoder();
+                codecpar = std::shared_ptr<AVCodecParameters>(
+                    avcodec_parameters_alloc(), [](AVCodecParameters* ptr) { avcodec_parameters_free(&ptr); });
+                FF(avcodec_parameters_from_context(codecpar.get(), enc_.get()));
+            }
+
+            // Interlaced channels send every field separately.
+            const auto capacity =
+                static_cast<std::size_t>(std::ceil(seconds_ * format_desc.fps * format_desc.field_count));
+
+            buffer_ = std::make_shared<ReplayBuffer>(name_, format_desc, capacity, std::move(codecpar));
+            ReplayBuffer::add(buffer_);
+
+            graph_->set_text(print());
+        });
+    }
+
+    std::future<bool> send(core::video_field field, core::const_frame frame) override
+    {
+        if (!enc_) {
+            auto replay_frame    = std::make_shared<ReplayFrame>();
+            replay_frame->number = number_++;
+            replay_frame->frame  = frame;
+            replay_frame->bytes  = frame.image_data(0).size() + frame.audio_data().size() * sizeof(int32_t);
+            buffer_->push(std::move(replay_frame));
+            return make_ready_future(true);
+        }
+
+        if (executor_.size() >= executor_.capacity()) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            return make_ready_future(true);
+        }
+
+        // Numbers are only taken by frames that are encoded, so the ring stays consecutive.
+        const auto number = number_++;
+        executor_.begin_invoke([=] {
+            caspar::timer frame_timer;
+            encode(number, frame);
+            graph_->set_value("encode-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+        });
+
+        return make_ready_future(true);
+    }
+
+    std::wstring print() const override
+    {
+        return L"replay[" + std::to_wstring(channel_index_) + L"|" + name_ + L"]";
+    }
+
+    std::wstring name() const override { return L"replay"; }
+
+    int index() const override { return index_; }
+
+    core::monitor::state state() const override
+    {
+        core::monitor::state state;
+        state["replay/name"]  = name_;
+        state["replay/codec"] = codec_.empty() ? std::string("raw") : codec_;
+        if (buffer_) {
+            state["replay"] = buffer_->state();
+        }
+        return state;
+    }
+
+  private:
+    // Each buffer name is given the next index the first time it is used, so that names never share an index and
+    // REMOVE with the same name finds this consumer.
+    static int index_for(const std::wstring& name)
+    {
+        static std::mutex                  mutex;
+        static std::map<std::wstring, int> indices;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const auto next = 150000 + static_cast<int>(indices.size() % 50000);
+        return indices.emplace(boost::to_upper_copy(name), next).first->second;
+    }
+
+    void open_encoder()
+    {
+        const auto codec = avcodec_find_encoder_by_name(codec_.c_str());
+        if (!codec) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unknown replay codec " + codec_));
+        }
+
+        const auto desc = avcodec_descriptor_get(codec->id);
+        if (!desc || !(desc->props & AV_CODEC_PROP_INTRA_ONLY)) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Replay codec " + codec_ + " is not intra-only"));
+        }
+
+        enc_ = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+        if (!enc_) {
+            FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+        }
+
+        enc_->width           = format_desc_.width;
+        enc_->height          = format_desc_.height;
+        enc_->time_base       = AVRational{format_desc_.duration, format_desc_.time_scale * format_desc_.field_count};
+        enc_->pix_fmt         = codec->pix_fmts
+                                    ? avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, AV_PIX_FMT_BGRA, 1, nullptr)
+                                    : AV_PIX_FMT_BGRA;
+        enc_->colorspace      = AVCOL_SPC_BT709;
+        enc_->color_primaries = AVCOL_PRI_BT709;
+        enc_->color_trc       = AVCOL_TRC_BT709;
+        enc_->color_range     = AVCOL_RANGE_JPEG;
+
+        // Slice threads keep every packet in step with its frame.
+        enc_->thread_count = 0;
+        enc_->thread_type  = FF_THREAD_SLICE;
+
+        if (quality_ > 0) {
+            enc_->flags |= AV_CODEC_FLAG_QSCALE;
+            enc_->global_quality = FF_QP2LAMBDA * quality_;
+        }
+
+        FF(avcodec_open2(enc_.get(), codec, nullptr));
+
+        CASPAR_LOG(info) << print() << L" Encoding " << u16(codec_) << L" "
+                         << u16(av_get_pix_fmt_name(enc_->pix_fmt));
+    }
+
+    void encode(int64_t number, const core::const_frame& frame)
+    {
+        auto src = make_av_video_frame(frame, format_desc_);
+
+        if (!sws_) {
+            sws_.reset(sws_getContext(src->width,
+                                      src->height,
+                                      static_cast<AVPixelFormat>(src->format),
+                                      enc_->width,
+                                      enc_->height,
+                                      enc_->pix_fmt,
+                                      SWS_BICUBIC,
+                                      nullptr,
+                                      nullptr,
+                                      nullptr),
+                       [](SwsContext* ptr) { sws_freeContext(ptr); });
+            if (!sws_) {
+                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to create replay scaler"));
+            }
+            sws_setColorspaceDetails(sws_.get(),
+                                     sws_getCoefficients(SWS_CS_DEFAULT),
+                                     1,
+                                     sws_getCoefficients(SWS_CS_ITU709),
+                                     1,
+                                     0,
+                                     1 << 16,
+                                     1 << 16);
+        }
+
+        auto dst             = alloc_frame();
+        dst->width           = enc_->width;
+        dst->height          = enc_->height;
+        dst->format          = enc_->pix_fmt;
+        dst->colorspace      = enc_->colorspace;
+        dst->color_primaries = enc_->color_primaries;
+        dst->color_trc       = enc_->color_trc;
+        dst->color_range     = enc_->color_range;
+        dst->pts             = number;
+        FF(av_frame_get_buffer(dst.get(), 0));
+
+        sws_scale(sws_.get(), src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+
+        const auto& audio = frame.audio_data();
+        audio_[number]    = std::vector<int32_t>(audio.begin(), audio.end());
+
+        FF(avcodec_send_frame(enc_.get(), dst.get()));
+
+        while (true) {
+            auto pkt = alloc_packet();
+            auto ret = avcodec_receive_packet(enc_.get(), pkt.get());
+            if (ret == AVERROR(EAGAIN)) {
+                break;
+            }
+            FF_RET(ret, "avcodec_receive_packet");
+
+            auto replay_frame    = std::make_shared<ReplayFrame>();
+            replay_frame->number = pkt->pts;
+
+            auto it = audio_.find(pkt->pts);
+            if (it != audio_.end()) {
+                replay_frame->audio = std::move(it->second);
+                audio_.erase(audio_.begin(), std::next(it));
+            }
+
+            replay_frame->bytes  = pkt->size + replay_frame->audio.size() * sizeof(int32_t);
+            replay_frame->packet = std::move(pkt);
+            buffer_->push(std::move(replay_frame));
+        }
+    }
+};
+
+spl::shared_ptr<core::frame_consumer>
+create_replay_consumer(const std::vector<std::wstring>&                         params,
+                       const core::video_format_repository&                     format_repository,
+                       const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                       const core::channel_info&                                channel_info)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"REPLAY")) {
+        return core::frame_consumer::empty();
+    }
+
+    auto codec = u8(get_param(L"CODEC", params, L"raw"));
+    if (boost::iequals(codec, "raw")) {
+        codec.clear();
+    }
+
+    return spl::make_shared<replay_consumer>(
+        params.at(1), get_param(L"SECONDS", params, 10.0), codec, get_param(L"QUALITY", params, 0));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_replay_consumer(const boost::property_tree::wptree&                      ptree,
+                                     const core::video_format_repository&                     format_repository,
+                                     const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                                     const core::channel_info&                                channel_info)
+{
+    auto codec = u8(ptree.get(L"codec", L"raw"));
+    if (boost::iequals(codec, "raw")) {
+        codec.clear();
+    }
+
+    return spl::make_shared<replay_consumer>(
+        ptree.get<std::wstring>(L"name"), ptree.get(L"seconds", 10.0), codec, ptree.get(L"quality", 0));
+}
+
+}} // namespace caspar::ffmpeg
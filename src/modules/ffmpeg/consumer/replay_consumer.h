@@ -0,0 +1,27 @@
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/video_channel.h>
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+// REPLAY <name> [SECONDS n] [CODEC raw|<intra-only ffmpeg encoder>] [QUALITY n]
+spl::shared_ptr<core::frame_consumer>
+create_replay_consumer(const std::vector<std::wstring>&                         params,
+                       const core::video_format_repository&                     format_repository,
+                       const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                       const core::channel_info&                                channel_info);
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_replay_consumer(const boost::property_tree::wptree&,
+                                     const core::video_format_repository&                     format_repository,
+                                     const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                                     const core::channel_info&                                channel_info);
+
+}} // namespace caspar::ffmpeg
@@ -24,12 +24,26 @@
 #include "ffmpeg.h"
 
 #include "consumer/ffmpeg_consumer.h"
+#include "consumer/replay_consumer.h"
+#include "media/media_index.h"
+#include "media/thumbnail_cache.h"
+#include "producer/av_cache.h"
 #include "producer/ffmpeg_producer.h"
+#include "producer/playlist_producer.h"
+#include "producer/replay_producer.h"
 
+#include <common/base64.h>
+#include <common/env.h>
 #include <common/log.h>
+#include <common/utf.h>
 
 #include <core/module_dependencies.h>
 
+#include <protocol/amcp/amcp_command_repository_wrapper.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
 #include <mutex>
 
 #if defined(_MSC_VER)
@@ -107,6 +121,92 @@ void log_callback(void* ptr, int level, const char* fmt, va_list vl)
 
 void log_for_thread(void* ptr, int level, const char* fmt, va_list vl) { log_callback(ptr, level, fmt, vl); }
 
+// Replaces the query and thumbnail commands that are otherwise forwarded to the media scanner.
+void register_media_index_commands(const core::module_dependencies& dependencies)
+{
+    const auto font_folder = boost::filesystem::absolute(
+        env::properties().get(L"configuration.paths.font-path", std::wstring(L"font/")), env::initial_folder());
+
+    auto thumbnails = std::make_shared<thumbnail_cache>(
+        env::data_folder() + L"thumbnails",
+        env::properties().get(L"configuration.ffmpeg.media-index.thumbnails.width", 256),
+        env::properties().get(L"configuration.ffmpeg.media-index.thumbnails.threads", 1));
+
+    auto index = std::make_shared<media_index>(
+        env::media_folder(),
+        env::template_folder(),
+        font_folder,
+        env::data_folder() + L"media-index",
+        env::properties().get(L"configuration.ffmpeg.media-index.threads", 4),
+        std::chrono::seconds(env::properties().get(L"configuration.ffmpeg.media-index.rescan-interval", 300)),
+        thumbnails);
+
+    dependencies.command_repository->register_command(
+        L"Query Commands",
+        L"CLS",
+        [index](protocol::amcp::command_context& ctx) { return L"200 CLS OK\r\n" + index->cls() + L"\r\n"; },
+        0);
+    dependencies.command_repository->register_command(
+        L"Query Commands",
+        L"CINF",
+        [index](protocol::amcp::command_context& ctx) {
+            auto info = index->cinf(ctx.parameters.at(0));
+            if (info.empty()) {
+                return std::wstring(L"404 CINF ERROR\r\n");
+            }
+            return L"201 CINF OK\r\n" + info;
+        },
+        1);
+    dependencies.command_repository->register_command(
+        L"Query Commands",
+        L"TLS",
+        [index](protocol::amcp::command_context& ctx) { return L"200 TLS OK\r\n" + index->tls() + L"\r\n"; },
+        0);
+    dependencies.command_repository->register_command(
+        L"Query Commands",
+        L"FLS",
+        [index](protocol::amcp::command_context& ctx) { return L"200 FLS OK\r\n" + index->fls() + L"\r\n"; },
+        0);
+
+    dependencies.command_repository->register_command(
+        L"Thumbnail Commands",
+        L"THUMBNAIL LIST",
+        [index](protocol::amcp::command_context& ctx) {
+            return L"200 THUMBNAIL LIST OK\r\n" + index->thumbnails() + L"\r\n";
+        },
+        0);
+    dependencies.command_repository->register_command(
+        L"Thumbnail Commands",
+        L"THUMBNAIL RETRIEVE",
+        [index](protocol::amcp::command_context& ctx) {
+            auto png = index->thumbnail(ctx.parameters.at(0));
+            if (png.empty()) {
+                return std::wstring(L"404 THUMBNAIL RETRIEVE ERROR\r\n");
+            }
+            return L"201 THUMBNAIL RETRIEVE OK\r\n" + u16(to_base64(png.data(), png.size())) + L"\r\n";
+        },
+        1);
+    dependencies.command_repository->register_command(
+        L"Thumbnail Commands",
+        L"THUMBNAIL GENERATE",
+        [index](protocol::amcp::command_context& ctx) {
+            auto promise = std::make_shared<std::promise<std::wstring>>();
+            index->generate_thumbnail(ctx.parameters.at(0), [promise](bool ok) {
+                promise->set_value(ok ? L"202 THUMBNAIL GENERATE OK\r\n" : L"404 THUMBNAIL GENERATE ERROR\r\n");
+            });
+            return promise->get_future();
+        },
+        1);
+    dependencies.command_repository->register_command(
+        L"Thumbnail Commands",
+        L"THUMBNAIL GENERATE_ALL",
+        [index](protocol::amcp::command_context& ctx) {
+            index->generate_thumbnails();
+            return std::wstring(L"202 THUMBNAIL GENERATE_ALL OK\r\n");
+        },
+        0);
+}
+
 void init(const core::module_dependencies& dependencies)
 {
     av_log_set_callback(log_for_thread);
@@ -124,12 +224,22 @@ void init(const core::module_dependencies& dependencies)
 
     dependencies.consumer_registry->register_consumer_factory(L"FFmpeg Consumer", create_consumer);
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ffmpeg", create_preconfigured_consumer);
+    dependencies.consumer_registry->register_consumer_factory(L"Replay Consumer", create_replay_consumer);
+    dependencies.consumer_registry->register_preconfigured_consumer_factory(L"replay",
+                                                                            create_preconfigured_replay_consumer);
 
+    dependencies.producer_registry->register_producer_factory(L"Playlist Producer", create_playlist_producer);
+    dependencies.producer_registry->register_producer_factory(L"Replay Producer", create_replay_producer);
     dependencies.producer_registry->register_producer_factory(L"FFmpeg Producer", create_producer);
+
+    if (env::properties().get(L"configuration.ffmpeg.media-index.enabled", false)) {
+        register_media_index_commands(dependencies);
+    }
 }
 
 void uninit()
 {
+    ClipCache::instance().clear();
     // avfilter_uninit();
     avformat_network_deinit();
 }
@@ -0,0 +1,668 @@
+#include "../StdAfx.h"
+
+#include "media_index.h"
+#include "thumbnail_cache.h"
+
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/os/directory_watcher.h>
+#include <common/os/filesystem.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <atomic>
+#include <cmath>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+}
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+namespace fs = boost::filesystem;
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const std::string INDEX_HEADER = "casparcg-media-index 1";
+
+// Files are probed and published in chunks, so that a large scan becomes visible gradually.
+const std::size_t CHUNK_SIZE = 1000;
+
+const std::chrono::milliseconds SETTLE_TIME(500);
+
+struct file_stat
+{
+    uint64_t    size  = 0;
+    std::time_t mtime = 0;
+};
+
+struct media_entry
+{
+    file_stat   stat;
+    bool        valid = false; // False if the file could not be probed, it is then left out of CLS.
+    std::string type;          // MOVIE, STILL or AUDIO
+    int64_t     frames        = 0;
+    int         time_base_num = 0;
+    int         time_base_den = 1;
+};
+
+// Sorted by id, then by path relative to the media folder.
+using media_key = std::pair<std::wstring, std::wstring>;
+
+// "folder/clip.mov" => "FOLDER/CLIP"
+std::wstring get_id(const fs::path& relative)
+{
+    return boost::to_upper_copy((relative.parent_path() / relative.stem()).generic_wstring());
+}
+
+// The path relative to folder, if it is below folder.
+std::optional<std::wstring> relative_to(const fs::path& folder, const fs::path& path)
+{
+    auto prefix = folder.generic_wstring();
+    while (!prefix.empty() && prefix.back() == L'/') {
+        prefix.pop_back();
+    }
+
+    const auto str = path.generic_wstring();
+    if (str == prefix) {
+        return std::wstring();
+    }
+    if (str.size() <= prefix.size() + 1 || str.compare(0, prefix.size(), prefix) != 0 || str[prefix.size()] != L'/') {
+        return {};
+    }
+    return str.substr(prefix.size() + 1);
+}
+
+bool is_below(const std::wstring& relative, const std::wstring& folder)
+{
+    return folder.empty() || relative == folder ||
+           (relative.size() > folder.size() && relative.compare(0, folder.size(), folder) == 0 &&
+            relative[folder.size()] == L'/');
+}
+
+bool is_hidden(const fs::path& path) { return boost::starts_with(path.filename().wstring(), L"."); }
+
+bool is_hidden(const std::wstring& relative)
+{
+    return boost::starts_with(relative, L".") || boost::contains(relative, L"/.");
+}
+
+// Regular files below folder, hidden files and folders excluded.
+template <typename Func>
+void for_each_file(const fs::path& folder, Func&& func)
+{
+    boost::system::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(folder, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        boost::system::error_code file_ec;
+        if (is_hidden(it->path())) {
+            if (fs::is_directory(it->path(), file_ec)) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (fs::is_regular_file(it->path(), file_ec)) {
+            func(it->path());
+        }
+    }
+}
+
+std::optional<file_stat> stat(const fs::path& path)
+{
+    boost::system::error_code ec;
+
+    file_stat result;
+    result.size = fs::file_size(path, ec);
+    if (ec) {
+        return {};
+    }
+    result.mtime = fs::last_write_time(path, ec);
+    if (ec) {
+        return {};
+    }
+    return result;
+}
+
+// Mirrors the media scanner, which derives the same fields from ffprobe.
+media_entry probe(const fs::path& path, const file_stat& stat)
+{
+    media_entry entry;
+    entry.stat = stat;
+
+    AVFormatContext* ctx = nullptr;
+    if (avformat_open_input(&ctx, u8(path.wstring()).c_str(), nullptr, nullptr) < 0) {
+        return entry;
+    }
+    CASPAR_SCOPE_EXIT { avformat_close_input(&ctx); };
+
+    if (avformat_find_stream_info(ctx, nullptr) < 0) {
+        return entry;
+    }
+
+    const AVStream* video = nullptr;
+    const AVStream* audio = nullptr;
+    for (auto n = 0U; n < ctx->nb_streams; ++n) {
+        const auto stream = ctx->streams[n];
+        if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !video &&
+            (stream->disposition & AV_DISPOSITION_ATTACHED_PIC) == 0) {
+            video = stream;
+        } else if (stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && !audio) {
+            audio = stream;
+        }
+    }
+
+    const auto duration = ctx->duration != AV_NOPTS_VALUE && ctx->duration > 0
+                              ? static_cast<double>(ctx->duration) / AV_TIME_BASE
+                              : 1.0 / 24.0;
+
+    if (video) {
+        entry.type          = duration <= 1.0 / 24.0 ? "STILL" : "MOVIE";
+        entry.time_base_num = video->avg_frame_rate.den;
+        entry.time_base_den = video->avg_frame_rate.num;
+    } else if (audio) {
+        entry.type          = "AUDIO";
+        entry.time_base_num = audio->time_base.num;
+        entry.time_base_den = audio->time_base.den;
+    } else {
+        return entry;
+    }
+
+    entry.frames = entry.time_base_num > 0
+                       ? static_cast<int64_t>(std::floor(duration * entry.time_base_den / entry.time_base_num))
+                       : 0;
+    entry.valid = true;
+    return entry;
+}
+
+bool has_video(const media_entry& entry) { return entry.valid && (entry.type == "MOVIE" || entry.type == "STILL"); }
+
+// "20170413T121028" in local time.
+std::wstring format_time(std::time_t time)
+{
+    return boost::posix_time::to_iso_wstring(
+        boost::date_time::c_local_adjustor<boost::posix_time::ptime>::utc_to_local(
+            boost::posix_time::from_time_t(time)));
+}
+
+// "AMB"  MOVIE  6445960 20170413121028 268 1/25
+std::wstring cinf_line(const std::wstring& id, const media_entry& entry)
+{
+    auto modified = format_time(entry.stat.mtime);
+    modified.erase(8, 1);
+
+    return L"\"" + id + L"\"  " + u16(entry.type) + L"  " + std::to_wstring(entry.stat.size) + L" " + modified + L" " +
+           std::to_wstring(entry.frames) + L" " + std::to_wstring(entry.time_base_num) + L"/" +
+           std::to_wstring(entry.time_base_den) + L"\r\n";
+}
+
+// A folder listing that is rebuilt on the next request after its folder has changed.
+class listing
+{
+    const fs::path                      folder_;
+    const std::function<bool(fs::path)> filter_;
+    std::mutex                          mutex_;
+    bool                                dirty_ = true;
+    std::wstring                        text_;
+    std::unique_ptr<directory_watcher>  watcher_;
+
+  public:
+    listing(fs::path folder, std::function<bool(fs::path)> filter, std::chrono::seconds rescan_interval)
+        : folder_(std::move(folder))
+        , filter_(std::move(filter))
+    {
+        // A missing folder is listed on every request instead, so that it is picked up once it has been created.
+        boost::system::error_code ec;
+        if (fs::is_directory(folder_, ec)) {
+            watcher_ = std::make_unique<directory_watcher>(
+                folder_, SETTLE_TIME, rescan_interval, [this](const std::vector<fs::path>& paths) {
+                    case_insensitive_index_changed(folder_, paths);
+
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    dirty_ = true;
+                });
+        }
+    }
+
+    std::wstring text()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (dirty_ || !watcher_) {
+            std::set<std::wstring> ids;
+            for_each_file(folder_, [&](const fs::path& path) {
+                auto relative = relative_to(folder_, path);
+                if (relative && filter_(path)) {
+                    ids.insert(get_id(*relative));
+                }
+            });
+
+            text_.clear();
+            for (auto& id : ids) {
+                text_ += id + L"\r\n";
+            }
+            dirty_ = false;
+        }
+        return text_;
+    }
+};
+
+} // namespace
+
+struct media_index::impl
+{
+    const fs::path                         media_folder_;
+    const fs::path                         index_file_;
+    const int                              threads_;
+    const std::shared_ptr<thumbnail_cache> thumbnails_;
+
+    std::atomic<bool> abort_request_{false};
+
+    std::mutex                       mutex_;
+    std::map<media_key, media_entry> entries_; // Written on the executor thread, under mutex_.
+    bool                             cls_dirty_ = true;
+    std::wstring                     cls_;
+
+    listing templates_;
+    listing fonts_;
+
+    executor                           executor_{L"media-index"};
+    std::unique_ptr<directory_watcher> watcher_;
+
+    impl(fs::path                         media_folder,
+         fs::path                         template_folder,
+         fs::path                         font_folder,
+         fs::path                         index_file,
+         int                              threads,
+         std::chrono::seconds             rescan_interval,
+         std::shared_ptr<thumbnail_cache> thumbnails)
+        : media_folder_(std::move(media_folder))
+        , index_file_(std::move(index_file))
+        , threads_(std::max(threads, 1))
+        , thumbnails_(std::move(thumbnails))
+        , templates_(std::move(template_folder),
+                     [](const fs::path& path) {
+                         auto ext = boost::to_lower_copy(path.extension().wstring());
+                         return ext == L".ft" || ext == L".wt" || ext == L".ct" || ext == L".html";
+                     },
+                     rescan_interval)
+        , fonts_(std::move(font_folder), [](const fs::path&) { return true; }, rescan_interval)
+    {
+        executor_.begin_invoke([this] {
+            load();
+            update({});
+        });
+
+        watcher_ = std::make_unique<directory_watcher>(
+            media_folder_, SETTLE_TIME, rescan_interval, [this](const std::vector<fs::path>& paths) {
+                case_insensitive_index_changed(media_folder_, paths);
+                executor_.begin_invoke([=] { update(paths); });
+            });
+    }
+
+    ~impl()
+    {
+        abort_request_ = true;
+        watcher_.reset();
+        executor_.stop_and_wait();
+    }
+
+    std::wstring cls()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (cls_dirty_) {
+            cls_.clear();
+            for (auto& entry : entries_) {
+                if (entry.second.valid) {
+                    cls_ += cinf_line(entry.first.first, entry.second);
+                }
+            }
+            cls_dirty_ = false;
+        }
+        return cls_;
+    }
+
+    std::wstring cinf(const std::wstring& id)
+    {
+        const auto key = boost::to_upper_copy(id);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::wstring result;
+        for (auto it = entries_.lower_bound(media_key(key, L"")); it != entries_.end() && it->first.first == key;
+             ++it) {
+            if (it->second.valid) {
+                result += cinf_line(it->first.first, it->second);
+            }
+        }
+        return result;
+    }
+
+    thumbnail_source source(const media_key& key, const media_entry& entry) const
+    {
+        thumbnail_source result;
+        result.path  = media_folder_ / key.second;
+        result.size  = entry.stat.size;
+        result.mtime = entry.stat.mtime;
+        return result;
+    }
+
+    // The first media file with the given id that can have a thumbnail.
+    std::optional<thumbnail_source> find_thumbnail_source(const std::wstring& id)
+    {
+        const auto key = boost::to_upper_copy(id);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto it = entries_.lower_bound(media_key(key, L"")); it != entries_.end() && it->first.first == key;
+             ++it) {
+            if (has_video(it->second)) {
+                return source(it->first, it->second);
+            }
+        }
+        return {};
+    }
+
+    std::wstring thumbnails()
+    {
+        std::vector<std::pair<std::wstring, thumbnail_source>> sources;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& entry : entries_) {
+                if (has_video(entry.second)) {
+                    sources.emplace_back(entry.first.first, source(entry.first, entry.second));
+                }
+            }
+        }
+
+        std::wstring result;
+        for (auto& source : sources) {
+            auto info = thumbnails_->info(source.second);
+            if (info) {
+                result += L"\"" + source.first + L"\" " + format_time(info->created) + L" " +
+                          std::to_wstring(info->size) + L"\r\n";
+            }
+        }
+        return result;
+    }
+
+    std::vector<char> thumbnail(const std::wstring& id)
+    {
+        auto source = find_thumbnail_source(id);
+        return source ? thumbnails_->read(*source) : std::vector<char>();
+    }
+
+    void generate_thumbnail(const std::wstring& id, std::function<void(bool)> done)
+    {
+        auto source = find_thumbnail_source(id);
+        if (!source) {
+            done(false);
+            return;
+        }
+        thumbnails_->generate(*source, true, true, std::move(done));
+    }
+
+    // Called on the executor thread.
+    void generate_thumbnails()
+    {
+        std::vector<thumbnail_source> sources;
+        for (auto& entry : entries_) {
+            if (has_video(entry.second)) {
+                sources.push_back(source(entry.first, entry.second));
+            }
+        }
+
+        thumbnails_->retain(sources);
+        for (auto& source : sources) {
+            thumbnails_->generate(source, false, false, nullptr);
+        }
+    }
+
+    // Brings the entries below the given paths up to date, all of them if paths is empty.
+    void update(const std::vector<fs::path>& paths)
+    {
+        std::vector<std::wstring> folders;
+        if (paths.empty()) {
+            folders.emplace_back();
+        }
+        for (auto& path : paths) {
+            auto relative = relative_to(media_folder_, path);
+            if (relative) {
+                folders.push_back(*relative);
+            }
+        }
+
+        std::set<media_key>            removed;
+        std::map<media_key, file_stat> changed;
+        for (auto& folder : folders) {
+            const auto path = folder.empty() ? media_folder_ : media_folder_ / folder;
+
+            std::map<std::wstring, file_stat> files;
+            auto add = [&](const fs::path& file) {
+                auto relative = relative_to(media_folder_, file);
+                auto s        = stat(file);
+                if (relative && s && !is_hidden(*relative)) {
+                    files.emplace(*relative, *s);
+                }
+            };
+
+            boost::system::error_code ec;
+            if (fs::is_directory(path, ec)) {
+                for_each_file(path, add);
+            } else if (fs::is_regular_file(path, ec)) {
+                add(path);
+            }
+
+            for (auto& entry : entries_) {
+                if (is_below(entry.first.second, folder) && files.find(entry.first.second) == files.end()) {
+                    removed.insert(entry.first);
+                }
+            }
+            for (auto& file : files) {
+                media_key key(get_id(file.first), file.first);
+                auto      it = entries_.find(key);
+                if (it == entries_.end() || it->second.stat.size != file.second.size ||
+                    it->second.stat.mtime != file.second.mtime) {
+                    changed[key] = file.second;
+                }
+            }
+        }
+
+        if (!removed.empty()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& key : removed) {
+                entries_.erase(key);
+            }
+            cls_dirty_ = true;
+        }
+
+        if (!changed.empty()) {
+            CASPAR_LOG(info) << L"[media_index] Probing " << changed.size() << L" files.";
+        }
+
+        tbb::task_arena arena(threads_);
+
+        std::vector<std::pair<media_key, file_stat>> pending(changed.begin(), changed.end());
+        for (std::size_t offset = 0; offset < pending.size() && !abort_request_; offset += CHUNK_SIZE) {
+            const auto               count = std::min(CHUNK_SIZE, pending.size() - offset);
+            std::vector<media_entry> results(count);
+
+            arena.execute([&] {
+                tbb::parallel_for(std::size_t(0), count, [&](std::size_t n) {
+                    if (!abort_request_) {
+                        auto& file = pending[offset + n];
+                        results[n] = probe(media_folder_ / file.first.second, file.second);
+                    }
+                });
+            });
+
+            if (abort_request_) {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (auto n = 0ULL; n < count; ++n) {
+                    entries_[pending[offset + n].first] = results[n];
+                }
+                cls_dirty_ = true;
+            }
+
+            for (auto n = 0ULL; n < count; ++n) {
+                if (has_video(results[n])) {
+                    thumbnails_->generate(source(pending[offset + n].first, results[n]), false, false, nullptr);
+                }
+            }
+        }
+
+        if (!removed.empty() || !changed.empty()) {
+            save();
+        }
+
+        // Also picks up thumbnails that were missing from the previous run and removes those of deleted files.
+        if (paths.empty()) {
+            generate_thumbnails();
+        }
+    }
+
+    void load()
+    {
+        boost::system::error_code ec;
+        if (!fs::exists(index_file_, ec)) {
+            return;
+        }
+
+        fs::ifstream file(index_file_);
+        std::string  line;
+        if (!std::getline(file, line) || line != INDEX_HEADER) {
+            CASPAR_LOG(warning) << L"[media_index] Ignoring " << index_file_.wstring() << L" (unknown format).";
+            return;
+        }
+
+        std::map<media_key, media_entry> entries;
+        while (std::getline(file, line)) {
+            std::vector<std::string> fields;
+            boost::split(fields, line, boost::is_any_of("\t"));
+            if (fields.size() != 8) {
+                continue;
+            }
+
+            try {
+                media_entry entry;
+                entry.stat.size     = std::stoull(fields[1]);
+                entry.stat.mtime    = static_cast<std::time_t>(std::stoll(fields[2]));
+                entry.valid         = fields[3] == "1";
+                entry.type          = fields[4];
+                entry.frames        = std::stoll(fields[5]);
+                entry.time_base_num = std::stoi(fields[6]);
+                entry.time_base_den = std::stoi(fields[7]);
+
+                const auto relative = u16(fields[0]);
+                entries.emplace(media_key(get_id(relative), relative), std::move(entry));
+            } catch (...) {
+                // Re-probed by the initial scan.
+            }
+        }
+
+        CASPAR_LOG(info) << L"[media_index] Loaded " << entries.size() << L" files from " << index_file_.wstring();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_   = std::move(entries);
+        cls_dirty_ = true;
+    }
+
+    void save()
+    {
+        auto temp = index_file_;
+        temp += ".tmp";
+
+        try {
+            {
+                fs::ofstream file(temp, std::ios::trunc);
+                file << INDEX_HEADER << '\n';
+                for (auto& entry : entries_) {
+                    const auto relative = u8(entry.first.second);
+                    if (relative.find_first_of("\t\r\n") != std::string::npos) {
+                        continue;
+                    }
+
+                    auto& e = entry.second;
+                    file << relative << '\t' << e.stat.size << '\t' << static_cast<int64_t>(e.stat.mtime) << '\t'
+                         << (e.valid ? 1 : 0) << '\t' << e.type << '\t' << e.frames << '\t' << e.time_base_num
+                         << '\t' << e.time_base_den << '\n';
+                }
+                if (!file) {
+                    CASPAR_THROW_EXCEPTION(file_write_error() << msg_info(L"Failed to write " + temp.wstring()));
+                }
+            }
+            fs::rename(temp, index_file_);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+};
+
+media_index::media_index(fs::path                         media_folder,
+                         fs::path                         template_folder,
+                         fs::path                         font_folder,
+                         fs::path                         index_file,
+                         int                              threads,
+                         std::chrono::seconds             rescan_interval,
+                         std::shared_ptr<thumbnail_cache> thumbnails)
+    : impl_(new impl(std::move(media_folder),
+                     std::move(template_folder),
+                     std::move(font_folder),
+                     std::move(index_file),
+                     threads,
+                     rescan_interval,
+                     std::move(thumbnails)))
+{
+}
+
+media_index::~media_index() {}
+
+std::wstring media_index::cls() { return impl_->cls(); }
+
+std::wstring media_index::cinf(const std::wstring& id) { return impl_->cinf(id); }
+
+std::wstring media_index::tls() { return impl_->templates_.text(); }
+
+std::wstring media_index::fls() { return impl_->fonts_.text(); }
+
+std::wstring media_index::thumbnails() { return impl_->thumbnails(); }
+
+std::vector<char> media_index::thumbnail(const std::wstring& id) { return impl_->thumbnail(id); }
+
+void media_index::generate_thumbnail(const std::wstring& id, std::function<void(bool)> done)
+{
+    impl_->generate_thumbnail(id, std::move(done));
+}
+
+void media_index::generate_thumbnails()
+{
+    impl_->executor_.begin_invoke([this] { impl_->generate_thumbnails(); });
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+class thumbnail_cache;
+
+// In-process replacement for the media scanner's CLS, CINF, TLS and FLS replies.
+//
+// Every file in the media folder is probed with libavformat once and the result is kept in memory and persisted to
+// index_file, so that a restart only probes files whose size or modification time changed. The folder is scanned in
+// the background on startup and then kept up to date with a directory_watcher. Until the first scan has finished the
+// replies are served from the persisted index.
+//
+// Thumbnails of new and changed movies and stills are queued in thumbnails as they are probed.
+class media_index
+{
+  public:
+    media_index(boost::filesystem::path          media_folder,
+                boost::filesystem::path          template_folder,
+                boost::filesystem::path          font_folder,
+                boost::filesystem::path          index_file,
+                int                              threads,
+                std::chrono::seconds             rescan_interval,
+                std::shared_ptr<thumbnail_cache> thumbnails);
+    ~media_index();
+
+    media_index(const media_index&)            = delete;
+    media_index& operator=(const media_index&) = delete;
+
+    // One CINF line per media file, sorted by id.
+    std::wstring cls();
+
+    // The CINF lines of the media files with the given id, empty if there are none.
+    std::wstring cinf(const std::wstring& id);
+
+    // One id per template.
+    std::wstring tls();
+
+    // One id per font.
+    std::wstring fls();
+
+    // One line per media file with a thumbnail: "<id>" <created> <size>
+    std::wstring thumbnails();
+
+    // The PNG thumbnail of the media file with the given id, empty if there is none.
+    std::vector<char> thumbnail(const std::wstring& id);
+
+    // Makes the thumbnail of the media file with the given id again, ahead of other thumbnails. Calls done with false
+    // if there is no such file or the thumbnail could not be made.
+    void generate_thumbnail(const std::wstring& id, std::function<void(bool)> done);
+
+    // Queues the thumbnails of every media file that does not have one.
+    void generate_thumbnails();
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,428 @@
+#include "../StdAfx.h"
+
+#include "thumbnail_cache.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+namespace fs = boost::filesystem;
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Packets read after seeking before giving up on reaching the target frame.
+const int MAX_PACKETS = 2000;
+
+// FNV-1a of the path, size and modification time.
+std::string make_key(const thumbnail_source& source)
+{
+    const auto str = u8(source.path.generic_wstring()) + '\0' + std::to_string(source.size) + '\0' +
+                     std::to_string(static_cast<int64_t>(source.mtime));
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto c : str) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%016llx.png", static_cast<unsigned long long>(hash));
+    return buf;
+}
+
+std::shared_ptr<AVFrame> decode_frame(const fs::path& path)
+{
+    AVFormatContext* input = nullptr;
+    FF(avformat_open_input(&input, u8(path.wstring()).c_str(), nullptr, nullptr));
+    CASPAR_SCOPE_EXIT { avformat_close_input(&input); };
+
+    FF(avformat_find_stream_info(input, nullptr));
+
+    const auto index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    FF_RET(index, "av_find_best_stream");
+    const auto stream = input->streams[index];
+
+    const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        FF_RET(AVERROR_DECODER_NOT_FOUND, "avcodec_find_decoder");
+    }
+
+    auto decoder = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                                   [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+    if (!decoder) {
+        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+    }
+
+    FF(avcodec_parameters_to_context(decoder.get(), stream->codecpar));
+    decoder->pkt_timebase = stream->time_base;
+    decoder->thread_count = 1;
+    FF(avcodec_open2(decoder.get(), codec, nullptr));
+
+    // The first frame is often black, so the frame halfway into the file is used instead.
+    auto target = AV_NOPTS_VALUE;
+    if (input->duration > 0 && (stream->disposition & AV_DISPOSITION_ATTACHED_PIC) == 0) {
+        target = av_rescale_q(input->duration / 2, AVRational{1, AV_TIME_BASE}, stream->time_base);
+        if (stream->start_time != AV_NOPTS_VALUE) {
+            target += stream->start_time;
+        }
+        if (av_seek_frame(input, index, target, AVSEEK_FLAG_BACKWARD) < 0) {
+            target = AV_NOPTS_VALUE;
+        }
+    }
+
+    std::shared_ptr<AVFrame> frame;
+    auto                     found   = false;
+    auto                     flushed = false;
+    for (auto packets = 0; !found && !flushed && packets < MAX_PACKETS; ++packets) {
+        auto packet = alloc_packet();
+        auto ret    = av_read_frame(input, packet.get());
+        if (ret == AVERROR_EOF) {
+            FF(avcodec_send_packet(decoder.get(), nullptr));
+            flushed = true;
+        } else {
+            FF_RET(ret, "av_read_frame");
+            if (packet->stream_index != index) {
+                continue;
+            }
+            FF(avcodec_send_packet(decoder.get(), packet.get()));
+        }
+
+        while (!found) {
+            auto next = alloc_frame();
+            ret       = avcodec_receive_frame(decoder.get(), next.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            }
+            FF_RET(ret, "avcodec_receive_frame");
+
+            frame = std::move(next);
+            found = target == AV_NOPTS_VALUE || frame->best_effort_timestamp == AV_NOPTS_VALUE ||
+                    frame->best_effort_timestamp >= target;
+        }
+    }
+
+    if (!frame) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"No video frame in " + path.wstring()));
+    }
+    return frame;
+}
+
+std::vector<char> encode_png(const std::shared_ptr<AVFrame>& frame, int width)
+{
+    const auto sar    = frame->sample_aspect_ratio.num > 0 && frame->sample_aspect_ratio.den > 0
+                            ? av_q2d(frame->sample_aspect_ratio)
+                            : 1.0;
+    const auto height = std::max(2, static_cast<int>(std::lround(width * frame->height / (frame->width * sar) / 2)) * 2);
+
+    auto sws = std::shared_ptr<SwsContext>(sws_getContext(frame->width,
+                                                          frame->height,
+                                                          static_cast<AVPixelFormat>(frame->format),
+                                                          width,
+                                                          height,
+                                                          AV_PIX_FMT_RGB24,
+                                                          SWS_BICUBIC,
+                                                          nullptr,
+                                                          nullptr,
+                                                          nullptr),
+                                           [](SwsContext* ptr) { sws_freeContext(ptr); });
+    if (!sws) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to create thumbnail scaler"));
+    }
+
+    auto rgb    = alloc_frame();
+    rgb->width  = width;
+    rgb->height = height;
+    rgb->format = AV_PIX_FMT_RGB24;
+    FF(av_frame_get_buffer(rgb.get(), 0));
+
+    sws_scale(sws.get(), frame->data, frame->linesize, 0, frame->height, rgb->data, rgb->linesize);
+
+    const auto codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec) {
+        FF_RET(AVERROR_ENCODER_NOT_FOUND, "avcodec_find_encoder");
+    }
+
+    auto encoder = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                                   [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+    if (!encoder) {
+        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+    }
+
+    encoder->width     = width;
+    encoder->height    = height;
+    encoder->pix_fmt   = AV_PIX_FMT_RGB24;
+    encoder->time_base = AVRational{1, 25};
+    FF(avcodec_open2(encoder.get(), codec, nullptr));
+
+    FF(avcodec_send_frame(encoder.get(), rgb.get()));
+    FF(avcodec_send_frame(encoder.get(), nullptr));
+
+    auto packet = alloc_packet();
+    FF(avcodec_receive_packet(encoder.get(), packet.get()));
+
+    return std::vector<char>(packet->data, packet->data + packet->size);
+}
+
+} // namespace
+
+struct thumbnail_cache::impl
+{
+    struct job
+    {
+        thumbnail_source                       source;
+        bool                                   force = false;
+        std::vector<std::function<void(bool)>> done;
+    };
+
+    const fs::path folder_;
+    const int      width_;
+
+    std::mutex                            mutex_;
+    std::condition_variable               cond_;
+    std::map<std::string, thumbnail_info> thumbnails_; // By file name in folder_.
+    std::map<std::string, job>            jobs_;
+    std::deque<std::string>               urgent_;
+    std::deque<std::string>               background_;
+    bool                                  abort_request_ = false;
+    std::vector<std::thread>              threads_;
+
+    impl(fs::path folder, int width, int threads)
+        : folder_(std::move(folder))
+        , width_(std::max(width, 2))
+    {
+        fs::create_directories(folder_);
+
+        boost::system::error_code ec;
+        for (auto it = fs::directory_iterator(folder_, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+            boost::system::error_code file_ec;
+            thumbnail_info            info;
+            info.created = fs::last_write_time(it->path(), file_ec);
+            info.size    = fs::file_size(it->path(), file_ec);
+            if (!file_ec && it->path().extension() == ".png") {
+                thumbnails_[it->path().filename().string()] = info;
+            }
+        }
+
+        // A client waits for the reply to an urgent request, so those are not left to the idle priority threads.
+        threads_.emplace_back([this] {
+            set_thread_name(L"thumbnails-urgent");
+            run(urgent_);
+        });
+        for (auto n = 0; n < std::max(threads, 1); ++n) {
+            threads_.emplace_back([this] {
+                set_thread_name(L"thumbnails");
+                set_thread_background_priority();
+                run(background_);
+            });
+        }
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+
+        for (auto& job : jobs_) {
+            for (auto& done : job.second.done) {
+                done(false);
+            }
+        }
+    }
+
+    std::optional<thumbnail_info> info(const thumbnail_source& source)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = thumbnails_.find(make_key(source));
+        if (it == thumbnails_.end()) {
+            return {};
+        }
+        return it->second;
+    }
+
+    std::vector<char> read(const thumbnail_source& source)
+    {
+        const auto key = make_key(source);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (thumbnails_.find(key) == thumbnails_.end()) {
+                return {};
+            }
+        }
+
+        fs::ifstream file(folder_ / key, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void generate(const thumbnail_source& source, bool urgent, bool force, std::function<void(bool)> done)
+    {
+        const auto key = make_key(source);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (force || thumbnails_.find(key) == thumbnails_.end()) {
+                auto it = jobs_.find(key);
+                if (it == jobs_.end()) {
+                    it                = jobs_.emplace(key, job()).first;
+                    it->second.source = source;
+                    (urgent ? urgent_ : background_).push_back(key);
+                } else if (urgent) {
+                    // Also left in the background queue, which skips it once it has been made.
+                    urgent_.push_back(key);
+                }
+                it->second.force = it->second.force || force;
+                if (done) {
+                    it->second.done.push_back(std::move(done));
+                }
+                cond_.notify_all();
+                return;
+            }
+        }
+
+        if (done) {
+            done(true);
+        }
+    }
+
+    void retain(const std::vector<thumbnail_source>& sources)
+    {
+        std::set<std::string> keys;
+        for (auto& source : sources) {
+            keys.insert(make_key(source));
+        }
+
+        std::vector<std::string> removed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = thumbnails_.begin(); it != thumbnails_.end();) {
+                if (keys.find(it->first) == keys.end()) {
+                    removed.push_back(it->first);
+                    it = thumbnails_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        for (auto& key : removed) {
+            boost::system::error_code ec;
+            fs::remove(folder_ / key, ec);
+        }
+    }
+
+    void run(std::deque<std::string>& queue)
+    {
+        while (true) {
+            std::string key;
+            job         j;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_request_ || !queue.empty(); });
+                if (abort_request_) {
+                    return;
+                }
+
+                key = std::move(queue.front());
+                queue.pop_front();
+
+                auto it = jobs_.find(key);
+                if (it == jobs_.end()) {
+                    continue;
+                }
+                j = std::move(it->second);
+                jobs_.erase(it);
+            }
+
+            auto ok = false;
+            try {
+                const auto png = encode_png(decode_frame(j.source.path), width_);
+
+                auto temp = folder_ / key;
+                temp += ".tmp";
+                {
+                    fs::ofstream file(temp, std::ios::binary | std::ios::trunc);
+                    file.write(png.data(), png.size());
+                    if (!file) {
+                        CASPAR_THROW_EXCEPTION(file_write_error() << msg_info(L"Failed to write " + temp.wstring()));
+                    }
+                }
+                fs::rename(temp, folder_ / key);
+
+                thumbnail_info info;
+                info.created = std::time(nullptr);
+                info.size    = png.size();
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    thumbnails_[key] = info;
+                }
+                ok = true;
+            } catch (...) {
+                CASPAR_LOG(warning) << L"[thumbnail_cache] Failed to make a thumbnail of " << j.source.path.wstring()
+                                    << L".";
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            for (auto& done : j.done) {
+                done(ok);
+            }
+        }
+    }
+};
+
+thumbnail_cache::thumbnail_cache(fs::path folder, int width, int threads)
+    : impl_(new impl(std::move(folder), width, threads))
+{
+}
+
+thumbnail_cache::~thumbnail_cache() {}
+
+std::optional<thumbnail_info> thumbnail_cache::info(const thumbnail_source& source) { return impl_->info(source); }
+
+std::vector<char> thumbnail_cache::read(const thumbnail_source& source) { return impl_->read(source); }
+
+void thumbnail_cache::generate(const thumbnail_source& source, bool urgent, bool force, std::function<void(bool)> done)
+{
+    impl_->generate(source, urgent, force, std::move(done));
+}
+
+void thumbnail_cache::retain(const std::vector<thumbnail_source>& sources) { impl_->retain(sources); }
+
+}} // namespace caspar::ffmpeg
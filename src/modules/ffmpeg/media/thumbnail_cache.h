@@ -0,0 +1,60 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+struct thumbnail_source
+{
+    boost::filesystem::path path;
+    uint64_t                size  = 0;
+    std::time_t             mtime = 0;
+};
+
+struct thumbnail_info
+{
+    std::time_t created = 0;
+    uint64_t    size    = 0;
+};
+
+// PNG thumbnails of media files, stored in folder under a hash of the path, size and modification time of the file
+// they were made from. A changed file therefore never returns a stale thumbnail, and unchanged files keep theirs
+// across restarts.
+//
+// Thumbnails are made from a frame halfway into the file on a fixed number of threads which only run when the cpu is
+// otherwise idle, so that they never compete with playout. Urgent requests, which a client is waiting for, are made
+// one at a time on a thread of normal priority instead, so that a busy server still answers them.
+class thumbnail_cache
+{
+  public:
+    thumbnail_cache(boost::filesystem::path folder, int width, int threads);
+    ~thumbnail_cache();
+
+    thumbnail_cache(const thumbnail_cache&)            = delete;
+    thumbnail_cache& operator=(const thumbnail_cache&) = delete;
+
+    std::optional<thumbnail_info> info(const thumbnail_source& source);
+
+    // The PNG file, empty if there is no thumbnail.
+    std::vector<char> read(const thumbnail_source& source);
+
+    // Calls done from a worker thread once the thumbnail has been made, with false if that failed or the cache was
+    // destroyed first. Does nothing but call done if the thumbnail exists, unless force is set.
+    void generate(const thumbnail_source& source, bool urgent, bool force, std::function<void(bool)> done);
+
+    // Removes the thumbnails of every file but these.
+    void retain(const std::vector<thumbnail_source>& sources);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,104 @@
+#include "av_cache.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace caspar { namespace ffmpeg {
+
+std::size_t cached_frame_bytes(const core::const_frame& frame)
+{
+    std::size_t bytes = frame.audio_data().size() * sizeof(int32_t);
+    for (auto n = 0ULL; n < frame.pixel_format_desc().planes.size(); ++n) {
+        bytes += frame.image_data(n).size() + frame.pixel_format_desc().planes[n].size;
+    }
+    return bytes;
+}
+
+ClipCache& ClipCache::instance()
+{
+    static ClipCache cache;
+    return cache;
+}
+
+ClipCache::ClipCache()
+    : max_duration_(static_cast<int64_t>(
+          env::properties().get(L"configuration.ffmpeg.producer.clip-cache.max-duration", 10.0) * 1000000.0))
+    , max_bytes_(env::properties().get(L"configuration.ffmpeg.producer.clip-cache.max-size", std::size_t{0}) * 1024 *
+                 1024)
+{
+}
+
+void ClipCache::clear()
+{
+    std::list<entry_t> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries.swap(entries_);
+        index_.clear();
+        bytes_ = 0;
+    }
+}
+
+std::shared_ptr<const CachedClip> ClipCache::find(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        misses_ += 1;
+        return nullptr;
+    }
+
+    hits_ += 1;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+}
+
+void ClipCache::insert(const std::string& key, std::shared_ptr<const CachedClip> clip)
+{
+    if (!clip || clip->bytes > max_bytes_) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        bytes_ -= it->second->second->bytes;
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+
+    while (!entries_.empty() && bytes_ + clip->bytes > max_bytes_) {
+        auto& last = entries_.back();
+        CASPAR_LOG(debug) << L"[ffmpeg] Evicting " << u16(last.first) << L" from clip cache.";
+        bytes_ -= last.second->bytes;
+        index_.erase(last.first);
+        entries_.pop_back();
+        evictions_ += 1;
+    }
+
+    bytes_ += clip->bytes;
+    entries_.emplace_front(key, std::move(clip));
+    index_[key] = entries_.begin();
+}
+
+core::monitor::state ClipCache::state() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    core::monitor::state state;
+    state["entries"]   = static_cast<int64_t>(entries_.size());
+    state["size"]      = {static_cast<int64_t>(bytes_), static_cast<int64_t>(max_bytes_)};
+    state["hits"]      = hits_;
+    state["misses"]    = misses_;
+    state["evictions"] = evictions_;
+    return state;
+}
+
+}} // namespace caspar::ffmpeg
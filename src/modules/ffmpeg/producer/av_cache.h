@@ -0,0 +1,78 @@
+#pragma once
+
+#include <core/frame/frame.h>
+#include <core/monitor/monitor.h>
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+struct CachedFrame
+{
+    core::const_frame frame;
+    int64_t           pts      = 0;
+    int64_t           duration = 0;
+};
+
+// A clip range that has been decoded in full. Timestamps are in AV_TIME_BASE units.
+struct CachedClip
+{
+    std::vector<CachedFrame> frames;
+    int64_t                  start          = 0;
+    int64_t                  end            = 0;
+    int64_t                  duration       = 0;
+    int64_t                  input_duration = 0;
+    bool                     eof            = false;
+    std::size_t              bytes          = 0;
+};
+
+// The memory a cached frame keeps: its host buffers, the textures they were uploaded to and its audio.
+std::size_t cached_frame_bytes(const core::const_frame& frame);
+
+// Process wide LRU cache of decoded clips, shared by all producers on all channels. The cached frames
+// keep their uploaded textures, so replaying a clip does no I/O, decoding or upload work. The textures
+// keep the ogl device alive, so the module clears the cache on uninit, while the device still exists.
+class ClipCache
+{
+  public:
+    static ClipCache& instance();
+
+    void clear();
+
+    ClipCache(const ClipCache&)            = delete;
+    ClipCache& operator=(const ClipCache&) = delete;
+
+    bool        enabled() const { return max_bytes_ > 0; }
+    int64_t     max_duration() const { return max_duration_; }
+    std::size_t max_bytes() const { return max_bytes_; }
+
+    std::shared_ptr<const CachedClip> find(const std::string& key);
+    void                              insert(const std::string& key, std::shared_ptr<const CachedClip> clip);
+
+    core::monitor::state state() const;
+
+  private:
+    ClipCache();
+
+    using entry_t = std::pair<std::string, std::shared_ptr<const CachedClip>>;
+
+    const int64_t     max_duration_;
+    const std::size_t max_bytes_;
+
+    mutable std::mutex                                  mutex_;
+    std::list<entry_t>                                  entries_;
+    std::map<std::string, std::list<entry_t>::iterator> index_;
+    std::size_t                                         bytes_     = 0;
+    int64_t                                             hits_      = 0;
+    int64_t                                             misses_    = 0;
+    int64_t                                             evictions_ = 0;
+};
+
+}} // namespace caspar::ffmpeg
@@ -3,6 +3,7 @@
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
+#include <common/env.h>
 #include <common/except.h>
 #include <common/os/thread.h>
 #include <common/param.h>
@@ -26,6 +27,9 @@ extern "C" {
 
 namespace caspar { namespace ffmpeg {
 
+const std::size_t               READ_AHEAD_BLOCK_SIZE = 1024 * 1024;
+const std::chrono::milliseconds READ_TIMEOUT(60000); // Same as the rw_timeout of the file protocol
+
 Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, std::optional<bool> seekable)
     : filename_(filename)
     , graph_(graph)
@@ -76,9 +80,8 @@ Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> gr
 
 Input::~Input()
 {
-    graph_         = spl::shared_ptr<diagnostics::graph>();
-    abort_request_ = true;
-    ic_cond_.notify_all();
+    graph_ = spl::shared_ptr<diagnostics::graph>();
+    abort_reader();
 
     std::shared_ptr<AVPacket> packet;
     while (buffer_.try_pop(packet))
@@ -103,11 +106,22 @@ bool Input::try_pop(std::shared_ptr<AVPacket>& packet)
 AVFormatContext*       Input::operator->() { return ic_.get(); }
 AVFormatContext* const Input::operator->() const { return ic_.get(); }
 
-void Input::abort()
+void Input::abort_reader()
 {
     abort_request_ = true;
     ic_cond_.notify_all();
 
+    // av_read_frame holds ic_mutex_ while it waits on the reader, so wake the reader directly.
+    std::lock_guard<std::mutex> lock(reader_mutex_);
+    if (auto reader = reader_.lock()) {
+        reader->abort();
+    }
+}
+
+void Input::abort()
+{
+    abort_reader();
+
     std::shared_ptr<AVPacket> packet;
     while (buffer_.try_pop(packet))
         ;
@@ -145,12 +159,35 @@ void Input::internal_reset()
         filename_    = u8(url_parts.second);
     }
 
+    // When enabled, local files are read through our own read-ahead context instead of the file protocol.
+    std::shared_ptr<FileReader> reader;
+    const auto read_ahead = env::properties().get(L"configuration.ffmpeg.producer.read-ahead", 0);
+    if (url_parts.first.empty() && input_format == nullptr && read_ahead > 0) {
+        reader = std::make_shared<FileReader>(filename_,
+                                              READ_AHEAD_BLOCK_SIZE,
+                                              read_ahead,
+                                              READ_TIMEOUT,
+                                              [this] { return abort_request_.load(); },
+                                              graph_,
+                                              io_stats_);
+
+        std::lock_guard<std::mutex> lock(reader_mutex_);
+        reader_ = reader;
+        if (abort_request_) {
+            reader->abort();
+        }
+    }
+
     if (seekable_) {
         CASPAR_LOG(debug) << "av_input[" + filename_ + "] Disabled seeking";
-        FF(av_dict_set(&options, "seekable", *seekable_ ? "1" : "0", 0));
+        if (reader) {
+            reader->context()->seekable = *seekable_ ? AVIO_SEEKABLE_NORMAL : 0;
+        } else {
+            FF(av_dict_set(&options, "seekable", *seekable_ ? "1" : "0", 0));
+        }
     }
 
-    if (input_format == nullptr) {
+    if (input_format == nullptr && !reader) {
         // TODO (fix) timeout?
         FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
     }
@@ -159,8 +196,13 @@ void Input::internal_reset()
     ic->interrupt_callback.callback = Input::interrupt_cb;
     ic->interrupt_callback.opaque   = this;
 
+    if (reader) {
+        ic->pb = reader->context();
+    }
+
     FF(avformat_open_input(&ic, filename_.c_str(), input_format, &options));
-    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    // The reader must outlive the format context which references its AVIOContext.
+    auto ic2 = std::shared_ptr<AVFormatContext>(ic, [reader](AVFormatContext* ctx) { avformat_close_input(&ctx); });
 
     for (auto& p : to_map(&options)) {
         CASPAR_LOG(warning) << "av_input[" + filename_ + "]" << " Unused option " << p.first << "=" << p.second;
@@ -173,6 +215,8 @@ void Input::internal_reset()
 
 bool Input::eof() const { return eof_; }
 
+const IOStats& Input::io_stats() const { return *io_stats_; }
+
 void Input::seek(int64_t ts, bool flush)
 {
     std::unique_lock<std::mutex> lock(ic_mutex_);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "av_io.h"
+
 #include <common/diagnostics/graph.h>
 
 #include <atomic>
@@ -40,18 +42,25 @@ class Input
     bool eof() const;
     void seek(int64_t ts, bool flush = true);
 
+    const IOStats& io_stats() const;
+
   private:
     void internal_reset();
+    void abort_reader();
 
     std::optional<bool> seekable_;
 
     std::string                         filename_;
     std::shared_ptr<diagnostics::graph> graph_;
+    std::shared_ptr<IOStats>            io_stats_ = std::make_shared<IOStats>();
 
     mutable std::mutex               ic_mutex_;
     std::shared_ptr<AVFormatContext> ic_;
     std::condition_variable          ic_cond_;
 
+    std::mutex                reader_mutex_;
+    std::weak_ptr<FileReader> reader_;
+
     tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> buffer_;
 
     std::atomic<bool> eof_{false};
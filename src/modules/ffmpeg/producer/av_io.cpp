@@ -0,0 +1,337 @@
+#include "av_io.h"
+
+#include "../util/av_assert.h"
+
+#include <common/except.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const int IO_BUFFER_SIZE = 64 * 1024;
+
+std::FILE* open_file(const std::string& filename)
+{
+#ifdef _MSC_VER
+    return _wfopen(u16(filename).c_str(), L"rb");
+#else
+    return std::fopen(filename.c_str(), "rb");
+#endif
+}
+
+int seek_file(std::FILE* file, std::int64_t pos)
+{
+#ifdef _MSC_VER
+    return _fseeki64(file, pos, SEEK_SET);
+#else
+    return fseeko(file, static_cast<off_t>(pos), SEEK_SET);
+#endif
+}
+
+void advise(std::FILE* file, std::int64_t pos, std::int64_t len, bool sequential)
+{
+#if !defined(_MSC_VER) && defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fileno(file), static_cast<off_t>(pos), static_cast<off_t>(len),
+                  sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_WILLNEED);
+#endif
+}
+
+double smooth(double prev, double value) { return prev > 0.0 ? prev * 0.9 + value * 0.1 : value; }
+
+} // namespace
+
+FileReader::FileReader(const std::string&                  filename,
+                       std::size_t                         block_size,
+                       std::size_t                         block_count,
+                       std::chrono::milliseconds           timeout,
+                       std::function<bool()>               interrupted,
+                       std::shared_ptr<diagnostics::graph> graph,
+                       std::shared_ptr<IOStats>            stats)
+    : filename_(filename)
+    , block_size_(block_size)
+    , block_count_(std::max<std::size_t>(block_count, 2))
+    , timeout_(timeout)
+    , interrupted_(std::move(interrupted))
+    , graph_(std::move(graph))
+    , stats_(std::move(stats))
+{
+    file_ = open_file(filename_);
+    if (!file_) {
+        FF_RET(AVERROR(errno), "fopen");
+    }
+
+    // Reads are always full blocks, stdio buffering would only add a copy.
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+    advise(file_, 0, 0, true);
+
+    graph_->set_color("read-ahead", diagnostics::color(0.4f, 0.6f, 0.9f));
+    graph_->set_color("io-stall", diagnostics::color(0.9f, 0.4f, 0.2f));
+
+    auto buffer = static_cast<std::uint8_t*>(av_malloc(IO_BUFFER_SIZE));
+    if (!buffer) {
+        std::fclose(file_);
+        FF_RET(AVERROR(ENOMEM), "av_malloc");
+    }
+
+    auto ctx = avio_alloc_context(
+        buffer, IO_BUFFER_SIZE, 0, this, &FileReader::read_packet, nullptr, &FileReader::seek_packet);
+    if (!ctx) {
+        av_free(buffer);
+        std::fclose(file_);
+        FF_RET(AVERROR(ENOMEM), "avio_alloc_context");
+    }
+
+    ctx_ = std::shared_ptr<AVIOContext>(ctx, [](AVIOContext* ptr) {
+        av_freep(&ptr->buffer);
+        avio_context_free(&ptr);
+    });
+
+    thread_ = boost::thread([this] {
+        try {
+            set_thread_name(L"[ffmpeg::av_producer::FileReader]");
+            run();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    });
+}
+
+FileReader::~FileReader()
+{
+    abort();
+
+    thread_.join();
+    ctx_.reset();
+    std::fclose(file_);
+}
+
+void FileReader::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abort_ = true;
+    }
+    cond_.notify_all();
+}
+
+int FileReader::read_packet(void* opaque, std::uint8_t* buf, int buf_size)
+{
+    return static_cast<FileReader*>(opaque)->read(buf, buf_size);
+}
+
+int64_t FileReader::seek_packet(void* opaque, int64_t offset, int whence)
+{
+    return static_cast<FileReader*>(opaque)->seek(offset, whence);
+}
+
+void FileReader::update_window()
+{
+    // Release blocks the demuxer has moved past.
+    while (!blocks_.empty() && blocks_.front().size() == block_size_ &&
+           read_pos_ >= window_pos_ + static_cast<std::int64_t>(block_size_)) {
+        blocks_.pop_front();
+        window_pos_ += block_size_;
+        cond_.notify_all();
+    }
+
+    const auto window_end = window_pos_ + static_cast<std::int64_t>(block_size_ * block_count_);
+    if (read_pos_ >= window_pos_ && read_pos_ < window_end) {
+        return;
+    }
+
+    blocks_.clear();
+    window_pos_ = read_pos_ - read_pos_ % static_cast<std::int64_t>(block_size_);
+    window_eof_ = false;
+    primed_     = false;
+    error_      = 0;
+    generation_ += 1;
+    cond_.notify_all();
+
+    advise(file_, window_pos_, static_cast<std::int64_t>(block_size_ * block_count_), false);
+}
+
+int FileReader::read(std::uint8_t* buf, int buf_size)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout_;
+
+    while (true) {
+        if (abort_ || (interrupted_ && interrupted_())) {
+            return AVERROR_EXIT;
+        }
+
+        update_window();
+
+        const auto index  = static_cast<std::size_t>((read_pos_ - window_pos_) / block_size_);
+        const auto offset = static_cast<std::size_t>((read_pos_ - window_pos_) % block_size_);
+
+        if (index < blocks_.size()) {
+            const auto& block = blocks_[index];
+            if (offset >= block.size()) {
+                return AVERROR_EOF;
+            }
+            const auto count = std::min(static_cast<std::size_t>(buf_size), block.size() - offset);
+            std::memcpy(buf, block.data() + offset, count);
+            read_pos_ += count;
+            stalled_ = false;
+            return static_cast<int>(count);
+        }
+
+        if (window_eof_) {
+            return AVERROR_EOF;
+        }
+
+        if (error_ != 0) {
+            return error_;
+        }
+
+        // A stall is counted once, however many times we wake up before the block arrives.
+        if (primed_ && !stalled_) {
+            stalled_ = true;
+            stats_->stalls += 1;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "io-stall");
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return AVERROR(ETIMEDOUT);
+        }
+
+        cond_.wait_until(lock, deadline);
+    }
+}
+
+int64_t FileReader::seek(int64_t offset, int whence)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (whence & AVSEEK_SIZE) {
+        return size();
+    }
+
+    std::int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = read_pos_ + offset;
+            break;
+        case SEEK_END:
+            pos = size() + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    read_pos_ = pos;
+    update_window();
+
+    return pos;
+}
+
+std::int64_t FileReader::size() const
+{
+    boost::system::error_code ec;
+    const auto                size = boost::filesystem::file_size(boost::filesystem::path(u16(filename_)), ec);
+    return ec ? AVERROR(EIO) : static_cast<std::int64_t>(size);
+}
+
+void FileReader::run()
+{
+    std::vector<std::uint8_t> block;
+
+    while (true) {
+        std::int64_t  pos;
+        std::uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return abort_ || (!window_eof_ && error_ == 0 && blocks_.size() < block_count_); });
+
+            if (abort_) {
+                return;
+            }
+
+            pos        = window_pos_ + static_cast<std::int64_t>(blocks_.size() * block_size_);
+            generation = generation_;
+        }
+
+        block.resize(block_size_);
+
+        const auto  start = std::chrono::steady_clock::now();
+        std::size_t count = 0;
+        int         error = 0;
+
+        if (seek_file(file_, pos) != 0) {
+            error = AVERROR(errno);
+        } else {
+            count = std::fread(block.data(), 1, block_size_, file_);
+            if (count < block_size_ && std::ferror(file_)) {
+                error = AVERROR(EIO);
+                std::clearerr(file_);
+            }
+        }
+
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        stats_->bytes_read += count;
+        stats_->latency = smooth(stats_->latency, elapsed * 1000.0);
+        if (elapsed > 0.0 && count > 0) {
+            stats_->throughput = smooth(stats_->throughput, count / (1024.0 * 1024.0) / elapsed);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (generation != generation_) {
+                continue;
+            }
+
+            if (error != 0) {
+                error_ = error;
+            } else {
+                window_eof_ = count < block_size_;
+                if (count > 0) {
+                    block.resize(count);
+                    blocks_.push_back(std::move(block));
+                    block   = std::vector<std::uint8_t>();
+                    primed_ = true;
+                }
+            }
+
+            graph_->set_value("read-ahead", static_cast<double>(blocks_.size()) / static_cast<double>(block_count_));
+        }
+        cond_.notify_all();
+    }
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <common/diagnostics/graph.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+struct AVIOContext;
+
+namespace caspar { namespace ffmpeg {
+
+struct IOStats
+{
+    std::atomic<std::int64_t> bytes_read{0};
+    std::atomic<double>       throughput{0.0}; // MiB/s
+    std::atomic<double>       latency{0.0};    // ms per block
+    std::atomic<std::int64_t> stalls{0};
+};
+
+// Custom AVIOContext for local files. A background thread keeps a window of block aligned
+// reads ahead of the demuxer so that a single slow read on shared storage does not stall
+// av_read_frame. A read that gets no data within timeout fails with ETIMEDOUT, like the
+// rw_timeout of the file protocol.
+class FileReader
+{
+  public:
+    FileReader(const std::string&                  filename,
+               std::size_t                         block_size,
+               std::size_t                         block_count,
+               std::chrono::milliseconds           timeout,
+               std::function<bool()>               interrupted,
+               std::shared_ptr<diagnostics::graph> graph,
+               std::shared_ptr<IOStats>            stats);
+    ~FileReader();
+
+    FileReader(const FileReader&)            = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    AVIOContext* context() const { return ctx_.get(); }
+
+    // Wakes a blocked read, which then fails with AVERROR_EXIT.
+    void abort();
+
+  private:
+    static int     read_packet(void* opaque, std::uint8_t* buf, int buf_size);
+    static int64_t seek_packet(void* opaque, int64_t offset, int whence);
+
+    int          read(std::uint8_t* buf, int buf_size);
+    int64_t      seek(int64_t offset, int whence);
+    void         update_window();
+    std::int64_t size() const;
+    void         run();
+
+    const std::string                   filename_;
+    const std::size_t                   block_size_;
+    const std::size_t                   block_count_;
+    const std::chrono::milliseconds     timeout_;
+    std::function<bool()>               interrupted_;
+    std::shared_ptr<diagnostics::graph> graph_;
+    std::shared_ptr<IOStats>            stats_;
+
+    std::FILE* file_ = nullptr;
+
+    std::mutex                            mutex_;
+    std::condition_variable               cond_;
+    std::deque<std::vector<std::uint8_t>> blocks_;
+    std::int64_t                          window_pos_ = 0;
+    std::int64_t                          read_pos_   = 0;
+    std::uint64_t                         generation_ = 0;
+    bool                                  window_eof_ = false;
+    bool                                  primed_     = false;
+    bool                                  stalled_    = false;
+    int                                   error_      = 0;
+    bool                                  abort_      = false;
+
+    std::shared_ptr<AVIOContext> ctx_;
+    boost::thread                thread_;
+};
+
+}} // namespace caspar::ffmpeg
@@ -1,11 +1,13 @@
 #include "av_producer.h"
 
+#include "av_cache.h"
 #include "av_input.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
 #include <boost/exception/exception.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/range/algorithm/rotate.hpp>
@@ -24,6 +26,7 @@
 
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
 #include <core/monitor/monitor.h>
 
 #ifdef _MSC_VER
@@ -49,8 +52,11 @@ extern "C" {
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <deque>
 #include <iomanip>
+#include <limits>
+#include <map>
 #include <memory>
 #include <queue>
 #include <sstream>
@@ -75,27 +81,6 @@ struct Frame
 // TODO (fix) Handle ts discontinuities.
 // TODO (feat) Forward options.
 
-core::color_space get_color_space(const std::shared_ptr<AVFrame>& video)
-{
-    auto result = core::color_space::bt709;
-    if (video) {
-        switch (video->colorspace) {
-            case AVColorSpace::AVCOL_SPC_BT2020_NCL:
-                result = core::color_space::bt2020;
-                break;
-            case AVColorSpace::AVCOL_SPC_BT470BG:
-            case AVColorSpace::AVCOL_SPC_SMPTE170M:
-            case AVColorSpace::AVCOL_SPC_SMPTE240M:
-                result = core::color_space::bt601;
-                break;
-            default:
-                break;
-        }
-    }
-
-    return result;
-}
-
 class Decoder
 {
     Decoder(const Decoder&)            = delete;
@@ -117,12 +102,14 @@ class Decoder
 
     boost::thread thread;
 
+    std::shared_ptr<void> direct_rendering;
+
   public:
     std::shared_ptr<AVCodecContext> ctx;
 
     Decoder() = default;
 
-    explicit Decoder(AVStream* stream)
+    Decoder(AVStream* stream, std::shared_ptr<core::frame_factory> frame_factory, const void* tag)
         : st(stream)
     {
         const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
@@ -162,6 +149,10 @@ class Decoder
             ctx->thread_type = FF_THREAD_SLICE;
         }
 
+        if (env::properties().get(L"configuration.ffmpeg.producer.direct-rendering", true)) {
+            direct_rendering = set_direct_rendering(ctx.get(), std::move(frame_factory), tag);
+        }
+
         FF(avcodec_open2(ctx.get(), codec, nullptr));
 
         thread = boost::thread([=]() {
@@ -328,12 +319,14 @@ struct Filter
 
     Filter() = default;
 
-    Filter(std::string                    filter_spec,
-           const Input&                   input,
-           std::map<int, Decoder>&        streams,
-           int64_t                        start_time,
-           AVMediaType                    media_type,
-           const core::video_format_desc& format_desc)
+    Filter(std::string                                 filter_spec,
+           const Input&                                input,
+           std::map<int, Decoder>&                     streams,
+           int64_t                                     start_time,
+           AVMediaType                                 media_type,
+           const core::video_format_desc&              format_desc,
+           const std::shared_ptr<core::frame_factory>& frame_factory,
+           const void*                                 tag)
     {
         if (media_type == AVMEDIA_TYPE_VIDEO) {
             if (filter_spec.empty()) {
@@ -498,7 +491,11 @@ struct Filter
 
                 auto it = streams.find(index);
                 if (it == streams.end()) {
-                    it = streams.emplace(index, input->streams[index]).first;
+                    it = streams
+                             .emplace(std::piecewise_construct,
+                                      std::forward_as_tuple(index),
+                                      std::forward_as_tuple(input->streams[index], frame_factory, tag))
+                             .first;
                 }
 
                 auto st = it->second.ctx;
@@ -707,6 +704,27 @@ struct AVProducer::Impl
     std::atomic<bool>         buffer_eof_{false};
     int                       buffer_capacity_ = static_cast<int>(format_desc_.fps) / 4;
 
+    // Number of frames to hold decoded (and uploaded) before the first frame is played.
+    int  preroll_ = 0;
+    bool playing_ = false;
+
+    bool                              input_open_ = false;
+    std::string                       cache_key_;
+    int64_t                           cache_start_    = AV_NOPTS_VALUE;
+    int64_t                           cache_duration_ = AV_NOPTS_VALUE;
+    std::shared_ptr<const CachedClip> clip_;
+    std::size_t                       clip_pos_ = 0;
+    std::shared_ptr<CachedClip>       capture_;
+    std::atomic<bool>                 cached_{false};
+
+    // Variable speed playback. Frames around the play head are decoded into gop_cache_, keyed by frame number,
+    // instead of buffer_ and next_frame() moves position_ through them. Both are guarded by buffer_mutex_.
+    std::atomic<double>      speed_{1.0};
+    double                   position_ = 0.0;
+    std::map<int64_t, Frame> gop_cache_;
+    int                      gop_cache_capacity_ = 120;
+    bool                     gop_seeked_         = false;
+
     std::optional<caspar::executor> video_executor_;
     std::optional<caspar::executor> audio_executor_;
 
@@ -725,7 +743,8 @@ struct AVProducer::Impl
          std::optional<int64_t>               duration,
          bool                                 loop,
          int                                  seekable,
-         core::frame_geometry::scale_mode     scale_mode)
+         core::frame_geometry::scale_mode     scale_mode,
+         int                                  preroll)
         : frame_factory_(frame_factory)
         , format_desc_(format_desc)
         , format_tb_({format_desc.duration, format_desc.time_scale * format_desc.field_count})
@@ -739,6 +758,7 @@ struct AVProducer::Impl
         , vfilter_(vfilter)
         , seekable_(seekable)
         , scale_mode_(scale_mode)
+        , preroll_(std::max(preroll, 0))
         , video_executor_(L"video-executor")
         , audio_executor_(L"audio-executor")
     {
@@ -747,6 +767,14 @@ struct AVProducer::Impl
         graph_->set_color("frame-time", diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("decode-time", diagnostics::color(0.0f, 1.0f, 1.0f));
         graph_->set_color("buffer", diagnostics::color(1.0f, 1.0f, 0.0f));
+        graph_->set_color("gop-cache", diagnostics::color(0.3f, 0.8f, 0.6f));
+
+        buffer_capacity_    = std::max(buffer_capacity_, preroll_);
+        gop_cache_capacity_ = std::max(env::properties().get(L"configuration.ffmpeg.producer.gop-cache", 120), 8);
+
+        cache_key_      = make_cache_key();
+        cache_start_    = start_;
+        cache_duration_ = duration_;
 
         state_["file/name"] = u8(name_);
         state_["file/path"] = u8(path_);
@@ -792,9 +820,12 @@ struct AVProducer::Impl
         CASPAR_LOG(debug) << print() << " Joined";
     }
 
-    void run(std::optional<int64_t> firstSeek)
+    void open_input()
     {
-        std::vector<int> audio_cadence = format_desc_.audio_cadence;
+        if (input_open_) {
+            return;
+        }
+        input_open_ = true;
 
         input_.reset();
         {
@@ -813,22 +844,48 @@ struct AVProducer::Impl
             input_duration_ = input_->duration;
         }
 
+        const auto start = start_.load();
+        if (duration_ == AV_NOPTS_VALUE && input_->duration > 0) {
+            if (start != AV_NOPTS_VALUE) {
+                duration_ = input_->duration - start;
+            } else {
+                duration_ = input_->duration;
+            }
+        }
+    }
+
+    void run(std::optional<int64_t> firstSeek)
+    {
+        std::vector<int> audio_cadence = format_desc_.audio_cadence;
+
         {
-            const auto start = start_.load();
-            if (duration_ == AV_NOPTS_VALUE && input_->duration > 0) {
-                if (start != AV_NOPTS_VALUE) {
-                    duration_ = input_->duration - start;
-                } else {
-                    duration_ = input_->duration;
+            const auto firstStart = firstSeek ? av_rescale_q(*firstSeek, format_tb_, TIME_BASE_Q) : start_.load();
+
+            if (!cache_key_.empty()) {
+                clip_ = ClipCache::instance().find(cache_key_);
+            }
+
+            if (clip_) {
+                input_duration_ = clip_->input_duration;
+                if (duration_ == AV_NOPTS_VALUE) {
+                    duration_ = clip_->duration;
+                }
+                if (!seek_clip(firstStart)) {
+                    clip_.reset();
                 }
             }
 
-            const auto firstStart = firstSeek ? av_rescale_q(*firstSeek, format_tb_, TIME_BASE_Q) : start;
-            if (firstStart != AV_NOPTS_VALUE) {
-                seek_internal(firstStart);
-            } else {
-                reset(input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+            if (!clip_) {
+                open_input();
+                if (firstStart != AV_NOPTS_VALUE) {
+                    seek_internal(firstStart);
+                } else {
+                    reset(input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
+                }
+                begin_capture(firstStart);
             }
+
+            cached_ = clip_ != nullptr;
         }
 
         set_thread_name(L"[ffmpeg::av_producer]");
@@ -846,13 +903,59 @@ struct AVProducer::Impl
                 const auto seek = seek_.exchange(AV_NOPTS_VALUE);
 
                 if (seek != AV_NOPTS_VALUE) {
-                    seek_internal(seek);
+                    capture_.reset();
+                    if (!clip_ || !seek_clip(seek)) {
+                        clip_.reset();
+                        open_input();
+                        seek_internal(seek);
+                        begin_capture(seek);
+                    }
+                    cached_ = clip_ != nullptr;
+                    frame   = Frame{};
+                    continue;
+                }
+            }
+
+            const auto variable_speed = speed_ != 1.0;
+
+            if (variable_speed) {
+                if (clip_ || capture_) {
+                    clip_.reset();
+                    capture_.reset();
+                    cached_ = false;
+                    open_input();
+                }
+
+                const auto target = plan_gop(frame);
+                if (!target) {
+                    continue;
+                }
+                if (*target != AV_NOPTS_VALUE) {
+                    seek_internal(av_rescale_q(*target, format_tb_, TIME_BASE_Q));
                     frame = Frame{};
                     continue;
                 }
+                if (video_filter_.eof && audio_filter_.eof) {
+                    // Nothing more to decode in this direction, let plan_gop() seek elsewhere.
+                    gop_seeked_ = false;
+                    frame       = Frame{};
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    continue;
+                }
+            } else if (clip_) {
+                if (!next_clip_frame(frame)) {
+                    // The requested range is not covered by the cached clip, continue by decoding.
+                    const auto time = frame.pts != AV_NOPTS_VALUE ? frame.pts + frame.duration : start_.load();
+                    clip_.reset();
+                    cached_ = false;
+                    open_input();
+                    seek_internal(time);
+                    frame = Frame{};
+                }
+                continue;
             }
 
-            {
+            if (!variable_speed) {
                 // TODO (perf) seek as soon as input is past duration or eof.
 
                 auto start    = start_.load();
@@ -865,9 +968,18 @@ struct AVProducer::Impl
                               av_rescale_q(time, TIME_BASE_Q, format_tb_) >= av_rescale_q(end, TIME_BASE_Q, format_tb_);
 
                 if (buffer_eof_) {
+                    if (capture_) {
+                        end_capture();
+                    }
                     if (loop_ && frame_count_ > 2) {
                         frame = Frame{};
-                        seek_internal(start);
+                        if (clip_ && seek_clip(start)) {
+                            cached_ = true;
+                        } else {
+                            clip_.reset();
+                            seek_internal(start);
+                            begin_capture(start);
+                        }
                     } else {
                         std::this_thread::sleep_for(std::chrono::milliseconds(10));
                     }
@@ -941,19 +1053,18 @@ struct AVProducer::Impl
                 frame.duration   = av_rescale_q(frame.audio->nb_samples, {1, sr}, TIME_BASE_Q);
             }
 
-            frame.frame = core::draw_frame(
-                make_frame(this, *frame_factory_, frame.video, frame.audio, get_color_space(frame.video), scale_mode_));
+            auto const_frame  = core::const_frame(make_frame(
+                this, *frame_factory_, frame.video, frame.audio, get_color_space(frame.video.get()), scale_mode_));
+            frame.frame       = core::draw_frame(const_frame);
             frame.frame_count = frame_count_++;
 
+            if (capture_) {
+                capture(const_frame, frame);
+            }
+
             graph_->set_value("decode-time", decode_timer.elapsed() * format_desc_.fps * 0.5);
 
-            {
-                boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
-                buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_; });
-                if (seek_ == AV_NOPTS_VALUE) {
-                    buffer_.push_back(frame);
-                }
-            }
+            push(frame);
 
             if (format_desc_.field_count != 2 || frame_count_ % 2 == 1) {
                 // Update the frame-time every other frame when interlaced
@@ -963,8 +1074,6 @@ struct AVProducer::Impl
 
             decode_timer.restart();
 
-            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
-
             boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
         }
     }
@@ -972,10 +1081,37 @@ struct AVProducer::Impl
     void update_state()
     {
         graph_->set_text(u16(print()));
+
+        int  buffered  = 0;
+        bool prerolled = false;
+        if (preroll_ > 0) {
+            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+            buffered  = static_cast<int>(buffer_.size());
+            prerolled = playing_ || is_prerolled();
+        }
+
         boost::lock_guard<boost::mutex> lock(state_mutex_);
         state_["file/clip"] = {start().value_or(0) / format_desc_.fps, duration().value_or(0) / format_desc_.fps};
         state_["file/time"] = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
         state_["loop"]      = loop_;
+        state_["speed"]     = speed_.load();
+
+        const auto& io = input_.io_stats();
+        if (io.bytes_read > 0) {
+            state_["file/io/throughput"] = io.throughput.load();
+            state_["file/io/latency"]    = io.latency.load();
+            state_["file/io/stalls"]     = io.stalls.load();
+        }
+
+        if (!cache_key_.empty()) {
+            state_["file/cache"]        = ClipCache::instance().state();
+            state_["file/cache/cached"] = cached_.load();
+        }
+
+        if (preroll_ > 0) {
+            state_["prerolled"] = prerolled;
+            state_["preroll"]   = {buffered, preroll_};
+        }
     }
 
     core::draw_frame prev_frame(const core::video_field field)
@@ -1002,6 +1138,9 @@ struct AVProducer::Impl
     bool is_ready()
     {
         boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        if (preroll_ > 0 && !playing_) {
+            return is_prerolled();
+        }
         return !buffer_.empty() || frame_;
     }
 
@@ -1011,6 +1150,10 @@ struct AVProducer::Impl
 
         boost::lock_guard<boost::mutex> lock(buffer_mutex_);
 
+        if (speed_ != 1.0) {
+            return next_speed_frame();
+        }
+
         if (buffer_.empty() || (frame_flush_ && buffer_.size() < 4)) {
             auto start    = start_.load();
             auto duration = duration_.load();
@@ -1052,6 +1195,13 @@ struct AVProducer::Impl
         frame_flush_    = false;
 
         buffer_.pop_front();
+
+        if (!playing_) {
+            // Preroll is only needed until the first frame is out, fall back to the regular buffer size.
+            playing_         = true;
+            buffer_capacity_ = static_cast<int>(format_desc_.fps) / 4;
+        }
+
         buffer_cond_.notify_all();
 
         graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
@@ -1063,6 +1213,13 @@ struct AVProducer::Impl
     {
         CASPAR_SCOPE_EXIT { update_state(); };
 
+        if (speed_ != 1.0) {
+            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+            position_ = static_cast<double>(time);
+            buffer_cond_.notify_all();
+            return;
+        }
+
         seek_ = av_rescale_q(time, format_tb_, TIME_BASE_Q);
 
         {
@@ -1092,6 +1249,31 @@ struct AVProducer::Impl
 
     bool loop() const { return loop_; }
 
+    void speed(double speed)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+
+        const auto prev = speed_.exchange(speed);
+        if (prev == speed) {
+            return;
+        }
+
+        if (prev == 1.0) {
+            position_ = static_cast<double>(time()) + speed;
+        } else if (speed == 1.0) {
+            // Continue regular playback from the play head.
+            seek_ = av_rescale_q(static_cast<int64_t>(std::floor(position_)), format_tb_, TIME_BASE_Q);
+            gop_cache_.clear();
+        }
+
+        buffer_.clear();
+        buffer_cond_.notify_all();
+    }
+
+    double speed() const { return speed_; }
+
     void start(int64_t start)
     {
         CASPAR_SCOPE_EXIT { update_state(); };
@@ -1130,6 +1312,290 @@ struct AVProducer::Impl
     }
 
   private:
+    void push(const Frame& frame)
+    {
+        {
+            boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
+            buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_ || speed_ != 1.0; });
+            if (seek_ != AV_NOPTS_VALUE) {
+                return;
+            }
+            if (speed_ != 1.0) {
+                auto cached  = frame;
+                cached.video = nullptr;
+                cached.audio = nullptr;
+                gop_cache_[av_rescale_q(frame.pts, TIME_BASE_Q, format_tb_)] = std::move(cached);
+                graph_->set_value("gop-cache",
+                                  static_cast<double>(gop_cache_.size()) / static_cast<double>(gop_cache_capacity_));
+                return;
+            }
+            buffer_.push_back(frame);
+        }
+        graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+    }
+
+    int64_t last_frame_number() const
+    {
+        if (auto duration = this->duration()) {
+            return start().value_or(0) + *duration - 1;
+        }
+        if (auto duration = file_duration()) {
+            return *duration - 1;
+        }
+        return std::numeric_limits<int64_t>::max();
+    }
+
+    // Decides how the decoder should serve the play head in variable speed mode. Returns the frame to seek to,
+    // AV_NOPTS_VALUE to keep decoding forward or nothing when every frame ahead of the play head is cached.
+    std::optional<int64_t> plan_gop(const Frame& frame)
+    {
+        boost::unique_lock<boost::mutex> lock(buffer_mutex_);
+
+        const auto dir       = speed_ < 0.0 ? -1 : 1;
+        const auto lookahead = gop_cache_capacity_ / 2;
+        const auto chunk     = std::max(gop_cache_capacity_ / 4, 1);
+        const auto first     = start().value_or(0);
+        const auto last      = last_frame_number();
+        const auto position  = static_cast<int64_t>(std::floor(position_));
+
+        // Evict the frames furthest away from the play head, preferring those behind it.
+        while (static_cast<int>(gop_cache_.size()) > gop_cache_capacity_) {
+            const auto front = gop_cache_.begin();
+            const auto back  = std::prev(gop_cache_.end());
+            const auto ahead  = dir > 0 ? back->first - position : position - front->first;
+            const auto behind = 2 * (dir > 0 ? position - front->first : back->first - position);
+            if (behind >= ahead) {
+                gop_cache_.erase(dir > 0 ? front : back);
+            } else {
+                gop_cache_.erase(dir > 0 ? back : front);
+            }
+        }
+
+        auto missing = AV_NOPTS_VALUE;
+        for (int64_t n = 0; n <= lookahead; ++n) {
+            const auto index = position + n * dir;
+            if (index < first || index > last) {
+                break;
+            }
+            if (gop_cache_.find(index) == gop_cache_.end()) {
+                missing = index;
+                break;
+            }
+        }
+
+        if (missing == AV_NOPTS_VALUE) {
+            buffer_cond_.wait_for(lock, boost::chrono::milliseconds(10));
+            return {};
+        }
+
+        // Keep decoding if the decoder will reach the missing frame within a chunk, otherwise seek. In reverse a
+        // whole chunk before the missing frame is decoded, since long GOP media can only be decoded forward.
+        const auto next = frame.pts != AV_NOPTS_VALUE
+                              ? av_rescale_q(frame.pts + frame.duration, TIME_BASE_Q, format_tb_)
+                              : AV_NOPTS_VALUE;
+        if (next == AV_NOPTS_VALUE ? gop_seeked_ : next >= missing - chunk && next <= missing) {
+            return AV_NOPTS_VALUE;
+        }
+
+        gop_seeked_ = true;
+        return dir > 0 ? missing : std::max(first, missing - chunk + 1);
+    }
+
+    // Requires buffer_mutex_.
+    core::draw_frame next_speed_frame()
+    {
+        const auto speed = speed_.load();
+        const auto first = start().value_or(0);
+        const auto last  = last_frame_number();
+        const auto index = static_cast<int64_t>(std::floor(position_));
+
+        auto it = gop_cache_.find(index);
+        if (it == gop_cache_.end()) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
+            buffer_cond_.notify_all();
+            return core::draw_frame::still(frame_);
+        }
+
+        auto result = it->second.frame;
+
+        // Blend towards the following frame for smooth slow motion.
+        const auto fraction = position_ - static_cast<double>(index);
+        auto       next     = gop_cache_.find(index + 1);
+        if (fraction > 0.01 && next != gop_cache_.end()) {
+            auto blend                                = next->second.frame;
+            blend.transform().image_transform.opacity = fraction;
+            result = core::draw_frame(std::vector<core::draw_frame>{result, blend});
+        }
+        result.transform().audio_transform.volume = 0.0;
+
+        frame_          = result;
+        frame_time_     = it->second.pts;
+        frame_duration_ = it->second.duration;
+        frame_flush_    = false;
+
+        position_ += speed;
+        if (position_ < static_cast<double>(first) || position_ >= static_cast<double>(last) + 1.0) {
+            if (loop_) {
+                position_ = static_cast<double>(speed > 0.0 ? first : last);
+            } else {
+                position_ = std::clamp(position_, static_cast<double>(first), static_cast<double>(last));
+            }
+        }
+
+        buffer_cond_.notify_all();
+
+        return result;
+    }
+
+    std::string make_cache_key() const
+    {
+        auto& cache = ClipCache::instance();
+        if (!cache.enabled() || path_.find("://") != std::string::npos) {
+            return "";
+        }
+
+        if (duration_ != AV_NOPTS_VALUE && duration_ > cache.max_duration()) {
+            return "";
+        }
+
+        boost::system::error_code ec;
+        const auto                path  = boost::filesystem::path(u16(path_));
+        const auto                size  = boost::filesystem::file_size(path, ec);
+        const auto                mtime = ec ? 0 : boost::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return "";
+        }
+
+        std::ostringstream str;
+        str << path_ << "|" << size << "|" << mtime << "|" << vfilter_ << "|" << afilter_ << "|"
+            << u8(format_desc_.name) << "|" << static_cast<int>(scale_mode_) << "|" << start_.load() << "|"
+            << duration_.load();
+        return str.str();
+    }
+
+    void begin_capture(int64_t time)
+    {
+        capture_.reset();
+
+        const auto start    = start_.load();
+        const auto duration = duration_.load();
+        if (cache_key_.empty() || start != cache_start_ || (time != AV_NOPTS_VALUE && time != start) ||
+            duration == AV_NOPTS_VALUE || duration > ClipCache::instance().max_duration()) {
+            return;
+        }
+        if (cache_duration_ != AV_NOPTS_VALUE && duration != cache_duration_) {
+            return;
+        }
+
+        capture_                 = std::make_shared<CachedClip>();
+        capture_->start          = start != AV_NOPTS_VALUE ? start : 0;
+        capture_->end            = capture_->start;
+        capture_->duration       = duration;
+        capture_->input_duration = input_duration_;
+    }
+
+    void capture(const core::const_frame& const_frame, const Frame& frame)
+    {
+        const auto bytes = cached_frame_bytes(const_frame);
+
+        if (capture_->bytes + bytes > ClipCache::instance().max_bytes()) {
+            capture_.reset();
+            return;
+        }
+
+        capture_->bytes += bytes;
+        capture_->end = std::max(capture_->end, frame.pts + frame.duration);
+        capture_->frames.push_back(CachedFrame{const_frame, frame.pts, frame.duration});
+    }
+
+    void end_capture()
+    {
+        auto clip = std::move(capture_);
+
+        if (clip->frames.empty() || start_ != cache_start_ || duration_ != clip->duration) {
+            return;
+        }
+
+        clip->eof = video_filter_.eof && audio_filter_.eof;
+
+        CASPAR_LOG(debug) << print() << " Cached " << clip->frames.size() << " frames (" << clip->bytes / (1024 * 1024)
+                          << " MiB).";
+
+        ClipCache::instance().insert(cache_key_, clip);
+
+        // Playback has already reached the end, continue from the cache on the next loop.
+        clip_     = std::move(clip);
+        clip_pos_ = clip_->frames.size();
+    }
+
+    // Positions playback of the cached clip at the frame covering time. Returns false if it isn't cached.
+    bool seek_clip(int64_t time)
+    {
+        time = time != AV_NOPTS_VALUE ? time : 0;
+        if (time < clip_->start || time >= clip_->end) {
+            return false;
+        }
+
+        const auto it = std::find_if(clip_->frames.begin(), clip_->frames.end(), [&](const CachedFrame& frame) {
+            return frame.pts + frame.duration > time;
+        });
+
+        clip_pos_    = static_cast<std::size_t>(it - clip_->frames.begin());
+        frame_flush_ = true;
+        frame_count_ = 0;
+        buffer_eof_  = false;
+
+        return true;
+    }
+
+    // Plays the next frame from the cached clip. Returns false if the clip no longer covers the requested range.
+    bool next_clip_frame(Frame& frame)
+    {
+        auto start    = start_.load();
+        auto duration = duration_.load();
+
+        start    = start != AV_NOPTS_VALUE ? start : 0;
+        auto end = duration != AV_NOPTS_VALUE ? start + duration : INT64_MAX;
+
+        if (start < clip_->start || (end > clip_->end && !clip_->eof)) {
+            return false;
+        }
+
+        auto time   = frame.pts != AV_NOPTS_VALUE ? frame.pts + frame.duration : 0;
+        buffer_eof_ = clip_pos_ >= clip_->frames.size() ||
+                      av_rescale_q(time, TIME_BASE_Q, format_tb_) >= av_rescale_q(end, TIME_BASE_Q, format_tb_);
+
+        if (buffer_eof_) {
+            if (loop_ && frame_count_ > 2) {
+                frame = Frame{};
+                return seek_clip(start);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            return true;
+        }
+
+        const auto& cached = clip_->frames[clip_pos_++];
+
+        frame             = Frame{};
+        frame.frame       = core::draw_frame(cached.frame.with_tag(this));
+        frame.pts         = cached.pts;
+        frame.duration    = cached.duration;
+        frame.frame_count = frame_count_++;
+
+        push(frame);
+
+        return true;
+    }
+
+    // Requires buffer_mutex_.
+    bool is_prerolled() const
+    {
+        if (buffer_.empty()) {
+            return false;
+        }
+        return static_cast<int>(buffer_.size()) >= preroll_ || buffer_eof_;
+    }
+
     bool want_packet()
     {
         return std::any_of(decoders_.begin(), decoders_.end(), [](auto& p) { return p.second.want_packet(); });
@@ -1221,8 +1687,10 @@ struct AVProducer::Impl
 
     void reset(int64_t start_time)
     {
-        video_filter_ = Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_);
-        audio_filter_ = Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_);
+        video_filter_ =
+            Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_, frame_factory_, this);
+        audio_filter_ =
+            Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_, frame_factory_, this);
 
         sources_.clear();
         for (auto& p : video_filter_.sources) {
@@ -1267,7 +1735,8 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                        std::optional<int64_t>               duration,
                        std::optional<bool>                  loop,
                        int                                  seekable,
-                       core::frame_geometry::scale_mode     scale_mode)
+                       core::frame_geometry::scale_mode     scale_mode,
+                       int                                  preroll)
     : impl_(new Impl(std::move(frame_factory),
                      std::move(format_desc),
                      std::move(name),
@@ -1279,7 +1748,8 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                      std::move(duration),
                      std::move(loop.value_or(false)),
                      seekable,
-                     scale_mode))
+                     scale_mode,
+                     preroll))
 {
 }
 
@@ -1295,6 +1765,14 @@ AVProducer& AVProducer::seek(int64_t time)
     return *this;
 }
 
+AVProducer& AVProducer::speed(double speed)
+{
+    impl_->speed(speed);
+    return *this;
+}
+
+double AVProducer::speed() const { return impl_->speed(); }
+
 AVProducer& AVProducer::loop(bool loop)
 {
     impl_->loop(loop);
@@ -42,6 +42,7 @@
 #include <common/filesystem.h>
 
 #include <chrono>
+#include <cmath>
 
 #pragma warning(push, 1)
 
@@ -65,6 +66,9 @@ struct ffmpeg_producer : public core::frame_producer
 
     std::shared_ptr<AVProducer> producer_;
 
+    const bool                            preroll_;
+    std::shared_ptr<core::frame_producer> leading_;
+
   public:
     explicit ffmpeg_producer(spl::shared_ptr<core::frame_factory> frame_factory,
                              core::video_format_desc              format_desc,
@@ -77,7 +81,8 @@ struct ffmpeg_producer : public core::frame_producer
                              std::optional<int64_t>               duration,
                              std::optional<bool>                  loop,
                              int                                  seekable,
-                             core::frame_geometry::scale_mode     scale_mode)
+                             core::frame_geometry::scale_mode     scale_mode,
+                             int                                  preroll)
         : filename_(filename)
         , frame_factory_(frame_factory)
         , format_desc_(format_desc)
@@ -92,7 +97,9 @@ struct ffmpeg_producer : public core::frame_producer
                                    duration,
                                    loop,
                                    seekable,
-                                   scale_mode))
+                                   scale_mode,
+                                   preroll))
+        , preroll_(preroll > 0)
     {
     }
 
@@ -113,9 +120,23 @@ struct ffmpeg_producer : public core::frame_producer
 
     core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
     {
+        // A prerolling clip that is played without a transition keeps the previous foreground on air until its
+        // preroll is complete, as a transition would, so that it starts with its frames buffered.
+        if (leading_ && (field == core::video_field::b || !producer_->is_ready())) {
+            return leading_->receive(field, nb_samples);
+        }
+        leading_.reset();
+
         return producer_->next_frame(field);
     }
 
+    void leading_producer(const spl::shared_ptr<core::frame_producer>& producer) override
+    {
+        if (preroll_) {
+            leading_ = producer;
+        }
+    }
+
     std::uint32_t frame_number() const override
     {
         return static_cast<std::uint32_t>(producer_->time() - producer_->start());
@@ -145,6 +166,12 @@ struct ffmpeg_producer : public core::frame_producer
             }
 
             result = std::to_wstring(producer_->loop());
+        } else if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                producer_->speed(boost::lexical_cast<double>(value));
+            }
+
+            result = std::to_wstring(producer_->speed());
         } else if (boost::iequals(cmd, L"in") || boost::iequals(cmd, L"start")) {
             if (!value.empty()) {
                 producer_->start(boost::lexical_cast<int64_t>(value));
@@ -321,6 +348,19 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
 
     auto scale_mode = core::scale_mode_from_string(get_param(L"SCALE_MODE", params, L"STRETCH"));
 
+    // PREROLL [frames] holds the first frames decoded before PLAY, defaults to one second. PLAY, with or without a
+    // transition, keeps the current clip on air until they are.
+    auto preroll = 0;
+    if (contains_param(L"PREROLL", params)) {
+        preroll = static_cast<int>(std::ceil(dependencies.format_desc.fps));
+
+        auto it    = std::find_if(params.begin(), params.end(), param_comparer(L"PREROLL"));
+        int  count = 0;
+        if (++it != params.end() && boost::conversion::try_lexical_convert(*it, count) && count > 0) {
+            preroll = count;
+        }
+    }
+
     boost::ireplace_all(filter_str, L"DEINTERLACE_BOB", L"YADIF=1:-1");
     boost::ireplace_all(filter_str, L"DEINTERLACE_LQ", L"SEPARATEFIELDS");
     boost::ireplace_all(filter_str, L"DEINTERLACE", L"YADIF=0:-1");
@@ -355,7 +395,8 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
                                                  duration,
                                                  loop,
                                                  seekable,
-                                                 scale_mode);
+                                                 scale_mode,
+                                                 preroll);
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
     }
@@ -0,0 +1,320 @@
+#include "../StdAfx.h"
+
+#include "playlist_producer.h"
+
+#include "ffmpeg_producer.h"
+
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/tokenizer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <optional>
+
+namespace caspar { namespace ffmpeg {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Each item is a single parameter, e.g. "'my clip' IN 10 OUT 50".
+std::vector<std::wstring> split_item(const std::wstring& item)
+{
+    using separator_t = boost::escaped_list_separator<wchar_t>;
+    using tokenizer_t = boost::tokenizer<separator_t, std::wstring::const_iterator, std::wstring>;
+
+    std::vector<std::wstring> result;
+    for (auto& token : tokenizer_t(item, separator_t(L'\\', L' ', L'\''))) {
+        if (!token.empty()) {
+            result.push_back(token);
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+class playlist_producer : public core::frame_producer
+{
+    const core::frame_producer_dependencies dependencies_;
+    const std::vector<std::wstring>         items_;
+    const int                               preroll_;
+
+    bool        loop_     = false;
+    bool        skip_     = false;
+    std::size_t index_    = 0;
+    uint32_t    received_ = 0;
+
+    spl::shared_ptr<core::frame_producer>                current_ = core::frame_producer::empty();
+    std::optional<std::size_t>                           next_index_;
+    std::future<spl::shared_ptr<core::frame_producer>>   next_future_;
+    std::optional<spl::shared_ptr<core::frame_producer>> next_;
+
+    // Items that failed to open in a row. Once every item has, the next attempt is delayed.
+    std::size_t                           failures_ = 0;
+    std::optional<std::size_t>            retry_index_;
+    std::chrono::steady_clock::time_point retry_time_;
+
+    core::monitor::state state_;
+
+    executor executor_{L"playlist"};
+
+  public:
+    playlist_producer(const core::frame_producer_dependencies& dependencies,
+                      std::vector<std::wstring>                items,
+                      bool                                     loop,
+                      int                                      preroll)
+        : dependencies_(dependencies.frame_factory,
+                        {},
+                        dependencies.format_repository,
+                        dependencies.format_desc,
+                        dependencies.producer_registry,
+                        dependencies.cg_registry)
+        , items_(std::move(items))
+        , preroll_(preroll)
+        , loop_(loop)
+    {
+        // Items which fail to open are skipped here too, the playlist only fails if none of them can be opened.
+        for (std::size_t index = 0; index < items_.size(); ++index) {
+            try {
+                current_ = open(index);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                current_ = core::frame_producer::empty();
+            }
+
+            if (current_ != core::frame_producer::empty()) {
+                index_ = index;
+                break;
+            }
+        }
+
+        if (current_ == core::frame_producer::empty()) {
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"PLAYLIST none of the items could be opened."));
+        }
+
+        prepare(index_ + 1);
+        update_state();
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        // Only splice on the first field so that every item starts on a whole frame.
+        if (field != core::video_field::b && (skip_ || finished()) && next_ready()) {
+            current_  = std::move(*next_);
+            index_    = *next_index_;
+            received_ = 0;
+            skip_     = false;
+            next_.reset();
+            next_index_.reset();
+
+            prepare(index_ + 1);
+        }
+
+        auto frame = current_->receive(field, nb_samples);
+        if (frame) {
+            received_ += 1;
+        }
+
+        update_state();
+
+        return frame;
+    }
+
+    core::draw_frame last_frame(const core::video_field field) override { return current_->last_frame(field); }
+
+    core::draw_frame first_frame(const core::video_field field) override { return current_->first_frame(field); }
+
+    bool is_ready() override { return current_->is_ready(); }
+
+    void leading_producer(const spl::shared_ptr<core::frame_producer>& producer) override
+    {
+        current_->leading_producer(producer);
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        const auto& cmd = params.at(0);
+
+        if (boost::iequals(cmd, L"next")) {
+            skip_ = true;
+            return make_ready_future(next_index_ ? std::to_wstring(*next_index_) : std::wstring());
+        }
+
+        if (boost::iequals(cmd, L"index")) {
+            return make_ready_future(std::to_wstring(index_));
+        }
+
+        if (boost::iequals(cmd, L"loop")) {
+            if (params.size() > 1) {
+                loop_ = boost::lexical_cast<bool>(params.at(1));
+                if (!next_index_ && !retry_index_) {
+                    prepare(index_ + 1);
+                }
+            }
+            return make_ready_future(std::to_wstring(loop_));
+        }
+
+        return current_->call(params);
+    }
+
+    std::wstring print() const override
+    {
+        return L"playlist[" + std::to_wstring(index_ + 1) + L"/" + std::to_wstring(items_.size()) + L"|" +
+               current_->print() + L"]";
+    }
+
+    std::wstring name() const override { return L"playlist"; }
+
+    core::monitor::state state() const override { return state_; }
+
+  private:
+    // Whether the frame delivered last was the final frame of the current item.
+    bool finished() const
+    {
+        if (received_ == 0) {
+            return false;
+        }
+
+        const auto nb_frames = current_->nb_frames();
+        if (nb_frames == std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+
+        return current_->frame_number() + 1 >= nb_frames;
+    }
+
+    bool next_ready()
+    {
+        if (retry_index_ && std::chrono::steady_clock::now() >= retry_time_) {
+            const auto index = *retry_index_;
+            retry_index_.reset();
+            prepare(index);
+        }
+
+        if (!next_ && next_future_.valid() && next_future_.wait_for(0s) == std::future_status::ready) {
+            try {
+                next_ = next_future_.get();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                next_ = core::frame_producer::empty();
+            }
+
+            if (*next_ == core::frame_producer::empty()) {
+                // Skip items which failed to open.
+                const auto failed = *next_index_;
+                next_.reset();
+                next_index_.reset();
+
+                failures_ += 1;
+                if (failures_ < items_.size()) {
+                    prepare(failed + 1);
+                } else {
+                    const auto rounds = std::min<std::size_t>(failures_ / items_.size(), 10);
+                    CASPAR_LOG(warning) << L"[playlist] No item could be opened, retrying in " << rounds << L"s.";
+                    retry_index_ = failed + 1;
+                    retry_time_  = std::chrono::steady_clock::now() + std::chrono::seconds(rounds);
+                }
+                return false;
+            }
+
+            failures_ = 0;
+        }
+
+        return next_ && (*next_)->is_ready();
+    }
+
+    spl::shared_ptr<core::frame_producer> open(std::size_t index) const
+    {
+        auto params = split_item(items_.at(index));
+        if (params.empty()) {
+            return core::frame_producer::empty();
+        }
+
+        if (preroll_ > 0 && !contains_param(L"PREROLL", params)) {
+            params.push_back(L"PREROLL");
+            params.push_back(std::to_wstring(preroll_));
+        }
+
+        auto producer = create_producer(dependencies_, params);
+        if (producer == core::frame_producer::empty()) {
+            CASPAR_LOG(warning) << L"[playlist] Failed to open " << items_.at(index) << L".";
+        }
+        return producer;
+    }
+
+    // Opens the item at index on executor_ so that it is decoded and prerolled before it is needed.
+    void prepare(std::size_t index)
+    {
+        if (index >= items_.size()) {
+            if (!loop_) {
+                return;
+            }
+            index = 0;
+        }
+
+        next_index_  = index;
+        next_future_ = executor_.begin_invoke([this, index] { return open(index); });
+    }
+
+    void update_state()
+    {
+        const auto next_ready = this->next_ready();
+
+        state_                        = current_->state();
+        state_["playlist/index"]      = {static_cast<int64_t>(index_), static_cast<int64_t>(items_.size())};
+        state_["playlist/loop"]       = loop_;
+        state_["playlist/next"]       = next_index_ ? static_cast<int64_t>(*next_index_) : INT64_C(-1);
+        state_["playlist/next/ready"] = next_ready;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_playlist_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"PLAYLIST")) {
+        return core::frame_producer::empty();
+    }
+
+    // Defaults to one second of preroll for every item but the first.
+    auto preroll = get_param(L"PREROLL", params, static_cast<int>(std::ceil(dependencies.format_desc.fps)));
+    auto loop    = false;
+
+    std::vector<std::wstring> items;
+    for (auto it = params.begin() + 1; it != params.end(); ++it) {
+        if (boost::iequals(*it, L"LOOP")) {
+            loop = true;
+        } else if (boost::iequals(*it, L"PREROLL")) {
+            if (it + 1 != params.end()) {
+                ++it;
+            }
+        } else {
+            items.push_back(*it);
+        }
+    }
+
+    if (items.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"PLAYLIST requires at least one item."));
+    }
+
+    return spl::make_shared<playlist_producer>(dependencies, std::move(items), loop, preroll);
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+// PLAYLIST "<clip> [IN n] [OUT n] [LENGTH n] ..." "<clip> ..." [LOOP] [PREROLL n]
+spl::shared_ptr<core::frame_producer> create_playlist_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params);
+
+}} // namespace caspar::ffmpeg
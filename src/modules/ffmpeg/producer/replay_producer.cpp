@@ -0,0 +1,328 @@
+#include "../StdAfx.h"
+
+#include "replay_producer.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_replay.h"
+#include "../util/av_util.h"
+
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <memory>
+#include <optional>
+
+namespace caspar { namespace ffmpeg {
+
+class replay_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::shared_ptr<ReplayBuffer>        buffer_;
+
+    int64_t                in_;
+    std::optional<int64_t> out_;
+    double                 position_;
+    double                 speed_;
+    bool                   loop_;
+
+    std::shared_ptr<AVCodecContext> dec_;
+    int64_t                         number_ = -1;
+    core::draw_frame                frame_;
+
+    // Compressed frames are decoded here, the frame after the current one ahead of time.
+    std::unique_ptr<executor>     decoder_;
+    int64_t                       prefetch_number_ = -1;
+    std::future<core::draw_frame> prefetch_;
+
+    core::monitor::state state_;
+
+  public:
+    replay_producer(const core::frame_producer_dependencies& dependencies,
+                    std::shared_ptr<ReplayBuffer>            buffer,
+                    std::optional<int64_t>                   in,
+                    std::optional<int64_t>                   out,
+                    double                                   speed,
+                    bool                                     loop)
+        : frame_factory_(dependencies.frame_factory)
+        , buffer_(std::move(buffer))
+        , speed_(speed)
+        , loop_(loop)
+    {
+        const auto range = buffer_->range();
+
+        in_       = in ? resolve(*in) : range.first;
+        out_      = out ? std::optional<int64_t>(resolve(*out)) : std::nullopt;
+        position_ = static_cast<double>(in_);
+
+        if (buffer_->format_desc().fps != dependencies.format_desc.fps ||
+            buffer_->format_desc().field_count != dependencies.format_desc.field_count) {
+            CASPAR_LOG(warning) << print() << L" Replay buffer format " << buffer_->format_desc().name
+                                << L" does not match channel format " << dependencies.format_desc.name << L".";
+        }
+
+        if (const auto codecpar = buffer_->codecpar()) {
+            const auto codec = avcodec_find_decoder(codecpar->codec_id);
+            if (!codec) {
+                FF_RET(AVERROR_DECODER_NOT_FOUND, "avcodec_find_decoder");
+            }
+
+            dec_ = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                                   [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+            if (!dec_) {
+                FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+            }
+            FF(avcodec_parameters_to_context(dec_.get(), codecpar));
+
+            // Slice threads return every frame as soon as its packet is sent.
+            dec_->thread_count = 0;
+            dec_->thread_type  = FF_THREAD_SLICE;
+
+            FF(avcodec_open2(dec_.get(), codec, nullptr));
+
+            decoder_ = std::make_unique<executor>(L"replay_producer");
+        }
+
+        update_state();
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        const auto range = buffer_->range();
+        const auto first = std::max(in_, range.first);
+        const auto last  = out_ ? std::min(*out_, range.second) : range.second;
+
+        if (first > last) {
+            // Nothing recorded yet, or the range has already been overwritten.
+            return frame_ ? core::draw_frame::still(frame_) : core::draw_frame{};
+        }
+
+        auto number = static_cast<int64_t>(std::floor(position_));
+        if (number > last) {
+            number    = loop_ && speed_ > 0.0 ? first : last;
+            position_ = static_cast<double>(number);
+        } else if (number < first) {
+            number    = loop_ && speed_ < 0.0 ? last : first;
+            position_ = static_cast<double>(number);
+        }
+
+        auto audible = false;
+        if (number != number_) {
+            if (auto entry = buffer_->get(number)) {
+                // A compressed frame that is still being decoded is shown on a later tick, if at all.
+                if (auto frame = load(number, std::move(entry))) {
+                    frame_  = std::move(*frame);
+                    number_ = number;
+                    audible = speed_ == 1.0;
+                }
+            }
+        }
+        position_ += speed_;
+
+        prefetch(static_cast<int64_t>(std::floor(position_)));
+
+        update_state();
+
+        // Audio is only played at normal speed and never repeated.
+        return audible ? frame_ : core::draw_frame::still(frame_);
+    }
+
+    bool is_ready() override
+    {
+        const auto range = buffer_->range();
+        return range.first <= range.second;
+    }
+
+    uint32_t frame_number() const override
+    {
+        return static_cast<uint32_t>(std::max<int64_t>(0, number_ - in_));
+    }
+
+    uint32_t nb_frames() const override
+    {
+        return out_ ? static_cast<uint32_t>(std::max<int64_t>(0, *out_ - in_ + 1))
+                    : std::numeric_limits<uint32_t>::max();
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        const auto& cmd = params.at(0);
+        const auto  arg = params.size() > 1 ? std::optional<std::wstring>(params.at(1)) : std::nullopt;
+
+        if (boost::iequals(cmd, L"speed")) {
+            if (arg) {
+                speed_ = boost::lexical_cast<double>(*arg);
+            }
+            return make_ready_future(boost::lexical_cast<std::wstring>(speed_));
+        }
+
+        if (boost::iequals(cmd, L"seek") && arg) {
+            position_ = static_cast<double>(resolve(boost::lexical_cast<int64_t>(*arg)));
+            return make_ready_future(std::to_wstring(static_cast<int64_t>(position_)));
+        }
+
+        if (boost::iequals(cmd, L"in")) {
+            if (arg) {
+                in_ = resolve(boost::lexical_cast<int64_t>(*arg));
+            }
+            return make_ready_future(std::to_wstring(in_));
+        }
+
+        if (boost::iequals(cmd, L"out")) {
+            if (arg) {
+                out_ = resolve(boost::lexical_cast<int64_t>(*arg));
+            }
+            return make_ready_future(out_ ? std::to_wstring(*out_) : std::wstring());
+        }
+
+        if (boost::iequals(cmd, L"loop")) {
+            if (arg) {
+                loop_ = boost::lexical_cast<bool>(*arg);
+            }
+            return make_ready_future(std::to_wstring(loop_));
+        }
+
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid replay command: " + cmd));
+    }
+
+    std::wstring print() const override
+    {
+        return L"replay[" + buffer_->name() + L"|" + std::to_wstring(number_) + L"]";
+    }
+
+    std::wstring name() const override { return L"replay"; }
+
+    core::monitor::state state() const override { return state_; }
+
+  private:
+    // Negative frame numbers count back from the newest frame.
+    int64_t resolve(int64_t number) const { return number < 0 ? buffer_->range().second + 1 + number : number; }
+
+    // Compressed frames are never decoded on the channel thread, nothing is returned until the decoder has the frame.
+    std::optional<core::draw_frame> load(int64_t number, std::shared_ptr<const ReplayFrame> entry)
+    {
+        // Raw frames share the recorded image and audio, only the tag is ours.
+        if (!entry->packet) {
+            return core::draw_frame(entry->frame.with_tag(this));
+        }
+
+        prefetch(number);
+
+        if (number != prefetch_number_ || prefetch_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return {};
+        }
+
+        prefetch_number_ = -1;
+        return prefetch_.get();
+    }
+
+    // Starts decoding the frame that will most likely be shown next, e.g. number + 1 at normal speed. One frame is
+    // decoded at a time, a decoder that falls behind skips frames instead of queueing them.
+    void prefetch(int64_t number)
+    {
+        if (!decoder_ || number == number_ || number == prefetch_number_) {
+            return;
+        }
+
+        if (prefetch_.valid() && prefetch_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+
+        auto entry = buffer_->get(number);
+        if (!entry || !entry->packet) {
+            return;
+        }
+
+        prefetch_number_ = number;
+        prefetch_        = decoder_->begin_invoke([this, entry] { return decode(*entry); });
+    }
+
+    core::draw_frame decode(const ReplayFrame& entry)
+    {
+        FF(avcodec_send_packet(dec_.get(), entry.packet.get()));
+
+        auto video = alloc_frame();
+        FF(avcodec_receive_frame(dec_.get(), video.get()));
+
+        auto frame         = make_frame(this, *frame_factory_, video, nullptr, get_color_space(video.get()));
+        frame.audio_data() = std::vector<int32_t>(entry.audio);
+
+        return core::draw_frame(std::move(frame));
+    }
+
+    void update_state()
+    {
+        const auto range = buffer_->range();
+
+        state_                 = core::monitor::state();
+        state_["replay"]       = buffer_->state();
+        state_["replay/name"]  = buffer_->name();
+        state_["replay/frame"] = number_;
+        state_["replay/in"]    = in_;
+        state_["replay/out"]   = out_ ? *out_ : range.second;
+        state_["replay/speed"] = speed_;
+        state_["replay/loop"]  = loop_;
+        state_["replay/delay"] = number_ >= 0 ? range.second - number_ : INT64_C(0);
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_replay_producer(const core::frame_producer_dependencies& dependencies,
+                                                             const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"REPLAY")) {
+        return core::frame_producer::empty();
+    }
+
+    auto buffer = ReplayBuffer::find(params.at(1));
+    if (!buffer) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No replay buffer named " + params.at(1) + L"."));
+    }
+
+    std::optional<int64_t> in;
+    if (contains_param(L"IN", params)) {
+        in = get_param(L"IN", params, INT64_C(0));
+    }
+
+    std::optional<int64_t> out;
+    if (contains_param(L"OUT", params)) {
+        out = get_param(L"OUT", params, INT64_C(0));
+    }
+
+    return spl::make_shared<replay_producer>(dependencies,
+                                             std::move(buffer),
+                                             in,
+                                             out,
+                                             get_param(L"SPEED", params, 1.0),
+                                             contains_param(L"LOOP", params));
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+// REPLAY <name> [IN n] [OUT n] [SPEED x] [LOOP]
+//
+// Plays back from the replay buffer with the given name. Frame numbers are those of the buffer, negative numbers
+// count back from the newest frame. Without OUT, playback follows the live edge of the buffer.
+spl::shared_ptr<core::frame_producer> create_replay_producer(const core::frame_producer_dependencies& dependencies,
+                                                             const std::vector<std::wstring>&         params);
+
+}} // namespace caspar::ffmpeg
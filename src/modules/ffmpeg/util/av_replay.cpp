@@ -0,0 +1,95 @@
+#include "av_replay.h"
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+std::mutex                                          registry_mutex;
+std::map<std::wstring, std::weak_ptr<ReplayBuffer>> registry;
+
+} // namespace
+
+ReplayBuffer::ReplayBuffer(std::wstring                       name,
+                           core::video_format_desc            format_desc,
+                           std::size_t                        capacity,
+                           std::shared_ptr<AVCodecParameters> codecpar)
+    : name_(std::move(name))
+    , format_desc_(std::move(format_desc))
+    , capacity_(std::max<std::size_t>(capacity, 1))
+    , codecpar_(std::move(codecpar))
+{
+}
+
+void ReplayBuffer::add(const std::shared_ptr<ReplayBuffer>& buffer)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    for (auto it = registry.begin(); it != registry.end();) {
+        it = it->second.expired() ? registry.erase(it) : std::next(it);
+    }
+    registry[boost::to_upper_copy(buffer->name())] = buffer;
+}
+
+std::shared_ptr<ReplayBuffer> ReplayBuffer::find(const std::wstring& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    auto it = registry.find(boost::to_upper_copy(name));
+    return it != registry.end() ? it->second.lock() : nullptr;
+}
+
+void ReplayBuffer::push(std::shared_ptr<const ReplayFrame> frame)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bytes_ += frame->bytes;
+    frames_.push_back(std::move(frame));
+
+    while (frames_.size() > capacity_) {
+        bytes_ -= frames_.front()->bytes;
+        frames_.pop_front();
+    }
+}
+
+std::shared_ptr<const ReplayFrame> ReplayBuffer::get(int64_t number) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (frames_.empty() || number < frames_.front()->number || number > frames_.back()->number) {
+        return nullptr;
+    }
+
+    // Numbers are consecutive, so the frame can be indexed directly.
+    return frames_.at(static_cast<std::size_t>(number - frames_.front()->number));
+}
+
+std::pair<int64_t, int64_t> ReplayBuffer::range() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (frames_.empty()) {
+        return {0, -1};
+    }
+    return {frames_.front()->number, frames_.back()->number};
+}
+
+core::monitor::state ReplayBuffer::state() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    core::monitor::state state;
+    state["frames"] = {static_cast<int64_t>(frames_.size()), static_cast<int64_t>(capacity_)};
+    state["size"]   = static_cast<int64_t>(bytes_);
+    if (!frames_.empty()) {
+        state["range"] = {frames_.front()->number, frames_.back()->number};
+    }
+    return state;
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <core/frame/frame.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct AVCodecParameters;
+struct AVPacket;
+
+namespace caspar { namespace ffmpeg {
+
+// A single frame, or field for interlaced channels, of a replay buffer. Holds either the raw channel output
+// in frame, or the image compressed by an intra-only codec in packet together with the audio.
+struct ReplayFrame
+{
+    int64_t                   number = 0;
+    core::const_frame         frame;
+    std::shared_ptr<AVPacket> packet;
+    std::vector<int32_t>      audio;
+    std::size_t               bytes = 0;
+};
+
+// Ring of the most recent frames of a channel, written by a replay consumer and read by any number of replay
+// producers. Buffers are looked up by name and stay alive for as long as a producer plays from them.
+class ReplayBuffer
+{
+  public:
+    ReplayBuffer(std::wstring                       name,
+                 core::video_format_desc            format_desc,
+                 std::size_t                        capacity,
+                 std::shared_ptr<AVCodecParameters> codecpar);
+
+    ReplayBuffer(const ReplayBuffer&)            = delete;
+    ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+
+    // Makes the buffer available by name, replacing any previous buffer with the same name.
+    static void                          add(const std::shared_ptr<ReplayBuffer>& buffer);
+    static std::shared_ptr<ReplayBuffer> find(const std::wstring& name);
+
+    void                               push(std::shared_ptr<const ReplayFrame> frame);
+    std::shared_ptr<const ReplayFrame> get(int64_t number) const;
+
+    // Numbers of the oldest and newest frame held. The range is empty, first > last, until the first push.
+    std::pair<int64_t, int64_t> range() const;
+
+    const std::wstring&            name() const { return name_; }
+    const core::video_format_desc& format_desc() const { return format_desc_; }
+
+    // The codec of ReplayFrame::packet, or nullptr if frames are held raw.
+    const AVCodecParameters* codecpar() const { return codecpar_.get(); }
+
+    core::monitor::state state() const;
+
+  private:
+    const std::wstring                       name_;
+    const core::video_format_desc            format_desc_;
+    const std::size_t                        capacity_;
+    const std::shared_ptr<AVCodecParameters> codecpar_;
+
+    mutable std::mutex                             mutex_;
+    std::deque<std::shared_ptr<const ReplayFrame>> frames_;
+    std::size_t                                    bytes_ = 0;
+};
+
+}} // namespace caspar::ffmpeg
@@ -2,6 +2,7 @@
 #include "av_assert.h"
 
 #include <common/bit_depth.h>
+#include <common/log.h>
 
 #if defined(_MSC_VER)
 #pragma warning(push)
@@ -13,6 +14,7 @@ extern "C" {
 #include <libavutil/channel_layout.h>
 #include <libavutil/frame.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 }
 #if defined(_MSC_VER)
@@ -23,7 +25,11 @@ extern "C" {
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
 
+#include <cstdint>
+#include <mutex>
+#include <optional>
 #include <tuple>
+#include <unordered_map>
 
 namespace caspar { namespace ffmpeg {
 
@@ -43,6 +49,243 @@ std::shared_ptr<AVPacket> alloc_packet()
     return packet;
 }
 
+namespace {
+
+// Upload buffers handed to a decoder by get_buffer2. The frame is taken by make_frame, while the plane views
+// keep the memory alive for as long as ffmpeg still references it.
+struct FrameBuffer
+{
+    std::mutex                             mutex;
+    std::optional<core::mutable_frame>     frame;
+    std::vector<array<const std::uint8_t>> planes;
+
+    ~FrameBuffer();
+};
+
+std::mutex& frame_buffers_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::unordered_map<const std::uint8_t*, std::weak_ptr<FrameBuffer>>& frame_buffers()
+{
+    static std::unordered_map<const std::uint8_t*, std::weak_ptr<FrameBuffer>> buffers;
+    return buffers;
+}
+
+FrameBuffer::~FrameBuffer()
+{
+    if (!planes.empty()) {
+        std::lock_guard<std::mutex> lock(frame_buffers_mutex());
+        frame_buffers().erase(planes[0].data());
+    }
+}
+
+bool equal_layout(const core::pixel_format_desc& lhs, const core::pixel_format_desc& rhs)
+{
+    if (lhs.format != rhs.format || lhs.color_space != rhs.color_space ||
+        lhs.is_straight_alpha != rhs.is_straight_alpha || lhs.planes.size() != rhs.planes.size()) {
+        return false;
+    }
+    for (std::size_t n = 0; n < lhs.planes.size(); ++n) {
+        const auto& a = lhs.planes[n];
+        const auto& b = rhs.planes[n];
+        if (a.linesize != b.linesize || a.width != b.width || a.height != b.height || a.stride != b.stride ||
+            a.depth != b.depth) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<core::mutable_frame> take_frame_buffer(const AVFrame& video, const core::pixel_format_desc& desc)
+{
+    std::shared_ptr<FrameBuffer> buffer;
+    {
+        std::lock_guard<std::mutex> lock(frame_buffers_mutex());
+        auto                        it = frame_buffers().find(video.data[0]);
+        if (it == frame_buffers().end()) {
+            return {};
+        }
+        buffer = it->second.lock();
+    }
+
+    if (!buffer) {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+
+    // Frames duplicated by the filter graph, or converted in place, are copied as usual.
+    if (!buffer->frame || !equal_layout(buffer->frame->pixel_format_desc(), desc)) {
+        return {};
+    }
+    for (std::size_t n = 0; n < buffer->planes.size(); ++n) {
+        if (video.data[n] != buffer->planes[n].data() || video.linesize[n] != desc.planes[n].linesize) {
+            return {};
+        }
+    }
+
+    std::optional<core::mutable_frame> frame;
+    frame.swap(buffer->frame);
+    return frame;
+}
+
+// Frame threaded decoders call get_buffer2 from several threads at once, so frames are created one at a time.
+struct DirectRendering
+{
+    std::shared_ptr<core::frame_factory> frame_factory;
+    const void*                          tag;
+    std::mutex                           mutex;
+};
+
+bool alloc_frame_buffer(DirectRendering& state, AVCodecContext* ctx, AVFrame* frame)
+{
+    const auto pix_fmt  = static_cast<AVPixelFormat>(frame->format);
+    const auto fmt_desc = av_pix_fmt_desc_get(pix_fmt);
+    if (!fmt_desc || (fmt_desc->flags & AV_PIX_FMT_FLAG_HWACCEL) || (fmt_desc->flags & AV_PIX_FMT_FLAG_PAL)) {
+        return false;
+    }
+
+    std::vector<int> data_map;
+    auto             desc = pixel_format_desc(pix_fmt, frame->width, frame->height, data_map, get_color_space(frame));
+    if (desc.format == core::pixel_format::invalid || !data_map.empty()) {
+        return false;
+    }
+
+    // Upload buffers are tightly packed, so only layouts where the decoder's padded width adds no padding
+    // can be decoded into them directly.
+    int width  = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+
+    int linesizes[4];
+    if (av_image_fill_linesizes(linesizes, pix_fmt, width) < 0) {
+        return false;
+    }
+
+    const int padding = 16 + 64 - 1;
+    for (std::size_t n = 0; n < desc.planes.size(); ++n) {
+        auto& plane = desc.planes[n];
+        if (linesizes[n] != plane.linesize || linesizes[n] % linesize_align[n] != 0) {
+            return false;
+        }
+
+        // The decoder may write up to the aligned height, which the uploaded texture never reads.
+        const auto is_chroma = (n == 1 || n == 2) && !(fmt_desc->flags & AV_PIX_FMT_FLAG_RGB);
+        const auto rows      = is_chroma ? AV_CEIL_RSHIFT(height, fmt_desc->log2_chroma_h) : height;
+        plane.size           = std::max(plane.size, linesizes[n] * rows + padding);
+    }
+
+    auto mframe = [&] {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.frame_factory->create_frame(state.tag, desc);
+    }();
+
+    auto buffer = std::make_shared<FrameBuffer>();
+    for (std::size_t n = 0; n < desc.planes.size(); ++n) {
+        const auto& data = mframe.image_data(n);
+        if (data.size() < static_cast<std::size_t>(desc.planes[n].size) ||
+            reinterpret_cast<std::uintptr_t>(data.data()) % 64 != 0) {
+            return false;
+        }
+        buffer->planes.emplace_back(data);
+    }
+    buffer->frame = std::move(mframe);
+
+    for (std::size_t n = 0; n < buffer->planes.size(); ++n) {
+        auto opaque = new std::shared_ptr<FrameBuffer>(buffer);
+        auto data   = const_cast<std::uint8_t*>(buffer->planes[n].data());
+
+        frame->buf[n] = av_buffer_create(
+            data,
+            static_cast<int>(buffer->planes[n].size()),
+            [](void* opaque, std::uint8_t*) { delete static_cast<std::shared_ptr<FrameBuffer>*>(opaque); },
+            opaque,
+            0);
+
+        if (!frame->buf[n]) {
+            delete opaque;
+            for (std::size_t k = 0; k < n; ++k) {
+                av_buffer_unref(&frame->buf[k]);
+                frame->data[k] = nullptr;
+            }
+            return false;
+        }
+
+        frame->data[n]     = data;
+        frame->linesize[n] = linesizes[n];
+    }
+    frame->extended_data = frame->data;
+
+    {
+        std::lock_guard<std::mutex> lock(frame_buffers_mutex());
+        frame_buffers()[buffer->planes[0].data()] = buffer;
+    }
+
+    return true;
+}
+
+int get_buffer(AVCodecContext* ctx, AVFrame* frame, int flags)
+{
+    auto state = static_cast<DirectRendering*>(ctx->opaque);
+
+    try {
+        if (state && alloc_frame_buffer(*state, ctx, frame)) {
+            return 0;
+        }
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+}
+
+} // namespace
+
+core::color_space get_color_space(const AVFrame* video)
+{
+    auto result = core::color_space::bt709;
+    if (video) {
+        switch (video->colorspace) {
+            case AVColorSpace::AVCOL_SPC_BT2020_NCL:
+                result = core::color_space::bt2020;
+                break;
+            case AVColorSpace::AVCOL_SPC_BT470BG:
+            case AVColorSpace::AVCOL_SPC_SMPTE170M:
+            case AVColorSpace::AVCOL_SPC_SMPTE240M:
+                result = core::color_space::bt601;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return result;
+}
+
+std::shared_ptr<void> set_direct_rendering(AVCodecContext*                      ctx,
+                                           std::shared_ptr<core::frame_factory> frame_factory,
+                                           const void*                          tag)
+{
+    // Inter codecs keep reference frames and may update frames in place after output, so only intra-only
+    // codecs are allowed to share memory with frames that have been handed to the mixer.
+    if (!frame_factory || ctx->codec_type != AVMEDIA_TYPE_VIDEO || !ctx->codec ||
+        !(ctx->codec->capabilities & AV_CODEC_CAP_DR1) || !ctx->codec_descriptor ||
+        !(ctx->codec_descriptor->props & AV_CODEC_PROP_INTRA_ONLY)) {
+        return nullptr;
+    }
+
+    auto state           = std::make_shared<DirectRendering>();
+    state->frame_factory = std::move(frame_factory);
+    state->tag           = tag;
+    ctx->opaque          = state.get();
+    ctx->get_buffer2     = get_buffer;
+    return state;
+}
+
 core::mutable_frame make_frame(void*                            tag,
                                core::frame_factory&             frame_factory,
                                std::shared_ptr<AVFrame>         video,
@@ -59,14 +302,16 @@ core::mutable_frame make_frame(void*                            tag,
               : core::pixel_format_desc(core::pixel_format::invalid);
     pix_desc.is_straight_alpha = is_straight_alpha;
 
-    auto frame = frame_factory.create_frame(tag, pix_desc);
+    // Decoded straight into upload buffers, see set_direct_rendering.
+    auto direct = video && data_map.empty() ? take_frame_buffer(*video, pix_desc) : std::nullopt;
+    auto frame  = direct ? std::move(*direct) : frame_factory.create_frame(tag, pix_desc);
     if (scale_mode != core::frame_geometry::scale_mode::stretch) {
         frame.geometry() = core::frame_geometry::get_default(scale_mode);
     }
 
     tbb::parallel_invoke(
         [&]() {
-            if (video) {
+            if (video && !direct) {
                 for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
                     auto frame_plan_index = data_map.empty() ? n : data_map.at(n);
 
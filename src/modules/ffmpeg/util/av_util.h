@@ -27,6 +27,8 @@ namespace caspar { namespace ffmpeg {
 std::shared_ptr<AVFrame>  alloc_frame();
 std::shared_ptr<AVPacket> alloc_packet();
 
+core::color_space get_color_space(const AVFrame* video);
+
 core::pixel_format_desc pixel_format_desc(AVPixelFormat     pix_fmt,
                                           int               width,
                                           int               height,
@@ -40,6 +42,17 @@ core::mutable_frame     make_frame(void*                    tag,
                                    core::frame_geometry::scale_mode     = core::frame_geometry::scale_mode::stretch,
                                    bool is_straight_alpha               = false);
 
+// Lets an intra-only video decoder write its frames straight into upload buffers from frame_factory, which
+// make_frame then hands over without copying. Returns the state which must outlive the codec context, or
+// nullptr when the decoder has to use the default allocator.
+//
+// An upload buffer stays pinned for as long as the decoder, or a filter, references the AVFrame decoded into
+// it, even after make_frame has handed its memory to the mixer. A frame threaded decoder holds up to one
+// frame per thread this way.
+std::shared_ptr<void> set_direct_rendering(AVCodecContext*                      ctx,
+                                           std::shared_ptr<core::frame_factory> frame_factory,
+                                           const void*                          tag);
+
 std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 
@@ -21,146 +21,104 @@
  */
 
 #include "image_consumer.h"
+#include "snapshot_service.h"
 
-#include <common/array.h>
-#include <common/env.h>
+#include <common/base64.h>
 #include <common/except.h>
 #include <common/future.h>
+#include <common/log.h>
+#include <common/utf.h>
 
 #include <core/consumer/channel_info.h>
+#include <core/consumer/output.h>
 #include <core/frame/frame.h>
+#include <core/video_channel.h>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
 
-#include <fstream>
+#include <atomic>
+#include <future>
 #include <utility>
 #include <vector>
 
-#include <ffmpeg/util/av_assert.h>
-#include <ffmpeg/util/av_util.h>
-
-#include "../util/image_algorithms.h"
-#include "../util/image_converter.h"
-#include "../util/image_view.h"
-
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4244)
-#endif
-extern "C" {
-#define __STDC_CONSTANT_MACROS
-#define __STDC_LIMIT_MACROS
-#include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
-#include <libavutil/imgutils.h>
-#include <libavutil/pixfmt.h>
-}
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
-
-namespace caspar::image {
+namespace caspar { namespace image {
 
 struct image_consumer : public core::frame_consumer
 {
-    const std::wstring filename_;
-
-    explicit image_consumer(std::wstring filename)
-        : filename_(std::move(filename))
+    const SnapshotOptions              options_;
+    const SnapshotService::callback_t callback_;
+    const int                          index_;
+    int                                channel_index_ = -1;
+    bool                               sent_          = false;
+
+    explicit image_consumer(SnapshotOptions options, SnapshotService::callback_t callback = nullptr)
+        : options_(std::move(options))
+        , callback_(std::move(callback))
+        , index_(next_index())
     {
     }
 
-    void initialize(const core::video_format_desc& /*format_desc*/, const core::channel_info& channel_info, int port_index) override {}
+    void initialize(const core::video_format_desc& /*format_desc*/, const core::channel_info& channel_info, int port_index) override
+    {
+        channel_index_ = channel_info.index;
+    }
 
     std::future<bool> send(core::video_field field, core::const_frame frame) override
     {
-        auto filename = filename_;
-
-        std::thread async([frame, filename] {
-            try {
-                std::string filename2;
-
-                if (frame.pixel_format_desc().format != core::pixel_format::bgra)
-                    CASPAR_THROW_EXCEPTION(caspar_exception()
-                                           << msg_info("image_consumer received frame with wrong format"));
-
-                if (filename.empty())
-                    filename2 =
-                        u8(env::media_folder() +
-                           boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) + L".png");
-                else
-                    filename2 = u8(env::media_folder() + filename + L".png");
-
-                std::fstream file_stream(filename2, std::fstream::out | std::fstream::trunc | std::fstream::binary);
-                if (!file_stream)
-                    FF_RET(AVERROR(EINVAL), "fstream_open");
-
-                const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
-                if (!codec)
-                    FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
-
-                auto ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
-                                                           [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
-
-                ctx->width     = static_cast<int>(frame.width());
-                ctx->height    = static_cast<int>(frame.height());
-                ctx->pix_fmt   = AV_PIX_FMT_RGBA;
-                ctx->time_base = {1, 1};
-                ctx->framerate = {0, 1};
-
-                FF(avcodec_open2(ctx.get(), codec, nullptr));
-
-                auto av_frame         = ffmpeg::alloc_frame();
-                av_frame->width       = static_cast<int>(frame.width());
-                av_frame->height      = static_cast<int>(frame.height());
-                av_frame->format      = AV_PIX_FMT_BGRA;
-                av_frame->pts         = 0;
-                av_frame->linesize[0] = static_cast<int>(frame.width()) * 4;
-                av_frame->data[0]     = const_cast<uint8_t*>(frame.image_data(0).data());
-
-                // The png encoder requires RGB ordering, the mixer producers BGR.
-                auto av_frame2 = convert_image_frame(av_frame, AV_PIX_FMT_RGBA);
-                // Also straighten the alpha, as png is always straight, and the mixer produces premultiplied
-                image_view<bgra_pixel> original_view(av_frame2->data[0], av_frame2->width, av_frame2->height);
-                unmultiply(original_view);
-
-                FF(avcodec_send_frame(ctx.get(), av_frame2.get()));
-                FF(avcodec_send_frame(ctx.get(), nullptr));
-
-                auto pkt = std::shared_ptr<AVPacket>(av_packet_alloc(), [](AVPacket* ptr) { av_packet_free(&ptr); });
-                int  ret = 0;
-                while (ret >= 0) {
-                    ret = avcodec_receive_packet(ctx.get(), pkt.get());
-                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                        break;
-                    FF_RET(ret, "avcodec_receive_packet");
-
-                    file_stream.write(reinterpret_cast<const char*>(pkt->data), pkt->size);
-                    av_packet_unref(pkt.get());
-                }
-
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION()
-            }
-        });
-        async.detach();
+        // Only the first frame or field is captured, the consumer is removed afterwards.
+        if (sent_)
+            return make_ready_future(false);
+        sent_ = true;
+
+        auto callback = callback_;
+        auto print    = this->print();
+
+        try {
+            SnapshotService::instance().submit(
+                channel_index_, std::move(frame), options_, [callback, print](std::exception_ptr e, Snapshot snapshot) {
+                    if (callback) {
+                        callback(std::move(e), std::move(snapshot));
+                    } else if (e) {
+                        try {
+                            std::rethrow_exception(e);
+                        } catch (...) {
+                            CASPAR_LOG_CURRENT_EXCEPTION();
+                        }
+                    } else {
+                        CASPAR_LOG(info) << print << L" Saved " << snapshot.path;
+                    }
+                });
+        } catch (...) {
+            if (!callback_)
+                throw;
+            callback_(std::current_exception(), Snapshot{});
+        }
 
         return make_ready_future(false);
     }
 
-    std::wstring print() const override { return L"image[]"; }
+    std::wstring print() const override { return L"image[" + options_.filename + L"]"; }
 
     std::wstring name() const override { return L"image"; }
 
-    int index() const override { return 100; }
+    // Every snapshot gets its own index, so that concurrent requests do not replace each other.
+    int index() const override { return index_; }
 
     core::monitor::state state() const override
     {
         core::monitor::state state;
-        state["image/filename"] = u8(filename_);
+        state["image/filename"] = u8(options_.filename);
+        state["image/format"]   = options_.format;
+        state["image/snapshots"] = SnapshotService::instance().state();
         return state;
     }
+
+  private:
+    static int next_index()
+    {
+        static std::atomic<int> counter{0};
+        return 200000 + counter++ % 100000;
+    }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&     params,
@@ -174,12 +132,37 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     if (channel_info.depth != common::bit_depth::bit8)
         CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Image consumer only supports 8-bit color depth."));
 
-    std::wstring filename;
+    auto options = SnapshotOptions::parse(std::vector<std::wstring>(params.begin() + 1, params.end()));
+    if (options.reply)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("RETURN is only supported by SNAPSHOT."));
+
+    return spl::make_shared<image_consumer>(std::move(options));
+}
 
-    if (params.size() > 1)
-        filename = params.at(1);
+std::future<std::wstring> snapshot_command(protocol::amcp::command_context& ctx)
+{
+    if (ctx.channel.raw_channel->get_consumer_channel_info().depth != common::bit_depth::bit8)
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Image consumer only supports 8-bit color depth."));
+
+    auto options = SnapshotOptions::parse(ctx.parameters);
+    auto promise = std::make_shared<std::promise<std::wstring>>();
+    auto future  = promise->get_future();
+
+    ctx.channel.raw_channel->output().add(
+        spl::make_shared<image_consumer>(options, [promise](std::exception_ptr e, Snapshot snapshot) {
+            if (e) {
+                promise->set_exception(e);
+            } else if (!snapshot.data.empty()) {
+                promise->set_value(L"201 SNAPSHOT OK\r\n" +
+                                   u16(to_base64(reinterpret_cast<const char*>(snapshot.data.data()),
+                                                 snapshot.data.size())) +
+                                   L"\r\n");
+            } else {
+                promise->set_value(L"201 SNAPSHOT OK\r\n" + snapshot.path + L"\r\n");
+            }
+        }));
 
-    return spl::make_shared<image_consumer>(filename);
+    return future;
 }
 
-} // namespace caspar::image
+}} // namespace caspar::image
@@ -26,7 +26,9 @@
 
 #include <boost/property_tree/ptree_fwd.hpp>
 #include <core/consumer/frame_consumer.h>
+#include <protocol/amcp/amcp_command_context.h>
 
+#include <future>
 #include <string>
 #include <vector>
 
@@ -37,4 +39,9 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
                                                       const std::vector<spl::shared_ptr<core::video_channel>>& channels,
                                                       const core::channel_info& channel_info);
 
+// SNAPSHOT [filename] [FORMAT png|jpg|webp|raw] [WIDTH w] [HEIGHT h] [QUALITY q] [RING n] [RETURN]
+//
+// Replies with the path of the written image, or with the base64 encoded image when RETURN is given.
+std::future<std::wstring> snapshot_command(protocol::amcp::command_context& ctx);
+
 }} // namespace caspar::image
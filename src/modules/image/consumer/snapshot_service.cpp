@@ -0,0 +1,350 @@
+#include "snapshot_service.h"
+
+#include "../util/image_algorithms.h"
+#include "../util/image_converter.h"
+#include "../util/image_view.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <ffmpeg/util/av_assert.h>
+#include <ffmpeg/util/av_util.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace image {
+
+namespace {
+
+const std::vector<std::wstring> KEYWORDS = {L"FORMAT", L"WIDTH", L"HEIGHT", L"QUALITY", L"RING", L"RETURN"};
+
+// Ring counters kept at most, the least recently used one is dropped and its ring starts over at 0.
+const std::size_t MAX_RINGS = 256;
+
+std::wstring extension(const std::string& format)
+{
+    if (format == "jpg")
+        return L".jpg";
+    if (format == "webp")
+        return L".webp";
+    if (format == "raw")
+        return L".raw";
+    return L".png";
+}
+
+std::shared_ptr<AVFrame> scale_frame(const std::shared_ptr<AVFrame>& src, int width, int height)
+{
+    if (src->width == width && src->height == height)
+        return src;
+
+    auto sws = std::shared_ptr<SwsContext>(sws_getContext(src->width,
+                                                          src->height,
+                                                          static_cast<AVPixelFormat>(src->format),
+                                                          width,
+                                                          height,
+                                                          static_cast<AVPixelFormat>(src->format),
+                                                          SWS_AREA,
+                                                          nullptr,
+                                                          nullptr,
+                                                          nullptr),
+                                           [](SwsContext* ptr) { sws_freeContext(ptr); });
+    if (!sws) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to create SwsContext"));
+    }
+
+    auto dst    = ffmpeg::alloc_frame();
+    dst->width  = width;
+    dst->height = height;
+    dst->format = src->format;
+    FF(av_frame_get_buffer(dst.get(), 0));
+
+    sws_scale(sws.get(), src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+
+    return dst;
+}
+
+// The mixer produces premultiplied alpha, image formats with alpha are straight.
+void unmultiply_frame(const std::shared_ptr<AVFrame>& frame)
+{
+    for (int y = 0; y < frame->height; ++y) {
+        auto                   data = frame->data[0] + static_cast<std::ptrdiff_t>(y) * frame->linesize[0];
+        image_view<bgra_pixel> row(data, frame->width, 1);
+        unmultiply(row);
+    }
+}
+
+} // namespace
+
+SnapshotOptions SnapshotOptions::parse(const std::vector<std::wstring>& params)
+{
+    SnapshotOptions options;
+
+    if (!params.empty() && std::none_of(KEYWORDS.begin(), KEYWORDS.end(), [&](const std::wstring& keyword) {
+            return boost::iequals(params.at(0), keyword);
+        }))
+        options.filename = params.at(0);
+
+    options.format  = boost::to_lower_copy(u8(get_param(L"FORMAT", params, L"png")));
+    options.width   = get_param(L"WIDTH", params, 0);
+    options.height  = get_param(L"HEIGHT", params, 0);
+    options.quality = get_param(L"QUALITY", params, 0);
+    options.ring    = get_param(L"RING", params, 0);
+    options.reply   = contains_param(L"RETURN", params);
+
+    if (options.format == "jpeg")
+        options.format = "jpg";
+
+    if (options.format != "png" && options.format != "jpg" && options.format != "webp" && options.format != "raw")
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Unsupported snapshot format " + options.format));
+
+    if (options.width < 0 || options.height < 0 || options.quality < 0 || options.quality > 100 || options.ring < 0)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid snapshot options"));
+
+    return options;
+}
+
+SnapshotService& SnapshotService::instance()
+{
+    static SnapshotService service;
+    return service;
+}
+
+SnapshotService::SnapshotService()
+    : max_pending_(std::max(env::properties().get(L"configuration.image.consumer.queue-size", 8), 1))
+    , min_interval_(env::properties().get(L"configuration.image.consumer.min-interval", 0.0))
+{
+    const auto threads = std::max(env::properties().get(L"configuration.image.consumer.threads", 2), 1);
+    for (auto n = 0; n < threads; ++n) {
+        workers_.push_back(std::make_unique<executor>(L"image-snapshot-" + std::to_wstring(n)));
+    }
+}
+
+void SnapshotService::submit(int channel_index, core::const_frame frame, SnapshotOptions options, callback_t callback)
+{
+    if (frame.pixel_format_desc().format != core::pixel_format::bgra)
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info("image_consumer received frame with wrong format"));
+
+    std::wstring path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto now =
+            std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+        if (min_interval_ > 0.0) {
+            auto it = last_.find(channel_index);
+            if (it != last_.end() && now - it->second < min_interval_) {
+                rejected_ += 1;
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info("Snapshot requested too often"));
+            }
+        }
+
+        if (pending_ >= max_pending_) {
+            rejected_ += 1;
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info("Too many snapshots pending"));
+        }
+
+        last_[channel_index] = now;
+        pending_ += 1;
+
+        if (!options.reply) {
+            if (options.filename.empty()) {
+                path = env::media_folder() +
+                       boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time());
+            } else if (options.ring > 0) {
+                auto it = rings_.find(options.filename);
+                if (it == rings_.end()) {
+                    if (rings_.size() >= MAX_RINGS) {
+                        rings_.erase(std::min_element(rings_.begin(), rings_.end(), [](auto& lhs, auto& rhs) {
+                            return lhs.second.used < rhs.second.used;
+                        }));
+                    }
+                    it = rings_.emplace(options.filename, Ring{}).first;
+                }
+                it->second.used = now;
+
+                const auto number = it->second.number++ % options.ring;
+                path              = env::media_folder() + options.filename + L"_" + std::to_wstring(number);
+            } else {
+                path = env::media_folder() + options.filename;
+            }
+            path += extension(options.format);
+        }
+    }
+
+    auto worker = std::min_element(
+        workers_.begin(), workers_.end(), [](const auto& lhs, const auto& rhs) { return lhs->size() < rhs->size(); });
+
+    (*worker)->begin_invoke([=, frame = std::move(frame), options = std::move(options)] {
+        CASPAR_SCOPE_EXIT { pending_ -= 1; };
+
+        Snapshot snapshot;
+        try {
+            snapshot = encode(frame, options, path);
+            encoded_ += 1;
+        } catch (...) {
+            callback(std::current_exception(), Snapshot{});
+            return;
+        }
+        callback(nullptr, std::move(snapshot));
+    });
+}
+
+Snapshot SnapshotService::encode(const core::const_frame& frame, const SnapshotOptions& options, const std::wstring& path)
+{
+    auto av_frame         = ffmpeg::alloc_frame();
+    av_frame->width       = static_cast<int>(frame.width());
+    av_frame->height      = static_cast<int>(frame.height());
+    av_frame->format      = AV_PIX_FMT_BGRA;
+    av_frame->linesize[0] = static_cast<int>(frame.width()) * 4;
+    av_frame->data[0]     = const_cast<uint8_t*>(frame.image_data(0).data());
+
+    auto width  = options.width;
+    auto height = options.height;
+    if (width == 0 && height == 0) {
+        width  = av_frame->width;
+        height = av_frame->height;
+    } else if (width == 0) {
+        width = std::max(1, av_frame->width * height / av_frame->height);
+    } else if (height == 0) {
+        height = std::max(1, av_frame->height * width / av_frame->width);
+    }
+
+    auto scaled = scale_frame(av_frame, width, height);
+
+    Snapshot snapshot;
+
+    if (options.format == "raw") {
+        snapshot.data.resize(static_cast<std::size_t>(width) * height * 4);
+        for (int y = 0; y < height; ++y)
+            std::memcpy(snapshot.data.data() + static_cast<std::size_t>(y) * width * 4,
+                        scaled->data[0] + static_cast<std::ptrdiff_t>(y) * scaled->linesize[0],
+                        static_cast<std::size_t>(width) * 4);
+    } else {
+        const AVCodec* codec = nullptr;
+        if (options.format == "jpg")
+            codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+        else if (options.format == "webp")
+            codec = avcodec_find_encoder_by_name("libwebp");
+        else
+            codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+        if (!codec)
+            FF_RET(AVERROR_ENCODER_NOT_FOUND, "avcodec_find_encoder");
+
+        auto ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                                   [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+        if (!ctx)
+            FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+
+        std::shared_ptr<AVFrame> picture;
+        if (options.format == "jpg") {
+            ctx->pix_fmt     = AV_PIX_FMT_YUVJ420P;
+            ctx->color_range = AVCOL_RANGE_JPEG;
+            picture          = convert_image_frame(scaled, ctx->pix_fmt);
+        } else {
+            // The png encoder requires RGB ordering, the mixer produces BGR.
+            picture = convert_image_frame(scaled, AV_PIX_FMT_RGBA);
+            unmultiply_frame(picture);
+
+            ctx->pix_fmt = AV_PIX_FMT_RGBA;
+            if (options.format == "webp") {
+                ctx->pix_fmt = avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, AV_PIX_FMT_YUVA420P, 1, nullptr);
+                picture      = convert_image_frame(picture, ctx->pix_fmt);
+            }
+        }
+
+        ctx->width     = width;
+        ctx->height    = height;
+        ctx->time_base = {1, 1};
+        ctx->framerate = {0, 1};
+
+        if (options.quality > 0) {
+            // mjpeg takes a quantizer, 2 being the best, libwebp takes the quality directly.
+            const auto q = options.format == "jpg" ? 2 + (100 - options.quality) * 29 / 99 : options.quality;
+            ctx->flags |= AV_CODEC_FLAG_QSCALE;
+            ctx->global_quality = FF_QP2LAMBDA * q;
+        }
+
+        FF(avcodec_open2(ctx.get(), codec, nullptr));
+
+        picture->pts     = 0;
+        picture->quality = ctx->global_quality;
+
+        FF(avcodec_send_frame(ctx.get(), picture.get()));
+        FF(avcodec_send_frame(ctx.get(), nullptr));
+
+        auto pkt = ffmpeg::alloc_packet();
+        while (true) {
+            auto ret = avcodec_receive_packet(ctx.get(), pkt.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                break;
+            FF_RET(ret, "avcodec_receive_packet");
+
+            snapshot.data.insert(snapshot.data.end(), pkt->data, pkt->data + pkt->size);
+            av_packet_unref(pkt.get());
+        }
+    }
+
+    if (options.reply)
+        return snapshot;
+
+    // Written next to the target and renamed, so that a reader never sees a partial image.
+    auto target = boost::filesystem::path(path);
+    auto tmp    = boost::filesystem::path(path + L".tmp");
+    {
+        boost::filesystem::ofstream file(tmp, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!file)
+            CASPAR_THROW_EXCEPTION(file_write_error() << msg_info(L"Failed to open " + tmp.wstring()));
+        file.write(reinterpret_cast<const char*>(snapshot.data.data()), snapshot.data.size());
+        file.close();
+        if (!file) {
+            boost::system::error_code ec;
+            boost::filesystem::remove(tmp, ec);
+            CASPAR_THROW_EXCEPTION(file_write_error() << msg_info(L"Failed to write " + tmp.wstring()));
+        }
+    }
+    boost::filesystem::rename(tmp, target);
+
+    snapshot.path = target.wstring();
+    snapshot.data.clear();
+
+    return snapshot;
+}
+
+core::monitor::state SnapshotService::state() const
+{
+    core::monitor::state state;
+    state["pending"]  = pending_.load();
+    state["encoded"]  = encoded_.load();
+    state["rejected"] = rejected_.load();
+    return state;
+}
+
+}} // namespace caspar::image
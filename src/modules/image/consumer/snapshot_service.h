@@ -0,0 +1,82 @@
+#pragma once
+
+#include <common/executor.h>
+
+#include <core/frame/frame.h>
+#include <core/monitor/monitor.h>
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace image {
+
+struct SnapshotOptions
+{
+    std::string  format  = "png"; // png, jpg, webp or raw (premultiplied BGRA)
+    int          width   = 0;     // 0 keeps the aspect ratio, or the channel size if both are 0
+    int          height  = 0;
+    int          quality = 0; // 1..100, 0 uses the encoder default
+    std::wstring filename;    // Relative to the media folder, a time stamp if empty
+    int          ring  = 0;   // Cycles through filename_0 .. filename_<ring - 1> when set
+    bool         reply = false;
+
+    // [filename] [FORMAT png|jpg|webp|raw] [WIDTH w] [HEIGHT h] [QUALITY q] [RING n] [RETURN]
+    static SnapshotOptions parse(const std::vector<std::wstring>& params);
+};
+
+struct Snapshot
+{
+    std::wstring         path; // Empty when the image is returned
+    std::vector<uint8_t> data; // Empty when the image is written to a file
+};
+
+// Encodes channel snapshots on a bounded pool of threads shared by all channels. Requests are rejected while the
+// pool is saturated or when a channel asks again within the minimum interval.
+class SnapshotService
+{
+  public:
+    static SnapshotService& instance();
+
+    SnapshotService(const SnapshotService&)            = delete;
+    SnapshotService& operator=(const SnapshotService&) = delete;
+
+    using callback_t = std::function<void(std::exception_ptr, Snapshot)>;
+
+    // Throws if the request is rejected, otherwise the callback is invoked from a worker thread once the snapshot
+    // has been encoded or has failed.
+    void submit(int channel_index, core::const_frame frame, SnapshotOptions options, callback_t callback);
+
+    core::monitor::state state() const;
+
+  private:
+    SnapshotService();
+
+    Snapshot encode(const core::const_frame& frame, const SnapshotOptions& options, const std::wstring& path);
+
+    const int    max_pending_;
+    const double min_interval_;
+
+    struct Ring
+    {
+        int64_t number = 0;
+        double  used   = 0.0;
+    };
+
+    mutable std::mutex           mutex_;
+    std::map<int, double>        last_;
+    std::map<std::wstring, Ring> rings_;
+    std::atomic<int>             pending_{0};
+    std::atomic<int64_t>         encoded_{0};
+    std::atomic<int64_t>         rejected_{0};
+
+    std::vector<std::unique_ptr<executor>> workers_;
+};
+
+}} // namespace caspar::image
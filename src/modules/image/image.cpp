@@ -24,16 +24,24 @@
 #include "consumer/image_consumer.h"
 #include "producer/image_producer.h"
 #include "producer/image_scroll_producer.h"
+#include "producer/image_sequence_producer.h"
+#include "util/image_cache.h"
 
 #include <common/utf.h>
 
+#include <protocol/amcp/amcp_command_repository_wrapper.h>
+
 namespace caspar { namespace image {
 
 void init(const core::module_dependencies& dependencies)
 {
     dependencies.producer_registry->register_producer_factory(L"Image Scroll Producer", create_scroll_producer);
+    dependencies.producer_registry->register_producer_factory(L"Image Sequence Producer", create_sequence_producer);
     dependencies.producer_registry->register_producer_factory(L"Image Producer", create_producer);
     dependencies.consumer_registry->register_consumer_factory(L"Image Consumer", create_consumer);
+    dependencies.command_repository->register_channel_command(L"Basic Commands", L"SNAPSHOT", snapshot_command, 0);
 }
 
+void uninit() { ImageCache::instance().clear(); }
+
 }} // namespace caspar::image
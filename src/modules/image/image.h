@@ -26,5 +26,6 @@
 namespace caspar { namespace image {
 
 void init(const core::module_dependencies& dependencies);
+void uninit();
 
 }} // namespace caspar::image
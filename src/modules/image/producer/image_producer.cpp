@@ -22,6 +22,7 @@
 
 #include "image_producer.h"
 
+#include "../util/image_cache.h"
 #include "../util/image_converter.h"
 #include "../util/image_loader.h"
 
@@ -32,6 +33,9 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <chrono>
+#include <exception>
+#include <future>
 #include <utility>
 
 namespace caspar { namespace image {
@@ -42,7 +46,9 @@ struct image_producer : public core::frame_producer
     const std::wstring                         description_;
     const spl::shared_ptr<core::frame_factory> frame_factory_;
     const uint32_t                             length_ = 0;
+    std::shared_future<core::const_frame>      future_;
     core::draw_frame                           frame_;
+    std::exception_ptr                         exception_;
 
     image_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
                    std::wstring                                description,
@@ -51,14 +57,12 @@ struct image_producer : public core::frame_producer
         : description_(std::move(description))
         , frame_factory_(frame_factory)
         , length_(length)
+        , future_(ImageCache::instance().load(frame_factory, description_, scale_mode))
     {
-        auto av_frame = load_image(description_);
-        if (!is_frame_compatible_with_mixer(av_frame))
-            av_frame = convert_image_frame(av_frame, AV_PIX_FMT_BGRA);
-
-        auto frame =
-            ffmpeg::make_frame(this, *frame_factory, av_frame, nullptr, core::color_space::bt709, scale_mode, true);
-        frame_ = core::draw_frame(std::move(frame));
+        // Missing and unreadable files still fail LOAD, only the decoding itself is deferred.
+        if (future_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            probe_image(description_);
+        }
 
         state_["file/path"] = description_;
 
@@ -86,13 +90,13 @@ struct image_producer : public core::frame_producer
 
     // frame_producer
 
-    core::draw_frame last_frame(const core::video_field field) override { return frame_; }
+    core::draw_frame last_frame(const core::video_field field) override { return poll(); }
 
-    core::draw_frame first_frame(const core::video_field field) override { return frame_; }
+    core::draw_frame first_frame(const core::video_field field) override { return poll(); }
 
-    bool is_ready() override { return true; }
+    bool is_ready() override { return static_cast<bool>(poll_or_throw()); }
 
-    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override { return frame_; }
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override { return poll_or_throw(); }
 
     uint32_t nb_frames() const override { return length_; }
 
@@ -101,6 +105,33 @@ struct image_producer : public core::frame_producer
     std::wstring name() const override { return L"image"; }
 
     core::monitor::state state() const override { return state_; }
+
+  private:
+    // Images are decoded by ImageCache, nothing is shown until the decoded frame is available.
+    const core::draw_frame& poll()
+    {
+        if (future_.valid() && future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            auto future = std::move(future_);
+            try {
+                frame_ = core::draw_frame(future.get());
+            } catch (...) {
+                CASPAR_LOG(error) << print() << L" Failed to load image.";
+                exception_ = std::current_exception();
+            }
+            state_["file/cache"] = ImageCache::instance().state();
+        }
+        return frame_;
+    }
+
+    // A failed decode is rethrown so that the producer is removed instead of staying empty and never ready.
+    const core::draw_frame& poll_or_throw()
+    {
+        poll();
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+        return frame_;
+    }
 };
 
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
@@ -27,7 +27,9 @@
 #include "../util/image_loader.h"
 #include "../util/image_view.h"
 
+#include <core/frame/frame_factory.h>
 #include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
 
 #include <common/env.h>
 #include <common/filesystem.h>
@@ -38,11 +40,15 @@
 #include <boost/date_time.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/scoped_array.hpp>
+
+#include <tbb/parallel_for.h>
 
 #include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <map>
 #include <optional>
 #include <utility>
 
@@ -105,11 +111,16 @@ struct image_scroll_producer : public core::frame_producer
 {
     core::monitor::state state_;
 
-    const std::wstring            filename_;
-    std::vector<core::draw_frame> frames_;
-    core::video_format_desc       format_desc_;
-    int                           width_;
-    int                           height_;
+    const std::wstring                         filename_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::video_format_desc                    format_desc_;
+    int                                        width_;
+    int                                        height_;
+
+    // The source is kept once, channel sized tiles are only created while they are visible.
+    std::vector<uint8_t>            image_;
+    int                             tile_count_ = 0;
+    std::map<int, core::draw_frame> tiles_;
 
     double                                  delta_ = 0.0;
     speed_tweener                           speed_;
@@ -128,6 +139,7 @@ struct image_scroll_producer : public core::frame_producer
                                    int                                         motion_blur_px         = 0,
                                    bool                                        premultiply_with_alpha = false)
         : filename_(std::move(filename))
+        , frame_factory_(frame_factory)
         , format_desc_(std::move(format_desc))
         , end_time_(std::move(end_time))
     {
@@ -164,15 +176,16 @@ struct image_scroll_producer : public core::frame_producer
 
         speed_ = speed_tweener(speed, speed, 0, tweener(L"linear"));
 
-        auto                   bytes = av_frame->data[0];
-        auto                   count = width_ * height_ * 4;
-        image_view<bgra_pixel> original_view(bytes, width_, height_);
+        image_.resize(static_cast<std::size_t>(width_) * height_ * 4);
+        for (int y = 0; y < height_; ++y)
+            std::memcpy(image_.data() + static_cast<std::size_t>(y) * width_ * 4,
+                        av_frame->data[0] + static_cast<std::ptrdiff_t>(y) * av_frame->linesize[0],
+                        static_cast<std::size_t>(width_) * 4);
+        av_frame.reset();
 
         // This needs to be performed before being the blur is applied
         if (premultiply_with_alpha)
-            premultiply(original_view);
-
-        boost::scoped_array<uint8_t> blurred_copy;
+            premultiply_bgra(image_.data(), width_, height_);
 
         if (motion_blur_px > 0) {
             double angle = 3.14159265 / 2; // Up
@@ -184,75 +197,16 @@ struct image_scroll_producer : public core::frame_producer
             else if (horizontal && speed > 0)
                 angle = 0.0; // Right
 
-            blurred_copy.reset(new uint8_t[count]);
-            image_view<bgra_pixel> blurred_view(blurred_copy.get(), width_, height_);
-            caspar::tweener        blur_tweener(L"easeInQuad");
-            blur(original_view, blurred_view, angle, motion_blur_px, blur_tweener);
-            bytes = blurred_copy.get();
+            std::vector<uint8_t> blurred(image_.size());
+            caspar::tweener      blur_tweener(L"easeInQuad");
+            blur_bgra(image_.data(), blurred.data(), width_, height_, angle, motion_blur_px, blur_tweener);
+            image_ = std::move(blurred);
         }
 
-        if (vertical) {
-            int n = 1;
-
-            while (count > 0) {
-                core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
-                desc.planes.emplace_back(width_, format_desc_.height, 4);
-                auto frame = frame_factory->create_frame(this, desc);
-
-                if (count >= frame.image_data(0).size()) {
-                    std::copy_n(bytes + count - frame.image_data(0).size(),
-                                frame.image_data(0).size(),
-                                frame.image_data(0).begin());
-                    count -= static_cast<int>(frame.image_data(0).size());
-                } else {
-                    memset(frame.image_data(0).begin(), 0, frame.image_data(0).size());
-                    std::copy_n(bytes, count, frame.image_data(0).begin() + format_desc_.size - count);
-                    count = 0;
-                }
-
-                core::draw_frame draw_frame(std::move(frame));
-
-                // Set the relative position to the other image fragments
-                draw_frame.transform().image_transform.fill_translation[1] = -n++;
-
-                frames_.push_back(draw_frame);
-            }
-        } else if (horizontal) {
-            int i = 0;
-            while (count > 0) {
-                core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
-                desc.planes.emplace_back(format_desc_.width, height_, 4);
-                auto frame = frame_factory->create_frame(this, desc);
-                if (count >= frame.image_data(0).size()) {
-                    for (int y = 0; y < height_; ++y)
-                        std::copy_n(bytes + i * format_desc_.width * 4 + y * width_ * 4,
-                                    format_desc_.width * 4,
-                                    frame.image_data(0).begin() + y * format_desc_.width * 4);
-
-                    ++i;
-                    count -= static_cast<int>(frame.image_data(0).size());
-                } else {
-                    memset(frame.image_data(0).begin(), 0, frame.image_data(0).size());
-                    auto width2 = width_ % format_desc_.width;
-                    for (int y = 0; y < height_; ++y)
-                        std::copy_n(bytes + i * format_desc_.width * 4 + y * width_ * 4,
-                                    width2 * 4,
-                                    frame.image_data(0).begin() + y * format_desc_.width * 4);
-
-                    count = 0;
-                }
-
-                frames_.emplace_back(std::move(frame));
-            }
-
-            std::reverse(frames_.begin(), frames_.end());
-
-            // Set the relative positions of the image fragments.
-            for (size_t n = 0; n < frames_.size(); ++n) {
-                double translation                                         = -(static_cast<double>(n) + 1.0);
-                frames_[n].transform().image_transform.fill_translation[0] = translation;
-            }
-        }
+        if (vertical)
+            tile_count_ = (height_ + format_desc_.height - 1) / format_desc_.height;
+        else
+            tile_count_ = (width_ + format_desc_.width - 1) / format_desc_.width;
 
         CASPAR_LOG(info) << print() << L" Initialized";
     }
@@ -289,42 +243,86 @@ struct image_scroll_producer : public core::frame_producer
         return make_ready_future<std::wstring>(L"");
     }
 
+    core::draw_frame make_tile(int n)
+    {
+        bool vertical = width_ == format_desc_.width;
+
+        core::pixel_format_desc desc = core::pixel_format_desc(core::pixel_format::bgra);
+        desc.planes.emplace_back(vertical ? width_ : format_desc_.width, vertical ? format_desc_.height : height_, 4);
+
+        auto        frame = frame_factory_->create_frame(this, desc);
+        auto        dst   = frame.image_data(0).begin();
+        const auto& plane = desc.planes.back();
+
+        // Tiles are numbered from the end of the image, the last one may only be partially covered.
+        int src_x = 0;
+        int src_y = 0;
+        int dst_y = 0;
+        int cols  = plane.width;
+        int rows  = plane.height;
+
+        if (vertical) {
+            auto end = height_ - (n - 1) * format_desc_.height;
+            src_y    = std::max(0, end - format_desc_.height);
+            dst_y    = format_desc_.height - (end - src_y);
+            rows     = end - src_y;
+        } else {
+            src_x = (tile_count_ - n) * format_desc_.width;
+            cols  = std::min(format_desc_.width, width_ - src_x);
+        }
+
+        if (rows != plane.height || cols != plane.width)
+            std::memset(dst, 0, frame.image_data(0).size());
+
+        tbb::parallel_for(0, rows, [&](int y) {
+            std::memcpy(dst + (static_cast<std::size_t>(dst_y + y) * plane.width) * 4,
+                        image_.data() + (static_cast<std::size_t>(src_y + y) * width_ + src_x) * 4,
+                        static_cast<std::size_t>(cols) * 4);
+        });
+
+        core::draw_frame draw_frame(std::move(frame));
+
+        // Set the relative position to the other image fragments
+        if (vertical)
+            draw_frame.transform().image_transform.fill_translation[1] = -n;
+        else
+            draw_frame.transform().image_transform.fill_translation[0] = -n;
+
+        return draw_frame;
+    }
+
     std::vector<core::draw_frame> get_visible()
     {
-        std::vector<core::draw_frame> result;
-        result.reserve(frames_.size());
-
-        for (auto& frame : frames_) {
-            auto& fill_translation = frame.transform().image_transform.fill_translation;
-
-            if (width_ == format_desc_.width) {
-                auto motion_offset_in_screens =
-                    (static_cast<double>(start_offset_y_) + delta_) / static_cast<double>(format_desc_.height);
-                auto vertical_offset = fill_translation[1] + motion_offset_in_screens;
-
-                if (vertical_offset < -1.0 || vertical_offset > 1.0) {
-                    continue;
-                }
-            } else {
-                auto motion_offset_in_screens =
-                    (static_cast<double>(start_offset_x_) + delta_) / static_cast<double>(format_desc_.width);
-                auto horizontal_offset = fill_translation[0] + motion_offset_in_screens;
-
-                if (horizontal_offset < -1.0 || horizontal_offset > 1.0) {
-                    continue;
-                }
-            }
+        double motion_offset_in_screens;
+        if (width_ == format_desc_.width)
+            motion_offset_in_screens =
+                (static_cast<double>(start_offset_y_) + delta_) / static_cast<double>(format_desc_.height);
+        else
+            motion_offset_in_screens =
+                (static_cast<double>(start_offset_x_) + delta_) / static_cast<double>(format_desc_.width);
 
-            result.push_back(frame);
+        // Tile n is placed at -n screens, relative to the motion offset.
+        auto first = std::max(1, static_cast<int>(std::ceil(motion_offset_in_screens - 1.0)));
+        auto last  = std::min(tile_count_, static_cast<int>(std::floor(motion_offset_in_screens + 1.0)));
+
+        tiles_.erase(tiles_.begin(), tiles_.lower_bound(first));
+        tiles_.erase(tiles_.upper_bound(last), tiles_.end());
+
+        std::vector<core::draw_frame> result;
+        for (auto n = first; n <= last; ++n) {
+            auto it = tiles_.find(n);
+            if (it == tiles_.end())
+                it = tiles_.emplace(n, make_tile(n)).first;
+            result.push_back(it->second);
         }
 
-        return std::move(result);
+        return result;
     }
 
     // frame_producer
     core::draw_frame render_frame(bool allow_eof)
     {
-        if (frames_.empty())
+        if (image_.empty())
             return core::draw_frame::empty();
 
         core::draw_frame result(get_visible());
@@ -397,7 +395,7 @@ struct image_scroll_producer : public core::frame_producer
 
     core::monitor::state state() const override { return state_; }
 
-    bool is_ready() override { return !frames_.empty(); }
+    bool is_ready() override { return !image_.empty(); }
 };
 
 spl::shared_ptr<core::frame_producer> create_scroll_producer(const core::frame_producer_dependencies& dependencies,
@@ -0,0 +1,331 @@
+#include "image_sequence_producer.h"
+
+#include "../util/image_converter.h"
+#include "../util/image_loader.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/filesystem.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/timer.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/geometry.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/regex.hpp>
+
+#include <tbb/task_group.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <map>
+#include <utility>
+
+namespace caspar { namespace image {
+
+namespace {
+
+// Orders "frame_9.png" before "frame_10.png", whether or not the numbers are zero padded.
+std::vector<boost::filesystem::path> list_sequence(const boost::filesystem::path& folder)
+{
+    static const boost::regex number_exp("(\\d+)\\D*$");
+
+    std::vector<std::pair<int64_t, boost::filesystem::path>> files;
+    for (auto it = boost::filesystem::directory_iterator(folder); it != boost::filesystem::directory_iterator(); ++it) {
+        if (!boost::filesystem::is_regular_file(it->path()) || !is_valid_file(it->path())) {
+            continue;
+        }
+
+        auto          stem   = it->path().stem().string();
+        auto          number = int64_t{-1};
+        boost::smatch what;
+        if (boost::regex_search(stem, what, number_exp)) {
+            boost::conversion::try_lexical_convert(what[1].str(), number);
+        }
+        files.emplace_back(number, it->path());
+    }
+
+    std::sort(files.begin(), files.end());
+
+    std::vector<boost::filesystem::path> result;
+    for (auto& file : files) {
+        result.push_back(std::move(file.second));
+    }
+    return result;
+}
+
+} // namespace
+
+class image_sequence_producer : public core::frame_producer
+{
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const std::wstring                         folder_;
+    const std::vector<boost::filesystem::path> files_;
+    const core::frame_geometry::scale_mode     scale_mode_;
+    const double                               fps_;
+    const std::size_t                          window_;
+
+    uint32_t in_;
+    uint32_t out_;
+    bool     loop_;
+    uint32_t position_;
+    bool     done_ = false;
+
+    std::map<uint32_t, std::future<core::draw_frame>> pending_;
+    core::draw_frame                                  frame_;
+
+    spl::shared_ptr<diagnostics::graph> graph_;
+    core::monitor::state                state_;
+
+    tbb::task_group tasks_;
+
+  public:
+    image_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                            std::wstring                             folder,
+                            std::vector<boost::filesystem::path>     files,
+                            uint32_t                                 in,
+                            uint32_t                                 out,
+                            bool                                     loop,
+                            core::frame_geometry::scale_mode         scale_mode)
+        : frame_factory_(dependencies.frame_factory)
+        , folder_(std::move(folder))
+        , files_(std::move(files))
+        , scale_mode_(scale_mode)
+        , fps_(dependencies.format_desc.fps)
+        , window_(std::max<std::size_t>(
+              2,
+              static_cast<std::size_t>(std::ceil(
+                  env::properties().get(L"configuration.image.producer.sequence-read-ahead", 0.5) *
+                  dependencies.format_desc.fps))))
+        , in_(std::min<uint32_t>(in, static_cast<uint32_t>(files_.size() - 1)))
+        , out_(std::max(in_, std::min<uint32_t>(out, static_cast<uint32_t>(files_.size() - 1))))
+        , loop_(loop)
+        , position_(in_)
+    {
+        diagnostics::register_graph(graph_);
+        graph_->set_color("decode-time", diagnostics::color(0.1f, 1.0f, 0.1f));
+        graph_->set_color("read-ahead", diagnostics::color(0.9f, 0.6f, 0.4f));
+        graph_->set_color("underrun", diagnostics::color(0.9f, 0.2f, 0.2f));
+        graph_->set_text(print());
+
+        prefetch();
+
+        CASPAR_LOG(info) << print() << L" Initialized with " << files_.size() << L" images.";
+    }
+
+    ~image_sequence_producer() noexcept override
+    {
+        tasks_.cancel();
+        tasks_.wait();
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(const core::video_field field, int nb_samples) override
+    {
+        // Interlaced channels show every image for both fields.
+        if (field == core::video_field::b || done_) {
+            return frame_;
+        }
+
+        prefetch();
+
+        auto it = pending_.find(position_);
+        if (it == pending_.end() || it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (frame_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "underrun");
+            }
+            return frame_;
+        }
+
+        try {
+            frame_ = it->second.get();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(warning) << print() << L" Failed to load " << files_.at(position_).wstring() << L".";
+        }
+        pending_.erase(it);
+
+        if (position_ < out_) {
+            position_ += 1;
+        } else if (loop_) {
+            position_ = in_;
+        } else {
+            done_ = true;
+        }
+
+        prefetch();
+        update_state();
+
+        return frame_;
+    }
+
+    bool is_ready() override
+    {
+        if (frame_) {
+            return true;
+        }
+        prefetch();
+        auto it = pending_.find(position_);
+        return it != pending_.end() && it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    uint32_t frame_number() const override { return position_ - in_; }
+
+    uint32_t nb_frames() const override { return loop_ ? std::numeric_limits<uint32_t>::max() : out_ - in_ + 1; }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        const auto& cmd = params.at(0);
+        const auto  arg = params.size() > 1 ? params.at(1) : std::wstring();
+
+        if (boost::iequals(cmd, L"loop")) {
+            if (!arg.empty()) {
+                loop_ = boost::lexical_cast<bool>(arg);
+                done_ = false;
+            }
+            return make_ready_future(std::to_wstring(loop_));
+        }
+
+        if (boost::iequals(cmd, L"seek") && !arg.empty()) {
+            seek(std::clamp(boost::lexical_cast<uint32_t>(arg), in_, out_));
+            return make_ready_future(std::to_wstring(position_));
+        }
+
+        if (boost::iequals(cmd, L"in")) {
+            if (!arg.empty()) {
+                in_ = std::min(boost::lexical_cast<uint32_t>(arg), out_);
+                seek(std::max(position_, in_));
+            }
+            return make_ready_future(std::to_wstring(in_));
+        }
+
+        if (boost::iequals(cmd, L"out")) {
+            if (!arg.empty()) {
+                out_ = std::clamp(boost::lexical_cast<uint32_t>(arg), in_, static_cast<uint32_t>(files_.size() - 1));
+                seek(std::min(position_, out_));
+            }
+            return make_ready_future(std::to_wstring(out_));
+        }
+
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid image sequence command: " + cmd));
+    }
+
+    std::wstring print() const override { return L"image_sequence_producer[" + folder_ + L"]"; }
+
+    std::wstring name() const override { return L"image-sequence"; }
+
+    core::monitor::state state() const override { return state_; }
+
+  private:
+    uint32_t next(uint32_t position) const { return position < out_ ? position + 1 : in_; }
+
+    // Keeps the next window_ images of the playback order decoding on the tbb pool.
+    void prefetch()
+    {
+        auto position = position_;
+        for (auto n = 0ULL; n < window_; ++n) {
+            if (pending_.find(position) == pending_.end()) {
+                auto task = std::make_shared<std::packaged_task<core::draw_frame()>>(
+                    [this, path = files_.at(position)] { return load(path); });
+                pending_.emplace(position, task->get_future());
+                tasks_.run([task] { (*task)(); });
+            }
+
+            if (position == out_ && !loop_) {
+                break;
+            }
+            position = next(position);
+            if (position == position_) {
+                break;
+            }
+        }
+
+        auto ready = 0;
+        for (auto& p : pending_) {
+            ready += p.second.wait_for(std::chrono::seconds(0)) == std::future_status::ready ? 1 : 0;
+        }
+        graph_->set_value("read-ahead", static_cast<double>(ready) / static_cast<double>(window_));
+    }
+
+    void seek(uint32_t position)
+    {
+        // Images outside the new window are still decoded, their results are dropped.
+        pending_.clear();
+        position_ = position;
+        done_     = false;
+        prefetch();
+        update_state();
+    }
+
+    core::draw_frame load(const boost::filesystem::path& path)
+    {
+        caspar::timer timer;
+
+        auto av_frame = load_image(path.wstring());
+        if (!is_frame_compatible_with_mixer(av_frame)) {
+            av_frame = convert_image_frame(av_frame, AV_PIX_FMT_BGRA);
+        }
+
+        auto frame = core::draw_frame(ffmpeg::make_frame(
+            this, *frame_factory_, av_frame, nullptr, core::color_space::bt709, scale_mode_, true));
+
+        graph_->set_value("decode-time", timer.elapsed() * fps_ * 0.5);
+
+        return frame;
+    }
+
+    void update_state()
+    {
+        state_["file/path"]     = folder_;
+        state_["file/frame"]    = {static_cast<int64_t>(position_ - in_), static_cast<int64_t>(out_ - in_ + 1)};
+        state_["sequence/in"]   = static_cast<int64_t>(in_);
+        state_["sequence/out"]  = static_cast<int64_t>(out_);
+        state_["sequence/loop"] = loop_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (boost::contains(params.at(0), L"://")) {
+        return core::frame_producer::empty();
+    }
+
+    auto folder = find_file_within_dir_or_absolute(
+        env::media_folder(), params.at(0), [](const boost::filesystem::path& path) {
+            return boost::filesystem::is_directory(path);
+        });
+    if (!folder) {
+        return core::frame_producer::empty();
+    }
+
+    auto files = list_sequence(*folder);
+    if (files.empty()) {
+        return core::frame_producer::empty();
+    }
+
+    return spl::make_shared<image_sequence_producer>(
+        dependencies,
+        folder->wstring(),
+        std::move(files),
+        get_param(L"IN", params, 0U),
+        get_param(L"OUT", params, std::numeric_limits<uint32_t>::max()),
+        contains_param(L"LOOP", params),
+        core::scale_mode_from_string(get_param(L"SCALE_MODE", params, L"STRETCH")));
+}
+
+}} // namespace caspar::image
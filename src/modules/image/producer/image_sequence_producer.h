@@ -0,0 +1,17 @@
+#pragma once
+
+#include <core/producer/frame_producer.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace image {
+
+// <folder> [LOOP] [IN n] [OUT n] [SCALE_MODE mode]
+//
+// Plays the numbered images in a folder at the channel frame rate, e.g. "logo/logo_0000.png", "logo/logo_0001.png".
+// IN and OUT are indices into the sequence.
+spl::shared_ptr<core::frame_producer> create_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params);
+
+}} // namespace caspar::image
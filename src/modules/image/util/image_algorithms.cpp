@@ -21,6 +21,9 @@
 
 #include "image_algorithms.h"
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
 #include <algorithm>
 #include <cmath>
 #include <vector>
@@ -46,4 +49,83 @@ std::vector<std::pair<int, int>> get_line_points(int num_pixels, double angle_ra
     return std::move(line_points);
 }
 
+void premultiply_bgra(uint8_t* data, int width, int height)
+{
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& rows) {
+        for (auto y = rows.begin(); y != rows.end(); ++y) {
+            auto row = data + static_cast<std::size_t>(y) * width * 4;
+            for (auto x = 0; x < width; ++x) {
+                const auto alpha = static_cast<unsigned>(row[x * 4 + 3]);
+                row[x * 4 + 0]   = static_cast<uint8_t>(row[x * 4 + 0] * alpha / 255);
+                row[x * 4 + 1]   = static_cast<uint8_t>(row[x * 4 + 1] * alpha / 255);
+                row[x * 4 + 2]   = static_cast<uint8_t>(row[x * 4 + 2] * alpha / 255);
+            }
+        }
+    });
+}
+
+void blur_bgra(const uint8_t*         src,
+               uint8_t*               dst,
+               int                    width,
+               int                    height,
+               double                 angle_radians,
+               int                    blur_px,
+               const caspar::tweener& tweener)
+{
+    const auto trail   = get_line_points(blur_px, angle_radians);
+    auto       weights = get_tweened_values<uint8_t>(tweener, trail.size() + 2, 255, 0);
+    weights.pop_back();
+    weights.erase(weights.begin());
+
+    // The points of the trail move away monotonically, so for every pixel the points inside the image form a prefix
+    // of the trail, just like blur() which stops at the first point outside.
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& rows) {
+        std::vector<int> sum(static_cast<std::size_t>(width) * 4);
+        std::vector<int> total(width);
+
+        for (auto y = rows.begin(); y != rows.end(); ++y) {
+            const auto row = src + static_cast<std::size_t>(y) * width * 4;
+
+            for (auto x = 0; x < width; ++x) {
+                sum[x * 4 + 0] = row[x * 4 + 0] * 255;
+                sum[x * 4 + 1] = row[x * 4 + 1] * 255;
+                sum[x * 4 + 2] = row[x * 4 + 2] * 255;
+                sum[x * 4 + 3] = row[x * 4 + 3] * 255;
+                total[x]       = 255;
+            }
+
+            for (auto i = 0ULL; i < trail.size(); ++i) {
+                const auto dx = trail[i].first;
+                const auto dy = trail[i].second;
+                if (y + dy < 0 || y + dy >= height) {
+                    break;
+                }
+
+                // Indexed from the start of the row, a pointer offset by a negative dx would lie before the image.
+                const auto other  = src + static_cast<std::size_t>(y + dy) * width * 4;
+                const auto weight = static_cast<int>(weights[i]);
+                const auto begin  = std::max(0, -dx);
+                const auto end    = std::min(width, width - dx);
+
+                for (auto x = begin; x < end; ++x) {
+                    const auto pixel = other + static_cast<std::size_t>(x + dx) * 4;
+                    sum[x * 4 + 0] += pixel[0] * weight;
+                    sum[x * 4 + 1] += pixel[1] * weight;
+                    sum[x * 4 + 2] += pixel[2] * weight;
+                    sum[x * 4 + 3] += pixel[3] * weight;
+                    total[x] += weight;
+                }
+            }
+
+            auto out = dst + static_cast<std::size_t>(y) * width * 4;
+            for (auto x = 0; x < width; ++x) {
+                out[x * 4 + 0] = static_cast<uint8_t>(sum[x * 4 + 0] / total[x]);
+                out[x * 4 + 1] = static_cast<uint8_t>(sum[x * 4 + 1] / total[x]);
+                out[x * 4 + 2] = static_cast<uint8_t>(sum[x * 4 + 2] / total[x]);
+                out[x * 4 + 3] = static_cast<uint8_t>(sum[x * 4 + 3] / total[x]);
+            }
+        }
+    });
+}
+
 }} // namespace caspar::image
@@ -225,4 +225,39 @@ void unmultiply(SrcDstView& view_to_modify)
     });
 }
 
+/**
+ * Premultiply a contiguous 8bit BGRA image with alpha in place. Rows are
+ * processed in parallel and the inner loop is free of branches so that it
+ * can be vectorized. The result is identical to premultiply().
+ *
+ * @param data   The first pixel of the image.
+ * @param width  The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ */
+void premultiply_bgra(uint8_t* data, int width, int height);
+
+/**
+ * Directionally blur a contiguous 8bit BGRA image into another of the same
+ * size. Rows are processed in parallel and every point of the motion trail is
+ * applied to a whole row at a time, so that the inner loop can be vectorized.
+ * The result matches blur(), except that the trail stops at the left and right
+ * edges instead of wrapping around into the neighbouring row.
+ *
+ * @param src           The first pixel of the source image.
+ * @param dst           The first pixel of the destination image.
+ * @param width         The width of both images in pixels.
+ * @param height        The height of both images in pixels.
+ * @param angle_radians The angle in radians to directionally blur the image.
+ * @param blur_px       The number of pixels of the blur.
+ * @param tweener       The tweener to use to create a pixel weighting curve
+ *                      with.
+ */
+void blur_bgra(const uint8_t*         src,
+               uint8_t*               dst,
+               int                    width,
+               int                    height,
+               double                 angle_radians,
+               int                    blur_px,
+               const caspar::tweener& tweener);
+
 }} // namespace caspar::image
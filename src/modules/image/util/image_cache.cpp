@@ -0,0 +1,169 @@
+#include "image_cache.h"
+
+#include "image_converter.h"
+#include "image_loader.h"
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/frame_factory.h>
+
+#include <boost/exception/errinfo_file_name.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+
+namespace caspar { namespace image {
+
+ImageCache& ImageCache::instance()
+{
+    static ImageCache cache;
+    return cache;
+}
+
+ImageCache::ImageCache()
+    : max_bytes_(env::properties().get(L"configuration.image.producer.cache-size", std::size_t{256}) * 1024 * 1024)
+{
+    const auto threads = std::max(env::properties().get(L"configuration.image.producer.threads", 2), 1);
+    for (auto n = 0; n < threads; ++n) {
+        loaders_.push_back(std::make_unique<executor>(L"image-loader-" + std::to_wstring(n)));
+    }
+}
+
+std::shared_future<core::const_frame> ImageCache::load(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                                       const std::wstring&                         filename,
+                                                       core::frame_geometry::scale_mode            scale_mode)
+{
+    boost::system::error_code ec;
+    const auto                mtime = boost::filesystem::last_write_time(filename, ec);
+    if (ec) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(filename)));
+    }
+
+    // The scale mode is part of the frame geometry, so it is part of the key as well.
+    const auto key = filename + L"|" + std::to_wstring(mtime) + L"|" + std::to_wstring(static_cast<int>(scale_mode));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        hits_ += 1;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->frame;
+    }
+
+    misses_ += 1;
+
+    const auto loader = std::min_element(
+        loaders_.begin(), loaders_.end(), [](const auto& lhs, const auto& rhs) { return lhs->size() < rhs->size(); });
+
+    auto tag = std::make_shared<char>();
+
+    // The entry is added below before the loader can report back, since that requires the lock held here.
+    auto frame = (*loader)
+                     ->begin_invoke([=] {
+                         try {
+                             auto av_frame = load_image(filename);
+                             if (!is_frame_compatible_with_mixer(av_frame)) {
+                                 av_frame = convert_image_frame(av_frame, AV_PIX_FMT_BGRA);
+                             }
+
+                             auto frame = core::const_frame(ffmpeg::make_frame(
+                                 tag.get(), *frame_factory, av_frame, nullptr, core::color_space::bt709, scale_mode, true));
+
+                             // The host buffers and the textures they were uploaded to.
+                             auto bytes = std::size_t{0};
+                             for (auto n = 0ULL; n < frame.pixel_format_desc().planes.size(); ++n) {
+                                 bytes += frame.image_data(n).size() + frame.pixel_format_desc().planes[n].size;
+                             }
+                             loaded(key, bytes);
+
+                             return frame;
+                         } catch (...) {
+                             failed(key);
+                             throw;
+                         }
+                     })
+                     .share();
+
+    if (max_bytes_ > 0) {
+        entries_.push_front(Entry{key, frame, tag});
+        index_[key] = entries_.begin();
+    }
+
+    return frame;
+}
+
+void ImageCache::clear()
+{
+    std::list<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries.swap(entries_);
+        index_.clear();
+        bytes_ = 0;
+    }
+}
+
+void ImageCache::loaded(const std::wstring& key, std::size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return;
+    }
+
+    if (bytes > max_bytes_) {
+        entries_.erase(it->second);
+        index_.erase(it);
+        return;
+    }
+
+    it->second->bytes = bytes;
+    bytes_ += bytes;
+
+    // Images that are still loading have no size yet and are skipped.
+    auto entry = entries_.end();
+    while (bytes_ > max_bytes_ && entry != entries_.begin()) {
+        --entry;
+        if (entry->bytes == 0 || entry == it->second) {
+            continue;
+        }
+
+        CASPAR_LOG(debug) << L"[image] Evicting " << entry->key << L" from image cache.";
+        bytes_ -= entry->bytes;
+        index_.erase(entry->key);
+        entry = entries_.erase(entry);
+        evictions_ += 1;
+    }
+}
+
+void ImageCache::failed(const std::wstring& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+}
+
+core::monitor::state ImageCache::state() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    core::monitor::state state;
+    state["entries"]   = static_cast<int64_t>(entries_.size());
+    state["size"]      = {static_cast<int64_t>(bytes_), static_cast<int64_t>(max_bytes_)};
+    state["hits"]      = hits_;
+    state["misses"]    = misses_;
+    state["evictions"] = evictions_;
+    return state;
+}
+
+}} // namespace caspar::image
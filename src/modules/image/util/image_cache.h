@@ -0,0 +1,68 @@
+#pragma once
+
+#include <common/executor.h>
+#include <common/memory.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/geometry.h>
+#include <core/fwd.h>
+#include <core/monitor/monitor.h>
+
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace image {
+
+// Process wide LRU cache of decoded images, shared by all producers on all channels. Images are decoded and
+// uploaded on a pool of loader threads, so loading never blocks the caller, and an image that is loaded again
+// while unchanged on disk is available immediately. The uploaded textures keep the ogl device alive, so the
+// module clears the cache on uninit, while the device still exists.
+class ImageCache
+{
+  public:
+    static ImageCache& instance();
+
+    void clear();
+
+    ImageCache(const ImageCache&)            = delete;
+    ImageCache& operator=(const ImageCache&) = delete;
+
+    std::shared_future<core::const_frame> load(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                                               const std::wstring&                         filename,
+                                               core::frame_geometry::scale_mode            scale_mode);
+
+    core::monitor::state state() const;
+
+  private:
+    ImageCache();
+
+    struct Entry
+    {
+        std::wstring                          key;
+        std::shared_future<core::const_frame> frame;
+        std::shared_ptr<char>                 tag; // Each image is a stream of its own.
+        std::size_t                           bytes = 0;
+    };
+
+    void loaded(const std::wstring& key, std::size_t bytes);
+    void failed(const std::wstring& key);
+
+    const std::size_t max_bytes_;
+
+    mutable std::mutex                                 mutex_;
+    std::list<Entry>                                   entries_;
+    std::map<std::wstring, std::list<Entry>::iterator> index_;
+    std::size_t                                        bytes_     = 0;
+    int64_t                                            hits_      = 0;
+    int64_t                                            misses_    = 0;
+    int64_t                                            evictions_ = 0;
+
+    std::vector<std::unique_ptr<executor>> loaders_;
+};
+
+}} // namespace caspar::image
@@ -121,6 +121,22 @@ std::shared_ptr<AVFrame> load_image(const std::wstring& filename)
     return ff_load_image(u8(filename).c_str(), nullptr);
 }
 
+void probe_image(const std::wstring& filename)
+{
+    if (!boost::filesystem::exists(filename))
+        CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(filename)));
+
+    // The image demuxers know the codec from the header alone, unlike image2pipe which needs a decoded frame.
+    AVFormatContext* format_ctx = nullptr;
+    FF(avformat_open_input(&format_ctx, u8(filename).c_str(), nullptr, nullptr));
+    CASPAR_SCOPE_EXIT { avformat_close_input(&format_ctx); };
+
+    if (format_ctx->nb_streams == 0 || !avcodec_find_decoder(format_ctx->streams[0]->codecpar->codec_id)) {
+        CASPAR_THROW_EXCEPTION(file_read_error() << boost::errinfo_file_name(u8(filename))
+                                                 << msg_info("Not a supported image"));
+    }
+}
+
 static int readFunction(void* opaque, uint8_t* buf, int buf_size)
 {
     auto& data = *static_cast<std::vector<unsigned char>*>(opaque);
@@ -161,7 +177,8 @@ bool is_valid_file(const boost::filesystem::path& filename)
                                                       L".jpx",
                                                       L".j2k",
                                                       L".j2c",
-                                                      L".webp"};
+                                                      L".webp",
+                                                      L".exr"};
 
     auto ext = boost::to_lower_copy(boost::filesystem::path(filename).extension().wstring());
     if (extensions.find(ext) == extensions.end()) {
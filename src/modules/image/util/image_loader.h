@@ -31,6 +31,9 @@
 namespace caspar { namespace image {
 
 std::shared_ptr<AVFrame> load_image(const std::wstring& filename);
+
+// Throws if the file does not exist or its header is not an image that can be decoded, without decoding it.
+void probe_image(const std::wstring& filename);
 std::shared_ptr<AVFrame> load_from_memory(std::vector<unsigned char> image_data);
 
 bool is_valid_file(const boost::filesystem::path& filename);
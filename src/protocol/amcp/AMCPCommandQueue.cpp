@@ -25,8 +25,9 @@
 
 #include <boost/lexical_cast.hpp>
 #include <common/except.h>
-#include <common/future.h>
-#include <common/timer.h>
+
+#include <chrono>
+#include <functional>
 
 namespace caspar { namespace protocol { namespace amcp {
 
@@ -39,25 +40,13 @@ AMCPCommandQueue::AMCPCommandQueue(const std::wstring&
 
 AMCPCommandQueue::~AMCPCommandQueue() {}
 
-std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>                         cmd,
-                           const spl::shared_ptr<std::vector<channel_context>>& channels,
-                           bool                                                 reply_without_req_id)
+namespace {
+
+bool send_error(const std::shared_ptr<AMCPCommand>& cmd, bool reply_without_req_id)
 {
     try {
         try {
-            caspar::timer timer;
-
-            auto name = cmd->name();
-            CASPAR_LOG(debug) << "Executing command: " << name;
-
-            auto res = cmd->Execute(channels).share();
-            return std::async(std::launch::async, [cmd, res, reply_without_req_id, timer, name]() -> bool {
-                cmd->SendReply(res.get(), reply_without_req_id);
-
-                CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << name;
-                return true;
-            });
-
+            throw;
         } catch (file_not_found&) {
             CASPAR_LOG(error) << " File not found.";
             cmd->SendReply(L"404 " + cmd->name() + L" FAILED\r\n", reply_without_req_id);
@@ -77,12 +66,47 @@ std::future<bool> exec_cmd(std::shared_ptr<AMCPCommand>
             CASPAR_LOG(error) << "Failed to execute command: " << cmd->name();
             cmd->SendReply(L"501 " + cmd->name() + L" FAILED\r\n", reply_without_req_id);
         }
-
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
     }
 
-    return make_ready_future(false);
+    return false;
+}
+
+} // namespace
+
+// Starts the command and returns a function which waits for its result and sends the reply. The function runs on the
+// queue's own executor, so that replies keep their order without a thread per command, and batches can start all
+// their commands before waiting for any of them.
+std::function<bool()> exec_cmd(std::shared_ptr<AMCPCommand>                         cmd,
+                               const spl::shared_ptr<std::vector<channel_context>>& channels,
+                               bool                                                 reply_without_req_id,
+                               amcp_command_stats::clock::time_point                queued)
+{
+    const auto started = amcp_command_stats::clock::now();
+
+    try {
+        CASPAR_LOG(debug) << "Executing command: " << cmd->name();
+
+        auto res = std::make_shared<std::future<std::wstring>>(cmd->Execute(channels));
+        return [cmd, res, reply_without_req_id, queued, started]() -> bool {
+            try {
+                cmd->SendReply(res->get(), reply_without_req_id);
+            } catch (...) {
+                return send_error(cmd, reply_without_req_id);
+            }
+
+            const auto done = amcp_command_stats::clock::now();
+            amcp_command_stats::instance().record(cmd->name(), started - queued, done - started);
+
+            CASPAR_LOG(debug) << "Executed command (" << std::chrono::duration<double>(done - started).count()
+                              << "s): " << cmd->name();
+            return true;
+        };
+    } catch (...) {
+        auto result = send_error(cmd, reply_without_req_id);
+        return [result] { return result; };
+    }
 }
 
 void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentCommand)
@@ -101,9 +125,9 @@ void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentComm
         return;
     }
 
-    executor_.begin_invoke([=] {
+    executor_.begin_invoke([=, queued = amcp_command_stats::clock::now()] {
         try {
-            Execute(pCurrentCommand);
+            Execute(pCurrentCommand, queued);
 
             CASPAR_LOG(trace) << "Ready for a new command";
         } catch (...) {
@@ -112,35 +136,39 @@ void AMCPCommandQueue::AddCommand(std::shared_ptr<AMCPGroupCommand> pCurrentComm
     });
 }
 
-void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
+void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand>     cmd,
+                               amcp_command_stats::clock::time_point queued) const
 {
     if (cmd->Commands().empty())
         return;
 
     // Shortcut for commands which are either not a batch, or don't need to be
     if (cmd->Commands().size() == 1) {
-        exec_cmd(cmd->Commands().at(0), channels_, true);
+        exec_cmd(cmd->Commands().at(0), channels_, true, queued)();
         return;
     }
 
-    caspar::timer timer;
     CASPAR_LOG(warning) << "Executing batch: " << cmd->name() << L"(" << cmd->Commands().size() << L" commands)";
 
     spl::shared_ptr<std::vector<channel_context>>     delayed_channels;
     std::vector<std::shared_ptr<core::stage_delayed>> delayed_stages;
-    std::vector<std::future<bool>>                    results;
+    std::vector<std::function<bool()>>                results;
     std::vector<std::unique_lock<std::mutex>>         channel_locks;
+    std::vector<std::future<void>>                    applied;
+
+    const auto started = amcp_command_stats::clock::now();
 
     try {
+        // The delayed stages only record operations, no thread is created for them.
         for (auto& ch : *channels_) {
-            auto st = std::make_shared<core::stage_delayed>(ch.raw_channel->stage(), ch.raw_channel->index());
+            auto st = std::make_shared<core::stage_delayed>(ch.raw_channel->stage());
             delayed_stages.push_back(st);
-            delayed_channels->emplace_back(ch.raw_channel, st, ch.lifecycle_key_);
+            delayed_channels->emplace_back(ch.raw_channel, st, ch.lifecycle_key_, ch.info);
         }
 
         // 'execute' aka queue all commands
         for (auto& cmd2 : cmd->Commands()) {
-            results.push_back(exec_cmd(cmd2, delayed_channels, cmd->HasClient()));
+            results.push_back(exec_cmd(cmd2, delayed_channels, cmd->HasClient(), queued));
         }
 
         // lock all the channels needed
@@ -152,28 +180,35 @@ void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
             channel_locks.push_back(st->get_lock());
         }
 
-        // execute the commands
+        // apply the commands, as a single task on each channel that was touched
         for (auto& st : delayed_stages) {
-            st->release();
+            if (st->count_queued() > 0) {
+                applied.push_back(st->release());
+            }
         }
     } catch (...) {
-        // Ensure the created executors don't get leaked
         for (auto& st : delayed_stages) {
             st->abort();
         }
+        for (auto& f : applied) {
+            f.wait();
+        }
 
         throw;
     }
 
     // wait for the commands to finish
-    for (auto& st : delayed_stages) {
-        st->wait();
+    for (auto& f : applied) {
+        f.wait();
     }
     channel_locks.clear();
 
+    const auto done = amcp_command_stats::clock::now();
+    amcp_command_stats::instance().record(cmd->name(), started - queued, done - started);
+
     int failed = 0;
-    for (auto& f : results) {
-        if (!f.get())
+    for (auto& reply : results) {
+        if (!reply())
             failed++;
     }
 
@@ -182,7 +217,8 @@ void AMCPCommandQueue::Execute(std::shared_ptr<AMCPGroupCommand> cmd) const
     else
         cmd->SendReply(L"202 COMMIT OK\r\n");
 
-    CASPAR_LOG(debug) << "Executed batch (" << timer.elapsed() << "s): " << cmd->name();
+    CASPAR_LOG(debug) << "Executed batch (" << std::chrono::duration<double>(done - started).count()
+                      << "s): " << cmd->name();
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -22,6 +22,7 @@
 #pragma once
 
 #include "AMCPCommand.h"
+#include "amcp_command_stats.h"
 
 #include <common/executor.h>
 #include <common/memory.h>
@@ -37,7 +38,7 @@ class AMCPCommandQueue
     ~AMCPCommandQueue();
 
     void AddCommand(std::shared_ptr<AMCPGroupCommand> command);
-    void Execute(std::shared_ptr<AMCPGroupCommand> cmd) const;
+    void Execute(std::shared_ptr<AMCPGroupCommand> cmd, amcp_command_stats::clock::time_point queued) const;
 
   private:
     executor                                            executor_;
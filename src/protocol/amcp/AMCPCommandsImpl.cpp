@@ -27,9 +27,11 @@
 
 #include "AMCPCommandsImpl.h"
 
+#include "../util/AsyncEventServer.h"
 #include "../util/http_request.h"
 #include "AMCPCommandQueue.h"
 #include "amcp_args.h"
+#include "amcp_command_stats.h"
 
 #include <common/env.h>
 
@@ -64,7 +66,6 @@
 #include <memory>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/regex.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/insert_linebreaks.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -76,7 +77,6 @@
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/range/algorithm/copy.hpp>
-#include <boost/regex.hpp>
 
 #include <tbb/concurrent_unordered_map.h>
 
@@ -1496,65 +1496,10 @@ std::wstring tls_command(command_context& ctx) { return make_request(ctx, "/tls"
 
 std::wstring version_command(command_context& ctx) { return L"201 VERSION OK\r\n" + env::version() + L"\r\n"; }
 
-struct param_visitor : public boost::static_visitor<void>
-{
-    std::wstring path;
-    pt::wptree&  o;
-
-    template <typename T>
-    param_visitor(std::string path, T& o)
-        : path(u16(path))
-        , o(o)
-    {
-    }
-
-    void operator()(const bool value) { o.add(path, value); }
-
-    void operator()(const int32_t value) { o.add(path, value); }
-
-    void operator()(const uint32_t value) { o.add(path, value); }
-
-    void operator()(const int64_t value) { o.add(path, value); }
-
-    void operator()(const uint64_t value) { o.add(path, value); }
-
-    void operator()(const float value) { o.add(path, value); }
-
-    void operator()(const double value) { o.add(path, value); }
-
-    void operator()(const std::string& value) { o.add(path, u16(value)); }
-
-    void operator()(const std::wstring& value) { o.add(path, value); }
-};
-
 std::wstring info_channel_command(command_context& ctx)
 {
-    pt::wptree info;
-    pt::wptree channel_info;
-
-    auto state = ctx.channel.raw_channel->state();
-    for (const auto& p : state) {
-        const auto replaced = boost::algorithm::replace_all_copy(p.first, "/", ".");
-        // avoid digit-only nodes in XML
-        const auto path = boost::algorithm::replace_all_regex_copy(
-            replaced, boost::regex("\\.(.*?)\\.([0-9]*?)\\."), std::string(".$1.$1_$2."));
-        param_visitor param_visitor(path, channel_info);
-        for (const auto& element : p.second) {
-            boost::apply_visitor(param_visitor, element);
-        }
-    }
-
-    info.add_child(L"channel", channel_info);
-
-    std::wstringstream replyString;
     // This is needed for backwards compatibility with old clients
-    replyString << L"201 INFO OK\r\n";
-
-    pt::xml_writer_settings<std::wstring> w(' ', 3);
-    pt::xml_parser::write_xml(replyString, info, w);
-
-    replyString << L"\r\n";
-    return replyString.str();
+    return L"201 INFO OK\r\n" + ctx.channel.info->xml() + L"\r\n";
 }
 
 std::wstring info_command(command_context& ctx)
@@ -1605,6 +1550,30 @@ std::wstring info_paths_command(command_context& ctx)
     return replyString.str();
 }
 
+std::wstring info_commands_command(command_context& ctx)
+{
+    std::wstringstream replyString;
+    replyString << L"201 INFO COMMANDS OK\r\n";
+
+    pt::xml_writer_settings<std::wstring> w(' ', 3);
+    pt::xml_parser::write_xml(replyString, amcp_command_stats::instance().info(), w);
+
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
+std::wstring info_connections_command(command_context& ctx)
+{
+    std::wstringstream replyString;
+    replyString << L"201 INFO CONNECTIONS OK\r\n";
+
+    pt::xml_writer_settings<std::wstring> w(' ', 3);
+    pt::xml_parser::write_xml(replyString, IO::connections_info(), w);
+
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
 std::wstring diag_command(command_context& ctx)
 {
     core::diagnostics::osd::show_graphs(true);
@@ -1812,6 +1781,8 @@ void register_commands(std::shared_ptr<amcp_command_repository_wrapper>& repo)
     repo->register_command(L"Query Commands", L"INFO", info_command, 0);
     repo->register_command(L"Query Commands", L"INFO CONFIG", info_config_command, 0);
     repo->register_command(L"Query Commands", L"INFO PATHS", info_paths_command, 0);
+    repo->register_command(L"Query Commands", L"INFO COMMANDS", info_commands_command, 0);
+    repo->register_command(L"Query Commands", L"INFO CONNECTIONS", info_connections_command, 0);
     repo->register_command(L"Query Commands", L"GL INFO", gl_info_command, 0);
     repo->register_command(L"Query Commands", L"GL GC", gl_gc_command, 0);
 
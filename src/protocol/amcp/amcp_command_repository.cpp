@@ -231,7 +231,7 @@ void amcp_command_repository::register_command(std::wstring      category,
                                                amcp_command_func command,
                                                int               min_num_params)
 {
-    impl_->commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    impl_->commands[std::move(name)] = std::make_pair(std::move(command), min_num_params);
 }
 
 void amcp_command_repository::register_channel_command(std::wstring      category,
@@ -239,7 +239,7 @@ void amcp_command_repository::register_channel_command(std::wstring      categor
                                                        amcp_command_func command,
                                                        int               min_num_params)
 {
-    impl_->channel_commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    impl_->channel_commands[std::move(name)] = std::make_pair(std::move(command), min_num_params);
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -41,6 +41,7 @@ class amcp_command_repository
 
     const spl::shared_ptr<std::vector<channel_context>>& channels() const;
 
+    // Registering a name again replaces the previous command, which lets modules override built-in commands.
     void register_command(std::wstring category, std::wstring name, amcp_command_func command, int min_num_params);
 
     void
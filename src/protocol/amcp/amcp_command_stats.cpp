@@ -0,0 +1,69 @@
+#include "../StdAfx.h"
+
+#include "amcp_command_stats.h"
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+amcp_command_stats& amcp_command_stats::instance()
+{
+    static amcp_command_stats stats;
+    return stats;
+}
+
+void amcp_command_stats::histogram::add(int64_t us)
+{
+    auto it = std::lower_bound(bounds.begin(), bounds.end(), us);
+    buckets[it - bounds.begin()] += 1;
+    total += us;
+    max = std::max(max, us);
+}
+
+boost::property_tree::wptree amcp_command_stats::histogram::info(int64_t count) const
+{
+    boost::property_tree::wptree info;
+    info.add(L"mean", count > 0 ? total / count : 0);
+    info.add(L"max", max);
+
+    for (auto n = 0ULL; n < buckets.size(); ++n) {
+        auto& bucket = info.add(L"buckets.bucket", buckets[n]);
+        bucket.add(L"<xmlattr>.le", n < bounds.size() ? std::to_wstring(bounds[n]) : L"inf");
+    }
+
+    return info;
+}
+
+void amcp_command_stats::record(const std::wstring& name, clock::duration queue_wait, clock::duration execute)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto& entry = entries_[name];
+    entry.count += 1;
+    entry.queue_wait.add(duration_cast<microseconds>(queue_wait).count());
+    entry.execute.add(duration_cast<microseconds>(execute).count());
+}
+
+boost::property_tree::wptree amcp_command_stats::info() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    boost::property_tree::wptree info;
+    for (auto& entry : entries_) {
+        boost::property_tree::wptree command;
+        command.add(L"name", entry.first);
+        command.add(L"count", entry.second.count);
+        command.add_child(L"queue-wait", entry.second.queue_wait.info(entry.second.count));
+        command.add_child(L"execute", entry.second.execute.info(entry.second.count));
+        info.add_child(L"commands.command", command);
+    }
+
+    return info;
+}
+
+}}} // namespace caspar::protocol::amcp
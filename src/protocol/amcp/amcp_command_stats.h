@@ -0,0 +1,57 @@
+#pragma once
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// Latency histograms of executed AMCP commands, keyed by command name and shared by all connections.
+class amcp_command_stats
+{
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static amcp_command_stats& instance();
+
+    // queue_wait is the time from the command being queued until it started executing, execute the time from then
+    // until its reply was sent.
+    void record(const std::wstring& name, clock::duration queue_wait, clock::duration execute);
+
+    // Times are reported in microseconds.
+    boost::property_tree::wptree info() const;
+
+  private:
+    amcp_command_stats() = default;
+
+    // Upper bounds in microseconds, the last bucket counts everything above.
+    static constexpr std::array<int64_t, 12> bounds = {
+        100, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000};
+
+    struct histogram
+    {
+        std::array<int64_t, bounds.size() + 1> buckets{};
+        int64_t                                total = 0;
+        int64_t                                max   = 0;
+
+        void                         add(int64_t us);
+        boost::property_tree::wptree info(int64_t count) const;
+    };
+
+    struct entry
+    {
+        int64_t   count = 0;
+        histogram queue_wait;
+        histogram execute;
+    };
+
+    mutable std::mutex            mutex_;
+    std::map<std::wstring, entry> entries_;
+};
+
+}}} // namespace caspar::protocol::amcp
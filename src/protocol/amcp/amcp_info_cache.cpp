@@ -0,0 +1,293 @@
+#include "../StdAfx.h"
+
+#include "amcp_info_cache.h"
+
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/algorithm/string/regex.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+#include <boost/regex.hpp>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace pt = boost::property_tree;
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+struct param_visitor : public boost::static_visitor<void>
+{
+    std::wstring path;
+    pt::wptree&  o;
+
+    param_visitor(std::wstring path, pt::wptree& o)
+        : path(std::move(path))
+        , o(o)
+    {
+    }
+
+    void operator()(const bool value) { o.add(path, value); }
+
+    void operator()(const int32_t value) { o.add(path, value); }
+
+    void operator()(const uint32_t value) { o.add(path, value); }
+
+    void operator()(const int64_t value) { o.add(path, value); }
+
+    void operator()(const uint64_t value) { o.add(path, value); }
+
+    void operator()(const float value) { o.add(path, value); }
+
+    void operator()(const double value) { o.add(path, value); }
+
+    void operator()(const std::string& value) { o.add(path, u16(value)); }
+
+    void operator()(const std::wstring& value) { o.add(path, value); }
+};
+
+using data_entry = core::monitor::data_map_t::value_type;
+
+const pt::xml_writer_settings<std::wstring> SETTINGS(' ', 3);
+
+std::vector<std::string> split_path(const std::string& key)
+{
+    std::vector<std::string> components;
+    boost::split(components, key, boost::is_any_of("/"));
+    return components;
+}
+
+bool is_number(const std::string& str)
+{
+    return !str.empty() && std::all_of(str.begin(), str.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// The entries of a subtree, serialized as the children of the element at the given indent.
+struct group
+{
+    core::monitor::data_map_t entries;
+    std::wstring              xml;
+};
+
+} // namespace
+
+struct info_cache::impl
+{
+    std::mutex                                  state_mutex_;
+    std::shared_ptr<const core::monitor::state> state_;
+
+    std::mutex                                  mutex_;
+    std::shared_ptr<const core::monitor::state> serialized_state_;
+    std::wstring                                xml_;
+    std::map<std::string, group>                groups_;
+    std::unordered_map<std::string, std::wstring> paths_;
+
+    void update(core::monitor::state state)
+    {
+        auto ptr = std::make_shared<const core::monitor::state>(std::move(state));
+
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_ = std::move(ptr);
+    }
+
+    std::wstring xml()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::shared_ptr<const core::monitor::state> state;
+        {
+            std::lock_guard<std::mutex> state_lock(state_mutex_);
+            state = state_;
+        }
+
+        if (!state) {
+            state = std::make_shared<const core::monitor::state>();
+        }
+
+        if (state != serialized_state_) {
+            xml_              = serialize(*state);
+            serialized_state_ = std::move(state);
+        }
+        return xml_;
+    }
+
+    // "stage/layer/10/foreground/file/name" => "stage.layer.layer_10.foreground.file.name"
+    const std::wstring& path(const std::string& key)
+    {
+        auto it = paths_.find(key);
+        if (it != paths_.end()) {
+            return it->second;
+        }
+
+        if (paths_.size() > 100000) {
+            paths_.clear();
+        }
+
+        const auto replaced = boost::algorithm::replace_all_copy(key, "/", ".");
+        // avoid digit-only nodes in XML
+        const auto path = boost::algorithm::replace_all_regex_copy(
+            replaced, boost::regex("\\.(.*?)\\.([0-9]*?)\\."), std::string(".$1.$1_$2."));
+        return paths_.emplace(key, u16(path)).first->second;
+    }
+
+    static std::wstring write_children(const pt::wptree& tree, int indent)
+    {
+        std::wstringstream stream;
+        for (auto& child : tree) {
+            pt::xml_parser::write_xml_element(stream, child.first, child.second, indent, SETTINGS);
+        }
+        return stream.str();
+    }
+
+    // Builds the same document as a single write_xml of the whole state. Every entry of a top level element like
+    // "stage" or "output" that only contains enumerated children ("stage/layer/10/...") is grouped by the enumerated
+    // child, everything else is grouped by the top level element. Groups with the same entries as in the previous
+    // request reuse their serialized elements.
+    std::wstring serialize(const core::monitor::state& state)
+    {
+        // Top level elements that are split into one group per enumerated child.
+        std::map<std::string, bool> split;
+        for (auto& entry : state) {
+            const auto components = split_path(entry.first);
+            const auto prefix     = components.size() >= 4 ? components[0] + "." + components[1] + "." + components[1] +
+                                                             "_" + components[2] + "."
+                                                       : std::string();
+            const auto enumerated = components.size() >= 4 && is_number(components[2]) &&
+                                    boost::starts_with(path(entry.first), u16(prefix));
+
+            auto it = split.find(components[0]);
+            if (it == split.end()) {
+                split.emplace(components[0], enumerated);
+            } else {
+                it->second = it->second && enumerated;
+            }
+        }
+
+        struct element
+        {
+            std::string top;   // "stage"
+            std::string child; // "layer", empty if the group is not split
+            std::string key;   // "stage/layer/10" or "stage"
+        };
+
+        std::vector<element>                                   order;
+        std::map<std::string, std::vector<const data_entry*>> entries;
+        for (auto& entry : state) {
+            const auto components = split_path(entry.first);
+
+            element e;
+            e.top = components[0];
+            e.key = components[0];
+            if (split[e.top]) {
+                e.child = components[1];
+                e.key   = components[0] + "/" + components[1] + "/" + components[2];
+            }
+
+            if (order.empty() || order.back().key != e.key) {
+                // The elements of a group are only written together if the group is contiguous.
+                if (entries.count(e.key) > 0) {
+                    return serialize_all(state);
+                }
+                order.push_back(e);
+            }
+            entries[e.key].push_back(&entry);
+        }
+
+        if (order.empty()) {
+            return serialize_all(state);
+        }
+
+        std::map<std::string, group> groups;
+        for (auto& e : order) {
+            core::monitor::data_map_t group_entries;
+            for (auto entry : entries[e.key]) {
+                group_entries.emplace_hint(group_entries.end(), entry->first, entry->second);
+            }
+
+            auto it = groups_.find(e.key);
+            if (it != groups_.end() && it->second.entries == group_entries) {
+                groups.emplace(e.key, std::move(it->second));
+                continue;
+            }
+
+            // Split groups are written as children of "channel.stage.layer", the others as children of "channel".
+            const auto   prefix = e.child.empty() ? std::wstring() : u16(e.top + "." + e.child + ".");
+            pt::wptree   tree;
+            for (auto entry : entries[e.key]) {
+                param_visitor param_visitor(path(entry->first).substr(prefix.size()), tree);
+                for (const auto& element : entry->second) {
+                    boost::apply_visitor(param_visitor, element);
+                }
+            }
+            groups.emplace(e.key, group{std::move(group_entries), write_children(tree, e.child.empty() ? 1 : 3)});
+        }
+        groups_ = std::move(groups);
+
+        const std::wstring indent1(3, L' ');
+        const std::wstring indent2(6, L' ');
+
+        std::wstring xml = L"<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<channel>\n";
+        for (auto n = 0ULL; n < order.size(); ++n) {
+            auto& e = order[n];
+
+            if (!e.child.empty() && (n == 0 || order[n - 1].top != e.top)) {
+                xml += indent1 + L"<" + u16(e.top) + L">\n";
+            }
+            if (!e.child.empty() && (n == 0 || order[n - 1].top != e.top || order[n - 1].child != e.child)) {
+                xml += indent2 + L"<" + u16(e.child) + L">\n";
+            }
+
+            xml += groups_[e.key].xml;
+
+            const auto last = n + 1 == order.size();
+            if (!e.child.empty() && (last || order[n + 1].top != e.top || order[n + 1].child != e.child)) {
+                xml += indent2 + L"</" + u16(e.child) + L">\n";
+            }
+            if (!e.child.empty() && (last || order[n + 1].top != e.top)) {
+                xml += indent1 + L"</" + u16(e.top) + L">\n";
+            }
+        }
+        xml += L"</channel>\n";
+
+        return xml;
+    }
+
+    std::wstring serialize_all(const core::monitor::state& state)
+    {
+        groups_.clear();
+
+        pt::wptree info;
+        pt::wptree channel_info;
+        for (const auto& p : state) {
+            param_visitor param_visitor(path(p.first), channel_info);
+            for (const auto& element : p.second) {
+                boost::apply_visitor(param_visitor, element);
+            }
+        }
+        info.add_child(L"channel", channel_info);
+
+        std::wstringstream stream;
+        pt::xml_parser::write_xml(stream, info, SETTINGS);
+        return stream.str();
+    }
+};
+
+info_cache::info_cache()
+    : impl_(new impl())
+{
+}
+
+info_cache::~info_cache() {}
+
+void info_cache::update(core::monitor::state state) { impl_->update(std::move(state)); }
+
+std::wstring info_cache::xml() { return impl_->xml(); }
+
+}}} // namespace caspar::protocol::amcp
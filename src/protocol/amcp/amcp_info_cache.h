@@ -0,0 +1,33 @@
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/monitor/monitor.h>
+
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// The XML document returned by INFO <channel>. The state is stored on every tick and only serialized when it is
+// requested, at most once per tick. Layers and consumer ports whose state did not change since the previous request
+// are not serialized again.
+class info_cache
+{
+  public:
+    info_cache();
+    ~info_cache();
+
+    info_cache(const info_cache&)            = delete;
+    info_cache& operator=(const info_cache&) = delete;
+
+    // Called from the channel thread.
+    void update(core::monitor::state state);
+
+    std::wstring xml();
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::amcp
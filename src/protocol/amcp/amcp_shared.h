@@ -2,6 +2,7 @@
 
 #include "../util/ClientInfo.h"
 #include "../util/lock_container.h"
+#include "amcp_info_cache.h"
 #include <core/producer/stage.h>
 #include <core/video_channel.h>
 #include <utility>
@@ -14,17 +15,20 @@ class channel_context
     explicit channel_context() {}
     explicit channel_context(std::shared_ptr<core::video_channel> c,
                              std::shared_ptr<core::stage_base>    s,
-                             const std::wstring&                  lifecycle_key)
+                             const std::wstring&                  lifecycle_key,
+                             std::shared_ptr<amcp::info_cache>    i)
         : raw_channel(std::move(c))
         , stage(std::move(s))
         , lock(std::make_shared<caspar::IO::lock_container>(lifecycle_key))
         , lifecycle_key_(lifecycle_key)
+        , info(std::move(i))
     {
     }
     const std::shared_ptr<core::video_channel>        raw_channel;
     const std::shared_ptr<core::stage_base>           stage;
     const std::shared_ptr<caspar::IO::lock_container> lock;
     const std::wstring                                lifecycle_key_;
+    const std::shared_ptr<amcp::info_cache>           info;
 };
 
 struct command_context_simple
@@ -0,0 +1,475 @@
+#include "../StdAfx.h"
+
+#include "exporter.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/diagnostics/call_context.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace caspar { namespace protocol { namespace metrics {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+const std::chrono::minutes  SERIES_EXPIRY(5);
+const std::chrono::seconds  REQUEST_TIMEOUT(5);
+const std::array<double, 8> BUCKETS = {0.05, 0.1, 0.2, 0.3, 0.4, 0.5, 0.75, 1.0};
+
+void append_label(std::string& out, const char* name, const std::string& value)
+{
+    if (!out.empty()) {
+        out += ',';
+    }
+    out += name;
+    out += "=\"";
+    for (auto c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string format_number(double value)
+{
+    if (std::isnan(value)) {
+        return "NaN";
+    }
+    if (std::isinf(value)) {
+        return value > 0 ? "+Inf" : "-Inf";
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", value);
+    return buf;
+}
+
+void append_sample(std::string& out, const char* metric, const std::string& labels, const std::string& value)
+{
+    out += metric;
+    out += '{';
+    out += labels;
+    out += "} ";
+    out += value;
+    out += '\n';
+}
+
+const char* severity_name(diagnostics::tag_severity severity)
+{
+    switch (severity) {
+        case diagnostics::tag_severity::WARNING:
+            return "warning";
+        case diagnostics::tag_severity::INFO:
+            return "info";
+        default:
+            return "silent";
+    }
+}
+
+struct value_series
+{
+    std::mutex                           mutex;
+    std::array<uint64_t, BUCKETS.size()> buckets{};
+    uint64_t                             count   = 0;
+    double                               sum     = 0.0;
+    double                               last    = 0.0;
+    clock::time_point                    updated = clock::now();
+
+    void observe(double value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto n = 0ULL; n < BUCKETS.size(); ++n) {
+            if (value <= BUCKETS[n]) {
+                ++buckets[n];
+            }
+        }
+        ++count;
+        sum += value;
+        last    = value;
+        updated = clock::now();
+    }
+};
+
+struct tag_series
+{
+    std::mutex        mutex;
+    uint64_t          count   = 0;
+    clock::time_point updated = clock::now();
+
+    void increment()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++count;
+        updated = clock::now();
+    }
+};
+
+// The series of all graphs, keyed by their labels. Graphs with the same labels, e.g. the same file playing twice on a
+// layer, share their series.
+class registry
+{
+    std::mutex                                           mutex_;
+    std::map<std::string, std::shared_ptr<value_series>> values_;
+    std::map<std::string, std::shared_ptr<tag_series>>   tags_;
+
+    template <typename T>
+    static std::shared_ptr<T> find_or_create(std::map<std::string, std::shared_ptr<T>>& series, std::string labels)
+    {
+        auto& result = series[std::move(labels)];
+        if (!result) {
+            result = std::make_shared<T>();
+        }
+        return result;
+    }
+
+    // Series are only referenced by the registry once the graphs writing to them are gone.
+    template <typename T>
+    static void expire(std::map<std::string, std::shared_ptr<T>>& series, clock::time_point now)
+    {
+        for (auto it = series.begin(); it != series.end();) {
+            if (it->second.use_count() == 1) {
+                std::lock_guard<std::mutex> lock(it->second->mutex);
+                if (now - it->second->updated > SERIES_EXPIRY) {
+                    it = series.erase(it);
+                    continue;
+                }
+            }
+            ++it;
+        }
+    }
+
+  public:
+    std::shared_ptr<value_series> value(std::string labels)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return find_or_create(values_, std::move(labels));
+    }
+
+    std::shared_ptr<tag_series> tag(std::string labels)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return find_or_create(tags_, std::move(labels));
+    }
+
+    std::string render()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto now = clock::now();
+        expire(values_, now);
+        expire(tags_, now);
+
+        std::string out;
+        out.reserve(values_.size() * 1024 + tags_.size() * 128);
+
+        out += "# HELP caspar_graph_value Diagnostics graph values, where 0.5 is one frame interval for times.\n";
+        out += "# TYPE caspar_graph_value histogram\n";
+        for (auto& entry : values_) {
+            std::lock_guard<std::mutex> series_lock(entry.second->mutex);
+            for (auto n = 0ULL; n < BUCKETS.size(); ++n) {
+                auto labels = entry.first;
+                append_label(labels, "le", format_number(BUCKETS[n]));
+                append_sample(out, "caspar_graph_value_bucket", labels, std::to_string(entry.second->buckets[n]));
+            }
+            auto labels = entry.first;
+            append_label(labels, "le", "+Inf");
+            append_sample(out, "caspar_graph_value_bucket", labels, std::to_string(entry.second->count));
+            append_sample(out, "caspar_graph_value_sum", entry.first, format_number(entry.second->sum));
+            append_sample(out, "caspar_graph_value_count", entry.first, std::to_string(entry.second->count));
+        }
+
+        out += "# HELP caspar_graph_last_value The latest value of each diagnostics graph value.\n";
+        out += "# TYPE caspar_graph_last_value gauge\n";
+        for (auto& entry : values_) {
+            std::lock_guard<std::mutex> series_lock(entry.second->mutex);
+            append_sample(out, "caspar_graph_last_value", entry.first, format_number(entry.second->last));
+        }
+
+        out += "# HELP caspar_graph_tags_total Diagnostics graph tags, such as dropped-frame and underflow.\n";
+        out += "# TYPE caspar_graph_tags_total counter\n";
+        for (auto& entry : tags_) {
+            std::lock_guard<std::mutex> series_lock(entry.second->mutex);
+            append_sample(out, "caspar_graph_tags_total", entry.first, std::to_string(entry.second->count));
+        }
+
+        return out;
+    }
+};
+
+class sink : public diagnostics::spi::graph_sink
+{
+    const std::weak_ptr<registry>         registry_;
+    const core::diagnostics::call_context context_ = core::diagnostics::call_context::for_thread();
+
+    std::mutex                                           mutex_;
+    std::wstring                                         text_;
+    std::string                                          labels_; // Empty until the graph has a text
+    std::map<std::string, std::shared_ptr<value_series>> values_;
+    std::map<std::string, std::shared_ptr<tag_series>>   tags_;
+
+  public:
+    explicit sink(std::weak_ptr<registry> registry)
+        : registry_(std::move(registry))
+    {
+    }
+
+    void activate() override {}
+
+    void set_text(const std::wstring& value) override
+    {
+        // The text is e.g. "video_channel[1|1080i5000]" or "DeckLink 8K Pro [1|1080i5000]". Only the part before the
+        // first '|' is used, since producers show their position after it.
+        auto open = value.find(L'[');
+        auto end  = open == std::wstring::npos ? open : value.find_first_of(L"|]", open + 1);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (value.compare(0, end, text_) == 0 && !labels_.empty()) {
+            return;
+        }
+        text_ = value.substr(0, end);
+
+        std::string labels;
+        append_label(labels, "graph", u8(boost::trim_copy(value.substr(0, open))));
+        if (context_.video_channel != -1) {
+            append_label(labels, "channel", std::to_string(context_.video_channel));
+        }
+        if (context_.layer != -1) {
+            append_label(labels, "layer", std::to_string(context_.layer));
+        }
+        if (open != std::wstring::npos) {
+            append_label(labels, "instance", u8(value.substr(open + 1, end - open - 1)));
+        }
+
+        if (labels != labels_) {
+            labels_ = std::move(labels);
+            values_.clear();
+            tags_.clear();
+        }
+    }
+
+    void set_value(const std::string& name, double value) override
+    {
+        std::shared_ptr<value_series> series;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto&                       cached = values_[name];
+            if (!cached) {
+                cached = create<value_series>(name, nullptr);
+            }
+            series = cached;
+        }
+        if (series) {
+            series->observe(value);
+        }
+    }
+
+    void set_tag(diagnostics::tag_severity severity, const std::string& name) override
+    {
+        std::shared_ptr<tag_series> series;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto&                       cached = tags_[name];
+            if (!cached) {
+                cached = create<tag_series>(name, severity_name(severity));
+            }
+            series = cached;
+        }
+        if (series) {
+            series->increment();
+        }
+    }
+
+    void set_color(const std::string& name, int color) override {}
+
+    void auto_reset() override {}
+
+  private:
+    // Values and tags of graphs without a text are dropped, rather than kept under a series nobody can identify.
+    template <typename T>
+    std::shared_ptr<T> create(const std::string& name, const char* severity)
+    {
+        auto reg = registry_.lock();
+        if (!reg || labels_.empty()) {
+            return nullptr;
+        }
+
+        auto labels = labels_;
+        append_label(labels, "name", name);
+        if (severity) {
+            append_label(labels, "severity", severity);
+        }
+
+        if constexpr (std::is_same_v<T, value_series>) {
+            return reg->value(std::move(labels));
+        } else {
+            return reg->tag(std::move(labels));
+        }
+    }
+};
+
+} // namespace
+
+struct exporter::impl : public std::enable_shared_from_this<impl>
+{
+    class session : public std::enable_shared_from_this<session>
+    {
+        boost::asio::ip::tcp::socket socket_;
+        boost::asio::steady_timer    timer_;
+        boost::asio::streambuf       request_{8192};
+        std::string                  response_;
+        std::weak_ptr<registry>      registry_;
+
+      public:
+        session(boost::asio::ip::tcp::socket socket, std::weak_ptr<registry> registry)
+            : socket_(std::move(socket))
+            , timer_(socket_.get_executor())
+            , registry_(std::move(registry))
+        {
+        }
+
+        void start()
+        {
+            auto self = shared_from_this();
+
+            timer_.expires_after(REQUEST_TIMEOUT);
+            timer_.async_wait([self](const boost::system::error_code& ec) {
+                if (!ec) {
+                    boost::system::error_code ignored;
+                    self->socket_.close(ignored);
+                }
+            });
+
+            boost::asio::async_read_until(
+                socket_, request_, "\r\n\r\n", [self](const boost::system::error_code& ec, std::size_t) {
+                    if (!ec) {
+                        self->respond();
+                    } else {
+                        self->timer_.cancel();
+                    }
+                });
+        }
+
+      private:
+        void respond()
+        {
+            std::istream request(&request_);
+            std::string  method;
+            std::string  target;
+            request >> method >> target;
+
+            auto status = std::string("200 OK");
+            auto body   = std::string();
+            if (method != "GET" && method != "HEAD") {
+                status = "405 Method Not Allowed";
+            } else if (target != "/metrics" && target.compare(0, 9, "/metrics?") != 0) {
+                status = "404 Not Found";
+            } else if (auto reg = registry_.lock()) {
+                body = reg->render();
+            } else {
+                status = "503 Service Unavailable";
+            }
+
+            response_ = "HTTP/1.1 " + status + "\r\n" + "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n" +
+                        "Content-Length: " + std::to_string(body.size()) + "\r\n" + "Connection: close\r\n\r\n";
+            if (method != "HEAD") {
+                response_ += body;
+            }
+
+            auto self = shared_from_this();
+            boost::asio::async_write(
+                socket_, boost::asio::buffer(response_), [self](const boost::system::error_code&, std::size_t) {
+                    boost::system::error_code ignored;
+                    self->socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                    self->socket_.close(ignored);
+                    self->timer_.cancel();
+                });
+        }
+    };
+
+    std::shared_ptr<boost::asio::io_context> io_context_;
+    boost::asio::ip::tcp::acceptor           acceptor_;
+    std::shared_ptr<registry>                registry_ = std::make_shared<registry>();
+
+    impl(std::shared_ptr<boost::asio::io_context> io_context, const std::wstring& host, unsigned short port)
+        : io_context_(std::move(io_context))
+        , acceptor_(boost::asio::make_strand(*io_context_))
+    {
+        try {
+            boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address(u8(host)), port);
+            acceptor_.open(endpoint.protocol());
+            acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+            acceptor_.bind(endpoint);
+            acceptor_.listen();
+        } catch (const boost::system::system_error& e) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Failed to serve metrics on " + host + L":" +
+                                                            std::to_wstring(port) + L" (" + u16(e.what()) + L")"));
+        }
+
+        std::weak_ptr<registry> weak_registry = registry_;
+        diagnostics::spi::register_sink_factory([weak_registry] { return spl::make_shared<sink>(weak_registry); });
+
+        CASPAR_LOG(info) << L"[metrics] Serving diagnostics graphs on http://" << host << L":" << port << L"/metrics";
+    }
+
+    void start()
+    {
+        auto self = shared_from_this();
+        boost::asio::dispatch(acceptor_.get_executor(), [self] { self->accept(); });
+    }
+
+    void stop()
+    {
+        auto self = shared_from_this();
+        boost::asio::dispatch(acceptor_.get_executor(), [self] {
+            boost::system::error_code ignored;
+            self->acceptor_.close(ignored);
+        });
+    }
+
+    void accept() // always called from the acceptor strand
+    {
+        auto self = shared_from_this();
+        acceptor_.async_accept(boost::asio::make_strand(*io_context_),
+                               [self](const boost::system::error_code& ec, boost::asio::ip::tcp::socket socket) {
+                                   if (!self->acceptor_.is_open()) {
+                                       return;
+                                   }
+                                   if (!ec) {
+                                       std::make_shared<session>(std::move(socket), self->registry_)->start();
+                                   }
+                                   self->accept();
+                               });
+    }
+};
+
+exporter::exporter(std::shared_ptr<boost::asio::io_context> io_context, const std::wstring& host, unsigned short port)
+    : impl_(spl::make_shared<impl>(std::move(io_context), host, port))
+{
+    impl_->start();
+}
+
+exporter::~exporter() { impl_->stop(); }
+
+}}} // namespace caspar::protocol::metrics
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <common/memory.h>
+
+#include <boost/asio/io_context.hpp>
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace protocol { namespace metrics {
+
+// Serves the values and tags of every diagnostics graph in the Prometheus text format on http://<host>:<port>/metrics,
+// so that headless servers can be monitored without the diagnostics window.
+//
+// Each graph created after the exporter is labelled with the channel and layer of the call_context it was created in,
+// and with the name and instance parsed from its text, "ffmpeg[amb|0.1/10.0]" giving graph="ffmpeg" instance="amb":
+//
+//   caspar_graph_value_bucket{graph="ffmpeg",channel="1",layer="10",instance="amb",name="frame-time",le="0.5"} 1200
+//   caspar_graph_value_sum{...} / caspar_graph_value_count{...} / caspar_graph_last_value{...}
+//   caspar_graph_tags_total{graph="video_channel",channel="1",instance="1",name="dropped-frame",severity="warning"} 3
+//
+// Values are in graph units, where 0.5 is one frame interval for times. Series whose graphs have all been destroyed
+// are kept for a few minutes, so that the final counts of a producer are scraped before they disappear.
+class exporter
+{
+  public:
+    exporter(std::shared_ptr<boost::asio::io_context> io_context, const std::wstring& host, unsigned short port);
+    ~exporter();
+
+    exporter(const exporter&)            = delete;
+    exporter& operator=(const exporter&) = delete;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::metrics
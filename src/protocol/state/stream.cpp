@@ -0,0 +1,366 @@
+#include "../StdAfx.h"
+
+#include "stream.h"
+
+#include "../util/strategy_adapters.h"
+
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace caspar { namespace protocol { namespace state {
+
+namespace {
+
+void append_string(std::string& out, const std::string& str)
+{
+    out += '"';
+    for (auto c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+struct json_visitor : public boost::static_visitor<void>
+{
+    std::string& out;
+
+    explicit json_visitor(std::string& out)
+        : out(out)
+    {
+    }
+
+    void operator()(const bool value) { out += value ? "true" : "false"; }
+    void operator()(const int32_t value) { out += std::to_string(value); }
+    void operator()(const uint32_t value) { out += std::to_string(value); }
+    void operator()(const int64_t value) { out += std::to_string(value); }
+    void operator()(const uint64_t value) { out += std::to_string(value); }
+    void operator()(const float value) { number(value, 9); }
+    void operator()(const double value) { number(value, 15); }
+    void operator()(const std::string& value) { append_string(out, value); }
+    void operator()(const std::wstring& value) { append_string(out, u8(value)); }
+
+    void number(double value, int precision)
+    {
+        if (!std::isfinite(value)) {
+            out += "null";
+            return;
+        }
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        out += buf;
+    }
+};
+
+// "path":[value, ...]
+std::string encode_entry(const std::string& path, const core::monitor::vector_t& values)
+{
+    std::string  out;
+    json_visitor visitor(out);
+
+    append_string(out, path);
+    out += ":[";
+    for (auto n = 0ULL; n < values.size(); ++n) {
+        if (n > 0) {
+            out += ',';
+        }
+        boost::apply_visitor(visitor, values[n]);
+    }
+    out += ']';
+    return out;
+}
+
+// Whether path is prefix or below it, so that "/channel/1" matches "/channel/1/stage" but not "/channel/10".
+bool is_under(const std::string& path, const std::string& prefix)
+{
+    if (prefix.empty() || prefix == "/") {
+        return true;
+    }
+    if (!boost::starts_with(path, prefix)) {
+        return false;
+    }
+    return path.size() == prefix.size() || prefix.back() == '/' || path[prefix.size()] == '/';
+}
+
+} // namespace
+
+struct stream::impl
+{
+    struct subscriber
+    {
+        IO::client_connection<char>::ptr client;
+        std::vector<std::string>         prefixes; // guarded by impl::mutex_
+
+        explicit subscriber(IO::client_connection<char>::ptr client)
+            : client(std::move(client))
+        {
+        }
+
+        bool matches(const std::string& path) const
+        {
+            return std::any_of(prefixes.begin(), prefixes.end(), [&](const std::string& prefix) {
+                return is_under(path, prefix);
+            });
+        }
+    };
+
+    class client_strategy : public IO::protocol_strategy<char>
+    {
+        spl::shared_ptr<impl>       impl_;
+        std::shared_ptr<subscriber> subscriber_;
+
+      public:
+        client_strategy(spl::shared_ptr<impl> impl, std::shared_ptr<subscriber> subscriber)
+            : impl_(std::move(impl))
+            , subscriber_(std::move(subscriber))
+        {
+        }
+
+        void parse(const std::string& data) override
+        {
+            auto line  = boost::trim_copy(data);
+            auto space = line.find(' ');
+            auto cmd   = boost::to_upper_copy(line.substr(0, space));
+            auto arg   = space == std::string::npos ? std::string() : boost::trim_copy(line.substr(space + 1));
+
+            if (!arg.empty() && arg[0] != '/') {
+                arg = "/" + arg;
+            }
+
+            if (cmd == "SUBSCRIBE") {
+                impl_->subscribe(subscriber_, arg);
+            } else if (cmd == "UNSUBSCRIBE") {
+                impl_->unsubscribe(subscriber_, arg);
+            } else if (!cmd.empty()) {
+                std::string msg = R"({"type":"error","message":)";
+                append_string(msg, "Unknown command " + cmd);
+                msg += "}\n";
+                subscriber_->client->send(std::move(msg));
+            }
+        }
+    };
+
+    class strategy_factory : public IO::protocol_strategy_factory<char>
+    {
+        spl::shared_ptr<impl> impl_;
+
+      public:
+        explicit strategy_factory(spl::shared_ptr<impl> impl)
+            : impl_(std::move(impl))
+        {
+        }
+
+        IO::protocol_strategy<char>::ptr create(const IO::client_connection<char>::ptr& client_connection) override
+        {
+            auto sub = std::make_shared<subscriber>(client_connection);
+            {
+                std::lock_guard<std::mutex> lock(impl_->mutex_);
+                impl_->subscribers_.push_back(sub);
+            }
+            return spl::make_shared<client_strategy>(impl_, std::move(sub));
+        }
+    };
+
+    std::mutex                          pending_mutex_;
+    std::condition_variable             pending_cond_;
+    std::map<int, core::monitor::state> pending_;
+
+    std::mutex                               mutex_;
+    std::map<int, core::monitor::data_map_t> channels_; // Last state sent, keyed by the full path
+    std::vector<std::weak_ptr<subscriber>>   subscribers_;
+
+    std::atomic<bool> abort_request_{false};
+    std::thread       thread_;
+
+    impl()
+    {
+        thread_ = std::thread([this] {
+            while (!abort_request_) {
+                std::map<int, core::monitor::state> pending;
+                {
+                    std::unique_lock<std::mutex> lock(pending_mutex_);
+                    pending_cond_.wait(lock, [&] { return !pending_.empty() || abort_request_; });
+
+                    if (abort_request_) {
+                        return;
+                    }
+                    std::swap(pending, pending_);
+                }
+
+                try {
+                    update(pending);
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        });
+    }
+
+    ~impl()
+    {
+        abort_request_ = true;
+        pending_cond_.notify_all();
+        thread_.join();
+    }
+
+    void send(int channel_index, const core::monitor::state& state)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending_[channel_index] = state;
+        }
+        pending_cond_.notify_all();
+    }
+
+    void update(const std::map<int, core::monitor::state>& pending)
+    {
+        std::vector<std::pair<std::string, std::string>> set; // path, encoded entry
+        std::vector<std::string>                         unset;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto& channel : pending) {
+            const auto prefix = "/channel/" + std::to_string(channel.first) + "/";
+
+            // All keys share the prefix, so they are appended in order.
+            core::monitor::data_map_t next;
+            for (auto& entry : channel.second) {
+                next.emplace_hint(next.end(), prefix + entry.first, entry.second);
+            }
+
+            auto& prev = channels_[channel.first];
+            auto  a    = prev.begin();
+            auto  b    = next.begin();
+            while (a != prev.end() || b != next.end()) {
+                if (b == next.end() || (a != prev.end() && a->first < b->first)) {
+                    unset.push_back(a->first);
+                    ++a;
+                } else if (a == prev.end() || b->first < a->first) {
+                    set.emplace_back(b->first, encode_entry(b->first, b->second));
+                    ++b;
+                } else {
+                    if (!(a->second == b->second)) {
+                        set.emplace_back(b->first, encode_entry(b->first, b->second));
+                    }
+                    ++a;
+                    ++b;
+                }
+            }
+            prev = std::move(next);
+        }
+
+        if (set.empty() && unset.empty()) {
+            return;
+        }
+
+        for (auto it = subscribers_.begin(); it != subscribers_.end();) {
+            auto sub = it->lock();
+            if (!sub) {
+                it = subscribers_.erase(it);
+                continue;
+            }
+            ++it;
+
+            auto        changed = false;
+            std::string msg     = R"({"type":"update","set":{)";
+            for (auto& entry : set) {
+                if (sub->matches(entry.first)) {
+                    msg += changed ? "," : "";
+                    msg += entry.second;
+                    changed = true;
+                }
+            }
+            msg += R"(},"unset":[)";
+            auto removed = false;
+            for (auto& path : unset) {
+                if (sub->matches(path)) {
+                    msg += removed ? "," : "";
+                    append_string(msg, path);
+                    removed = true;
+                }
+            }
+            msg += "]}\n";
+
+            if (changed || removed) {
+                sub->client->send(std::move(msg));
+            }
+        }
+    }
+
+    void subscribe(const std::shared_ptr<subscriber>& sub, const std::string& prefix)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (std::find(sub->prefixes.begin(), sub->prefixes.end(), prefix) == sub->prefixes.end()) {
+            sub->prefixes.push_back(prefix);
+        }
+
+        // Sent under the lock, so that no update is missed or sent twice between the snapshot and the next update.
+        auto        first = true;
+        std::string msg   = R"({"type":"snapshot","prefix":)";
+        append_string(msg, prefix);
+        msg += R"(,"set":{)";
+        for (auto& channel : channels_) {
+            for (auto& entry : channel.second) {
+                if (is_under(entry.first, prefix)) {
+                    msg += first ? "" : ",";
+                    msg += encode_entry(entry.first, entry.second);
+                    first = false;
+                }
+            }
+        }
+        msg += "}}\n";
+        sub->client->send(std::move(msg));
+
+        CASPAR_LOG(info) << L"State stream client " << sub->client->address() << L" subscribed to "
+                         << (prefix.empty() ? L"/" : u16(prefix));
+    }
+
+    void unsubscribe(const std::shared_ptr<subscriber>& sub, const std::string& prefix)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (prefix.empty()) {
+            sub->prefixes.clear();
+        } else {
+            sub->prefixes.erase(std::remove(sub->prefixes.begin(), sub->prefixes.end(), prefix), sub->prefixes.end());
+        }
+    }
+};
+
+stream::stream()
+    : impl_(spl::make_shared<impl>())
+{
+}
+
+stream::~stream() {}
+
+void stream::send(int channel_index, const core::monitor::state& state) { impl_->send(channel_index, state); }
+
+IO::protocol_strategy_factory<char>::ptr stream::create_strategy_factory()
+{
+    return spl::make_shared<IO::delimiter_based_chunking_strategy_factory<char>>(
+        "\n", spl::make_shared<impl::strategy_factory>(impl_));
+}
+
+}}} // namespace caspar::protocol::state
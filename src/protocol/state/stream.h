@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../util/protocol_strategy.h"
+
+#include <common/memory.h>
+
+#include <core/monitor/monitor.h>
+
+namespace caspar { namespace protocol { namespace state {
+
+// Pushes channel state to TCP clients as newline delimited JSON, as an alternative to polling INFO or receiving OSC
+// over UDP. A client sends
+//
+//   SUBSCRIBE [prefix]     e.g. "SUBSCRIBE /channel/1/stage", all paths if no prefix is given
+//   UNSUBSCRIBE [prefix]   all subscriptions if no prefix is given
+//
+// and receives a snapshot of the paths under the prefix, followed by an update for every tick that changed any of
+// the paths it is subscribed to:
+//
+//   {"type":"snapshot","prefix":"/channel/1/stage","set":{"/channel/1/stage/layer/10/foreground/file/name":["amb"]}}
+//   {"type":"update","set":{"/channel/1/stage/layer/10/foreground/file/time":[1.2,10]},"unset":["/channel/1/..."]}
+//
+// Values are always arrays, in the same order as the OSC message arguments.
+class stream
+{
+  public:
+    stream();
+    ~stream();
+
+    stream(const stream&)            = delete;
+    stream& operator=(const stream&) = delete;
+
+    // Called with the complete state of a channel once per tick. Only the latest state of a channel is kept until
+    // it has been compared to the previous one, so a slow stream coalesces ticks rather than queueing them.
+    void send(int channel_index, const core::monitor::state& state);
+
+    IO::protocol_strategy_factory<char>::ptr create_strategy_factory();
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::protocol::state
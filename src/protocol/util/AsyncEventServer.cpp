@@ -24,13 +24,18 @@
 #include "AsyncEventServer.h"
 
 #include <algorithm>
-#include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/asio.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 #include <tbb/concurrent_hash_map.h>
 #include <tbb/concurrent_queue.h>
@@ -41,24 +46,75 @@ namespace caspar { namespace IO {
 
 class connection;
 
-using connection_set = std::set<spl::shared_ptr<connection>>;
+// Connections run on their own strands, so the set is shared between threads.
+class connection_set
+{
+    mutable std::mutex                    mutex_;
+    std::set<spl::shared_ptr<connection>> connections_;
+
+  public:
+    std::size_t insert(const spl::shared_ptr<connection>& conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.insert(conn);
+        return connections_.size();
+    }
+
+    std::size_t erase(const spl::shared_ptr<connection>& conn)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_.erase(conn);
+        return connections_.size();
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_.size();
+    }
+
+    std::vector<spl::shared_ptr<connection>> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::vector<spl::shared_ptr<connection>>(connections_.begin(), connections_.end());
+    }
+};
+
+namespace {
+
+std::mutex                                  servers_mutex;
+std::vector<std::weak_ptr<connection_set>> servers;
+
+} // namespace
 
 class connection : public spl::enable_shared_from_this<connection>
 {
+    using clock              = std::chrono::steady_clock;
     using lifecycle_map_type = tbb::concurrent_hash_map<std::wstring, std::shared_ptr<void>>;
-    using send_queue         = tbb::concurrent_queue<std::string>;
+    using send_queue         = tbb::concurrent_queue<std::pair<std::string, clock::time_point>>;
+
+    static constexpr std::size_t read_buffer_size = 32768;
 
     const spl::shared_ptr<tcp::socket>       socket_;
-    std::shared_ptr<boost::asio::io_context> io_context_;
     const std::wstring                       listen_port_;
+    const std::wstring                       remote_address_;
     const spl::shared_ptr<connection_set>    connection_set_;
     protocol_strategy_factory<char>::ptr     protocol_factory_;
     std::shared_ptr<protocol_strategy<char>> protocol_;
 
-    std::array<char, 32768> data_;
-    lifecycle_map_type      lifecycle_bound_objects_;
-    send_queue              send_queue_;
-    bool                    is_writing_;
+    std::string                    read_buffer_;
+    lifecycle_map_type             lifecycle_bound_objects_;
+    send_queue                     send_queue_;
+    bool                           is_writing_;
+    std::vector<std::string>       writing_;
+    std::vector<clock::time_point> writing_queued_;
+
+    std::atomic<int64_t> bytes_received_{0};
+    std::atomic<int64_t> bytes_sent_{0};
+    std::atomic<int64_t> replies_sent_{0};
+    std::atomic<int64_t> writes_{0};
+    std::atomic<int64_t> latency_total_{0}; // microseconds from send() until written
+    std::atomic<int64_t> latency_max_{0};
 
     class connection_holder : public client_connection<char>
     {
@@ -114,42 +170,44 @@ class connection : public spl::enable_shared_from_this<connection>
     };
 
   public:
-    static spl::shared_ptr<connection> create(std::shared_ptr<boost::asio::io_context>    io_context,
-                                              spl::shared_ptr<tcp::socket>                socket,
+    static spl::shared_ptr<connection> create(spl::shared_ptr<tcp::socket>                socket,
                                               const protocol_strategy_factory<char>::ptr& protocol,
                                               spl::shared_ptr<connection_set>             connection_set)
     {
         spl::shared_ptr<connection> con(
-            new connection(std::move(io_context), std::move(socket), std::move(protocol), std::move(connection_set)));
+            new connection(std::move(socket), std::move(protocol), std::move(connection_set)));
         con->init();
-        con->read_some();
         return con;
     }
 
     void init() { protocol_ = protocol_factory_->create(spl::make_shared<connection_holder>(shared_from_this())); }
 
+    // Called once the lifecycle bound objects have been added, so that no command runs before they exist.
+    void start()
+    {
+        auto self = shared_from_this();
+        boost::asio::dispatch(socket_->get_executor(), [self] { self->read_some(); });
+    }
+
     ~connection() { CASPAR_LOG(debug) << print() << L" connection destroyed."; }
 
     std::wstring print() const { return L"async_event_server[:" + listen_port_ + L"]"; }
 
     std::wstring address() const { return u16(socket_->local_endpoint().address().to_string()); }
 
-    std::wstring ipv4_address() const
-    {
-        return socket_->is_open() ? u16(socket_->remote_endpoint().address().to_string()) : L"no-address";
-    }
+    std::wstring ipv4_address() const { return socket_->is_open() ? remote_address_ : L"no-address"; }
 
     void send(std::string&& data)
     {
-        send_queue_.push(std::move(data));
+        send_queue_.push(std::make_pair(std::move(data), clock::now()));
         auto self = shared_from_this();
-        boost::asio::dispatch(*io_context_, [=] { self->do_write(); });
+        boost::asio::dispatch(socket_->get_executor(), [=] { self->do_write(); });
     }
 
     void disconnect()
     {
         std::weak_ptr<connection> self = shared_from_this();
-        boost::asio::dispatch(*io_context_, [=] {
+        boost::asio::dispatch(socket_->get_executor(), [=] {
             auto strong = self.lock();
 
             if (strong)
@@ -174,36 +232,72 @@ class connection : public spl::enable_shared_from_this<connection>
         return std::shared_ptr<void>();
     }
 
+    boost::property_tree::wptree info() const
+    {
+        const auto writes = writes_.load();
+
+        boost::property_tree::wptree info;
+        info.add(L"address", remote_address_);
+        info.add(L"port", listen_port_);
+        info.add(L"bytes-received", bytes_received_.load());
+        info.add(L"bytes-sent", bytes_sent_.load());
+        info.add(L"replies", replies_sent_.load());
+        info.add(L"writes", writes);
+        info.add(L"latency.mean", replies_sent_ > 0 ? latency_total_ / replies_sent_ : 0);
+        info.add(L"latency.max", latency_max_.load());
+        return info;
+    }
+
   private:
-    void do_write() // always called from the asio-service-thread
+    void do_write() // always called from the connection strand
     {
-        if (!is_writing_) {
-            std::string data;
-            if (send_queue_.try_pop(data)) {
-                write_some(std::move(data));
-            }
+        if (is_writing_) {
+            return;
+        }
+
+        // Everything queued so far is written with a single gathering write.
+        std::pair<std::string, clock::time_point> data;
+        while (send_queue_.try_pop(data)) {
+            writing_.push_back(std::move(data.first));
+            writing_queued_.push_back(data.second);
+        }
+
+        if (writing_.empty()) {
+            return;
+        }
+
+        std::vector<boost::asio::const_buffer> buffers;
+        buffers.reserve(writing_.size());
+        for (auto& str : writing_) {
+            buffers.push_back(boost::asio::buffer(str));
         }
+
+        is_writing_ = true;
+        boost::asio::async_write(
+            *socket_,
+            buffers,
+            std::bind(&connection::handle_write, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
     }
 
-    void stop() // always called from the asio-service-thread
+    void stop() // always called from the connection strand
     {
-        connection_set_->erase(shared_from_this());
+        const auto remaining = connection_set_->erase(shared_from_this());
 
-        CASPAR_LOG(info) << print() << L" Client " << ipv4_address() << L" disconnected (" << connection_set_->size()
-                         << L" connections).";
+        CASPAR_LOG(info) << print() << L" Client " << ipv4_address() << L" disconnected (" << remaining
+                         << L" connections, " << bytes_received_ << L" bytes received, " << bytes_sent_
+                         << L" bytes sent).";
 
         boost::system::error_code ec;
         socket_->shutdown(boost::asio::socket_base::shutdown_type::shutdown_both, ec);
         socket_->close(ec);
     }
 
-    connection(const std::shared_ptr<boost::asio::io_context>& io_context,
-               const spl::shared_ptr<tcp::socket>&             socket,
-               const protocol_strategy_factory<char>::ptr&     protocol_factory,
-               const spl::shared_ptr<connection_set>&          connection_set)
+    connection(const spl::shared_ptr<tcp::socket>&         socket,
+               const protocol_strategy_factory<char>::ptr& protocol_factory,
+               const spl::shared_ptr<connection_set>&      connection_set)
         : socket_(socket)
-        , io_context_(io_context)
         , listen_port_(socket_->is_open() ? std::to_wstring(socket_->local_endpoint().port()) : L"no-port")
+        , remote_address_(socket_->is_open() ? u16(socket_->remote_endpoint().address().to_string()) : L"no-address")
         , connection_set_(connection_set)
         , protocol_factory_(protocol_factory)
         , is_writing_(false)
@@ -213,13 +307,15 @@ class connection : public spl::enable_shared_from_this<connection>
     }
 
     void handle_read(const boost::system::error_code& error,
-                     size_t                           bytes_transferred) // always called from the asio-service-thread
+                     size_t                           bytes_transferred) // always called from the connection strand
     {
         if (!error) {
-            try {
-                std::string data(data_.begin(), data_.begin() + bytes_transferred);
+            bytes_received_ += static_cast<int64_t>(bytes_transferred);
 
-                protocol_->parse(data);
+            try {
+                // The read buffer is handed to the protocol as is, it is only shrunk to the received size.
+                read_buffer_.resize(bytes_transferred);
+                protocol_->parse(read_buffer_);
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
@@ -229,44 +325,40 @@ class connection : public spl::enable_shared_from_this<connection>
             stop();
     }
 
-    void handle_write(const spl::shared_ptr<std::string>& str,
-                      const boost::system::error_code&    error,
-                      size_t bytes_transferred) // always called from the asio-service-thread
+    void handle_write(const boost::system::error_code& error,
+                      size_t bytes_transferred) // always called from the connection strand
     {
         if (!error) {
-            if (bytes_transferred != str->size()) {
-                str->assign(str->substr(bytes_transferred));
-                socket_->async_write_some(boost::asio::buffer(str->data(), str->size()),
-                                          std::bind(&connection::handle_write,
-                                                    shared_from_this(),
-                                                    str,
-                                                    std::placeholders::_1,
-                                                    std::placeholders::_2));
-            } else {
-                is_writing_ = false;
-                do_write();
+            const auto now = clock::now();
+
+            int64_t latency_max = latency_max_;
+            for (auto& queued : writing_queued_) {
+                const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(now - queued).count();
+                latency_total_ += latency;
+                latency_max = std::max<int64_t>(latency_max, latency);
             }
+            latency_max_ = latency_max;
+
+            bytes_sent_ += static_cast<int64_t>(bytes_transferred);
+            replies_sent_ += static_cast<int64_t>(writing_.size());
+            writes_ += 1;
+
+            writing_.clear();
+            writing_queued_.clear();
+            is_writing_ = false;
+            do_write();
         } else if (error != boost::asio::error::operation_aborted && socket_->is_open())
             stop();
     }
 
-    void read_some() // always called from the asio-service-thread
+    void read_some() // always called from the connection strand
     {
+        read_buffer_.resize(read_buffer_size);
         socket_->async_read_some(
-            boost::asio::buffer(data_.data(), data_.size()),
+            boost::asio::buffer(&read_buffer_[0], read_buffer_.size()),
             std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
     }
 
-    void write_some(std::string&& data) // always called from the asio-service-thread
-    {
-        is_writing_ = true;
-        auto str    = spl::make_shared<std::string>(std::move(data));
-        socket_->async_write_some(
-            boost::asio::buffer(str->data(), str->size()),
-            std::bind(
-                &connection::handle_write, shared_from_this(), str, std::placeholders::_1, std::placeholders::_2));
-    }
-
     friend struct AsyncEventServer::implementation;
 };
 
@@ -282,40 +374,46 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
                    const protocol_strategy_factory<char>::ptr& protocol,
                    unsigned short                              port)
         : io_context_(std::move(io_context))
-        , acceptor_(*io_context_, tcp::endpoint(tcp::v4(), port))
+        , acceptor_(boost::asio::make_strand(*io_context_), tcp::endpoint(tcp::v4(), port))
         , protocol_factory_(protocol)
     {
+        std::lock_guard<std::mutex> lock(servers_mutex);
+        servers.erase(std::remove_if(servers.begin(), servers.end(), [](auto& s) { return s.expired(); }),
+                      servers.end());
+        servers.push_back(connection_set_);
     }
 
     void stop()
     {
-        try {
-            acceptor_.cancel();
-            acceptor_.close();
-        } catch (...) {
-            CASPAR_LOG_CURRENT_EXCEPTION();
-        }
+        // The acceptor is only touched from its strand.
+        auto self = shared_from_this();
+        boost::asio::dispatch(acceptor_.get_executor(), [self] {
+            try {
+                self->acceptor_.cancel();
+                self->acceptor_.close();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
     }
 
     ~implementation()
     {
-        auto conns_set = connection_set_;
-
-        boost::asio::post(*io_context_, [conns_set] {
-            auto connections = *conns_set;
-            for (auto& connection : connections)
-                connection->stop();
-        });
+        for (auto& connection : connection_set_->snapshot()) {
+            boost::asio::post(connection->socket_->get_executor(), [connection] { connection->stop(); });
+        }
     }
 
-    void start_accept()
+    void start_accept() // always called from the acceptor strand
     {
-        spl::shared_ptr<tcp::socket> socket(new tcp::socket(*io_context_));
+        // Every connection gets its own strand, so clients are served in parallel by the io_context threads.
+        spl::shared_ptr<tcp::socket> socket(new tcp::socket(boost::asio::make_strand(*io_context_)));
         acceptor_.async_accept(
             *socket, std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1));
     }
 
-    void handle_accept(const spl::shared_ptr<tcp::socket>& socket, const boost::system::error_code& error)
+    void handle_accept(const spl::shared_ptr<tcp::socket>& socket,
+                       const boost::system::error_code&    error) // always called from the acceptor strand
     {
         if (!acceptor_.is_open())
             return;
@@ -327,13 +425,18 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
             if (ec)
                 CASPAR_LOG(warning) << print() << L" Failed to enable TCP keep-alive on socket";
 
-            auto conn = connection::create(io_context_, socket, protocol_factory_, connection_set_);
+            // Replies are small and latency sensitive.
+            socket->set_option(tcp::no_delay(true), ec);
+
+            auto conn = connection::create(socket, protocol_factory_, connection_set_);
             connection_set_->insert(conn);
 
             for (auto& lifecycle_factory : lifecycle_factories_) {
                 auto lifecycle_bound = lifecycle_factory(u8(conn->ipv4_address()));
                 conn->add_lifecycle_bound_object(lifecycle_bound.first, lifecycle_bound.second);
             }
+
+            conn->start();
         }
         start_accept();
     }
@@ -346,7 +449,7 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
     void add_client_lifecycle_object_factory(const lifecycle_factory_t& factory)
     {
         auto self = shared_from_this();
-        boost::asio::post(*io_context_, [=] { self->lifecycle_factories_.push_back(factory); });
+        boost::asio::post(acceptor_.get_executor(), [=] { self->lifecycle_factories_.push_back(factory); });
     }
 };
 
@@ -355,7 +458,8 @@ AsyncEventServer::AsyncEventServer(std::shared_ptr<boost::asio::io_context>    i
                                    unsigned short                              port)
     : impl_(new implementation(std::move(io_context), protocol, port))
 {
-    impl_->start_accept();
+    auto impl = impl_;
+    boost::asio::dispatch(impl_->acceptor_.get_executor(), [impl] { impl->start_accept(); });
 }
 
 AsyncEventServer::~AsyncEventServer() { impl_->stop(); }
@@ -365,4 +469,25 @@ void AsyncEventServer::add_client_lifecycle_object_factory(const lifecycle_facto
     impl_->add_client_lifecycle_object_factory(factory);
 }
 
+boost::property_tree::wptree connections_info()
+{
+    std::vector<std::shared_ptr<connection_set>> sets;
+    {
+        std::lock_guard<std::mutex> lock(servers_mutex);
+        for (auto& server : servers) {
+            if (auto set = server.lock()) {
+                sets.push_back(std::move(set));
+            }
+        }
+    }
+
+    boost::property_tree::wptree info;
+    for (auto& set : sets) {
+        for (auto& conn : set->snapshot()) {
+            info.add_child(L"connections.connection", conn->info());
+        }
+    }
+    return info;
+}
+
 }} // namespace caspar::IO
@@ -27,6 +27,7 @@
 #include <common/memory.h>
 
 #include <boost/asio.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
 
 namespace caspar { namespace IO {
 
@@ -52,4 +53,7 @@ class AsyncEventServer
     AsyncEventServer& operator=(const AsyncEventServer&) = delete;
 };
 
+// Byte and reply latency counters of the clients connected to every server.
+boost::property_tree::wptree connections_info();
+
 }} // namespace caspar::IO
@@ -28,6 +28,7 @@
 #include <common/env.h>
 #include <common/except.h>
 #include <common/memory.h>
+#include <common/os/filesystem.h>
 #include <common/ptree.h>
 #include <common/utf.h>
 
@@ -48,7 +49,9 @@
 #include <protocol/amcp/AMCPProtocolStrategy.h>
 #include <protocol/amcp/amcp_command_repository.h>
 #include <protocol/amcp/amcp_shared.h>
+#include <protocol/metrics/exporter.h>
 #include <protocol/osc/client.h>
+#include <protocol/state/stream.h>
 #include <protocol/util/AsyncEventServer.h>
 #include <protocol/util/strategy_adapters.h>
 #include <protocol/util/tokenize.h>
@@ -58,8 +61,10 @@
 #include <boost/format.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace caspar {
 using namespace core;
@@ -67,31 +72,40 @@ using namespace protocol;
 
 std::shared_ptr<boost::asio::io_context> create_io_context_with_running_service()
 {
-    auto io_context = std::make_shared<boost::asio::io_context>();
+    // AMCP clients are served on their own strands, so replies to several clients are written in parallel.
+    const auto thread_count = std::max(env::properties().get(L"configuration.amcp.io-threads", 2), 1);
+
+    auto io_context = std::make_shared<boost::asio::io_context>(thread_count);
     // To keep the io_context::run() running although no pending async
     // operations are posted.
     auto work      = std::make_shared<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(boost::asio::make_work_guard(*io_context));
     auto weak_work = std::weak_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(work);
-    auto thread    = std::make_shared<std::thread>([io_context, weak_work] {
-        while (auto strong = weak_work.lock()) {
-            try {
-                io_context->run();
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
+
+    auto threads = std::make_shared<std::vector<std::thread>>();
+    for (auto n = 0; n < thread_count; ++n) {
+        threads->emplace_back([io_context, weak_work] {
+            while (auto strong = weak_work.lock()) {
+                try {
+                    io_context->run();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
             }
-        }
 
-        CASPAR_LOG(info) << "[asio] Global io_context uninitialized.";
-    });
+            CASPAR_LOG(info) << "[asio] Global io_context uninitialized.";
+        });
+    }
 
-    return std::shared_ptr<boost::asio::io_context>(io_context.get(), [io_context, work, thread](void*) mutable {
+    return std::shared_ptr<boost::asio::io_context>(io_context.get(), [io_context, work, threads](void*) mutable {
         CASPAR_LOG(info) << "[asio] Shutting down global io_context.";
         work.reset();
         io_context->stop();
-        if (thread->get_id() != std::this_thread::get_id())
-            thread->join();
-        else
-            thread->detach();
+        for (auto& thread : *threads) {
+            if (thread.get_id() != std::this_thread::get_id())
+                thread.join();
+            else
+                thread.detach();
+        }
     });
 }
 
@@ -107,6 +121,8 @@ struct server::impl
     std::shared_ptr<IO::AsyncEventServer>                  primary_amcp_server_;
     std::shared_ptr<osc::client>                           osc_client_ = std::make_shared<osc::client>(io_context_);
     std::vector<std::shared_ptr<void>>                     predefined_osc_subscriptions_;
+    std::shared_ptr<state::stream>                         state_stream_ = std::make_shared<state::stream>();
+    std::shared_ptr<metrics::exporter>                     metrics_exporter_;
     spl::shared_ptr<std::vector<protocol::amcp::channel_context>> channels_;
     spl::shared_ptr<core::cg_producer_registry>                   cg_registry_;
     spl::shared_ptr<core::frame_producer_registry>                producer_registry_;
@@ -124,10 +140,22 @@ struct server::impl
         , shutdown_server_now_(std::move(shutdown_server_now))
     {
         caspar::core::diagnostics::osd::register_sink();
+
+        // Graphs only get the sinks registered before they are created, so this has to happen before the channels.
+        if (env::properties().get(L"configuration.metrics.enabled", false)) {
+            metrics_exporter_ = std::make_shared<metrics::exporter>(
+                io_context_,
+                env::properties().get(L"configuration.metrics.host", L"127.0.0.1"),
+                env::properties().get(L"configuration.metrics.port", static_cast<unsigned short>(9250)));
+        }
     }
 
     void start()
     {
+        add_case_insensitive_index(env::media_folder());
+        add_case_insensitive_index(env::template_folder());
+        add_case_insensitive_index(env::data_folder());
+
         setup_video_modes(env::properties());
         CASPAR_LOG(info) << L"Initialized video modes.";
 
@@ -158,6 +186,8 @@ struct server::impl
         io_context_.reset();
         predefined_osc_subscriptions_.clear();
         osc_client_.reset();
+        state_stream_.reset();
+        metrics_exporter_.reset();
 
         amcp_command_repo_wrapper_.reset();
         amcp_command_repo_.reset();
@@ -278,6 +308,8 @@ struct server::impl
                 CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
 
             auto weak_client = std::weak_ptr<osc::client>(osc_client_);
+            auto weak_stream = std::weak_ptr<state::stream>(state_stream_);
+            auto info_cache  = std::make_shared<amcp::info_cache>();
             auto channel_id  = static_cast<int>(channels_->size() + 1);
             auto depth       = color_depth == 16 ? common::bit_depth::bit16 : common::bit_depth::bit8;
             auto default_color_space =
@@ -287,7 +319,12 @@ struct server::impl
                                                 format_desc,
                                                 default_color_space,
                                                 accelerator_.create_image_mixer(channel_id, depth),
-                                                [channel_id, weak_client](core::monitor::state channel_state) {
+                                                [channel_id, weak_client, weak_stream, info_cache](
+                                                    core::monitor::state channel_state) {
+                                                    info_cache->update(channel_state);
+                                                    if (auto stream = weak_stream.lock()) {
+                                                        stream->send(channel_id, channel_state);
+                                                    }
                                                     monitor::state state;
                                                     state[""]["channel"][channel_id] = channel_state;
                                                     auto client                      = weak_client.lock();
@@ -297,7 +334,7 @@ struct server::impl
                                                 });
 
             const std::wstring lifecycle_key = L"lock" + std::to_wstring(channel_id);
-            channels_->emplace_back(channel, channel->stage(), lifecycle_key);
+            channels_->emplace_back(channel, channel->stage(), lifecycle_key, info_cache);
         }
 
         return xml_channels;
@@ -467,6 +504,9 @@ struct server::impl
         if (boost::iequals(name, L"AMCP"))
             return amcp::create_char_amcp_strategy_factory(port_description, spl::make_shared_ptr(amcp_command_repo_));
 
+        if (boost::iequals(name, L"STATE"))
+            return state_stream_->create_strategy_factory();
+
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid protocol: " + name));
     }
 };
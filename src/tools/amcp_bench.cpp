@@ -0,0 +1,331 @@
+// Replays AMCP commands against a running server and reports throughput and reply latency per command type.
+//
+// amcp-bench [--host 127.0.0.1] [--port 5250] [--connections 4] [--pipeline 1] [--duration 10] [--count 0]
+//            [--channel 1] [--file commands.txt]
+//
+// Every connection sends the commands in order, keeping --pipeline commands in flight, until --count commands have
+// been sent or --duration seconds have passed. Without --file a synthetic mix of MIXER, CG UPDATE and INFO commands
+// for --channel is used. Recorded streams have one command per line, empty lines and lines starting with # are
+// skipped. Commands are sent with REQ ids, so a reply is matched to its command even if the server reorders them.
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using boost::asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+struct options
+{
+    std::string host        = "127.0.0.1";
+    std::string port        = "5250";
+    int         connections = 4;
+    int         pipeline    = 1;
+    double      duration    = 10.0;
+    int64_t     count       = 0;
+    int         channel     = 1;
+    std::string file;
+};
+
+struct sample
+{
+    std::string type;
+    double      latency; // milliseconds
+    bool        failed;
+};
+
+// "MIXER 1-10 OPACITY 0.5" is reported as "MIXER OPACITY", "INFO 1" as "INFO".
+std::string command_type(const std::string& command)
+{
+    static const std::vector<std::string> groups = {"MIXER", "CG", "DATA", "THUMBNAIL", "INFO", "GL", "OSC", "LOG"};
+
+    std::vector<std::string> tokens;
+    boost::split(tokens, command, boost::is_space(), boost::token_compress_on);
+    if (tokens.empty()) {
+        return "";
+    }
+
+    auto type = boost::to_upper_copy(tokens[0]);
+    if (std::find(groups.begin(), groups.end(), type) == groups.end()) {
+        return type;
+    }
+
+    for (auto n = 1ULL; n < tokens.size(); ++n) {
+        if (tokens[n].empty() || std::isdigit(static_cast<unsigned char>(tokens[n][0]))) {
+            continue;
+        }
+        return type + " " + boost::to_upper_copy(tokens[n]);
+    }
+    return type;
+}
+
+std::vector<std::string> synthetic_commands(int channel)
+{
+    const auto ch = std::to_string(channel);
+    return {
+        "MIXER " + ch + "-10 OPACITY 0.5 10",
+        "MIXER " + ch + "-10 FILL 0.1 0.1 0.8 0.8 10",
+        "CG " + ch + "-20 UPDATE 1 \"{\\\"f0\\\":\\\"bench\\\"}\"",
+        "INFO " + ch,
+        "MIXER " + ch + "-10 OPACITY 1 10",
+        "MIXER " + ch + "-10 CLEAR",
+        "VERSION",
+    };
+}
+
+std::vector<std::string> load_commands(const std::string& file)
+{
+    std::ifstream            stream(file);
+    std::vector<std::string> commands;
+    std::string              line;
+
+    if (!stream) {
+        throw std::runtime_error("Failed to open " + file);
+    }
+
+    while (std::getline(stream, line)) {
+        boost::trim(line);
+        if (!line.empty() && line[0] != '#') {
+            commands.push_back(line);
+        }
+    }
+    return commands;
+}
+
+class connection
+{
+    using pending_map = std::unordered_map<int64_t, std::pair<std::string, clock_type::time_point>>;
+
+    tcp::socket            socket_;
+    boost::asio::streambuf buffer_;
+    pending_map            pending_;
+    int64_t                next_id_ = 0;
+
+  public:
+    connection(boost::asio::io_context& io_context, const options& opts)
+        : socket_(io_context)
+    {
+        tcp::resolver resolver(io_context);
+        boost::asio::connect(socket_, resolver.resolve(opts.host, opts.port));
+        socket_.set_option(tcp::no_delay(true));
+    }
+
+    void send(const std::string& command)
+    {
+        const auto id   = next_id_++;
+        const auto line = "REQ " + std::to_string(id) + " " + command + "\r\n";
+        pending_.emplace(id, std::make_pair(command_type(command), clock_type::now()));
+        boost::asio::write(socket_, boost::asio::buffer(line));
+    }
+
+    std::size_t in_flight() const { return pending_.size(); }
+
+    // Reads replies until one of the commands sent completes.
+    sample receive()
+    {
+        while (true) {
+            auto header = read_line();
+
+            // RES <id> <code> ...
+            std::vector<std::string> tokens;
+            boost::split(tokens, header, boost::is_space(), boost::token_compress_on);
+            if (tokens.size() < 3 || tokens[0] != "RES") {
+                continue;
+            }
+
+            const auto code = std::stoi(tokens[2]);
+            if (code == 200) {
+                while (!read_line().empty()) {
+                }
+            } else if (code == 201 || code == 400) {
+                read_line();
+            }
+
+            auto it = pending_.find(std::stoll(tokens[1]));
+            if (it == pending_.end()) {
+                continue;
+            }
+
+            auto latency = std::chrono::duration<double, std::milli>(clock_type::now() - it->second.second).count();
+            sample result{it->second.first, latency, code >= 400};
+            pending_.erase(it);
+            return result;
+        }
+    }
+
+  private:
+    std::string read_line()
+    {
+        boost::asio::read_until(socket_, buffer_, "\r\n");
+
+        std::istream stream(&buffer_);
+        std::string  line;
+        std::getline(stream, line);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        return line;
+    }
+};
+
+double percentile(std::vector<double>& values, double p)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    auto n = static_cast<std::size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+options parse_options(int argc, char** argv)
+{
+    options opts;
+    for (int n = 1; n + 1 < argc; n += 2) {
+        const std::string key   = argv[n];
+        const std::string value = argv[n + 1];
+
+        if (key == "--host") {
+            opts.host = value;
+        } else if (key == "--port") {
+            opts.port = value;
+        } else if (key == "--connections") {
+            opts.connections = std::max(1, std::stoi(value));
+        } else if (key == "--pipeline") {
+            opts.pipeline = std::max(1, std::stoi(value));
+        } else if (key == "--duration") {
+            opts.duration = std::stod(value);
+        } else if (key == "--count") {
+            opts.count = std::stoll(value);
+        } else if (key == "--channel") {
+            opts.channel = std::stoi(value);
+        } else if (key == "--file") {
+            opts.file = value;
+        } else {
+            throw std::invalid_argument("Unknown option " + key);
+        }
+    }
+    if (argc % 2 == 0) {
+        throw std::invalid_argument(std::string("Missing value for ") + argv[argc - 1]);
+    }
+    return opts;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    options                  opts;
+    std::vector<std::string> commands;
+
+    try {
+        opts     = parse_options(argc, argv);
+        commands = opts.file.empty() ? synthetic_commands(opts.channel) : load_commands(opts.file);
+    } catch (std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (commands.empty()) {
+        std::cerr << "No commands to send.\n";
+        return 1;
+    }
+
+    const auto deadline = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(
+                                                  std::chrono::duration<double>(opts.duration));
+
+    std::mutex                                 mutex;
+    std::map<std::string, std::vector<double>> latencies;
+    std::map<std::string, int64_t>             failures;
+    std::atomic<int>                           errors{0};
+    std::vector<std::thread>                   threads;
+
+    const auto started = clock_type::now();
+
+    for (int c = 0; c < opts.connections; ++c) {
+        threads.emplace_back([&, c] {
+            std::vector<sample> samples;
+
+            try {
+                boost::asio::io_context io_context;
+                connection              conn(io_context, opts);
+
+                // Connections start at different offsets, so the mix is spread over time.
+                auto    index = static_cast<std::size_t>(c) % commands.size();
+                int64_t sent  = 0;
+
+                auto more = [&] { return (opts.count == 0 || sent < opts.count) && clock_type::now() < deadline; };
+
+                while (more() || conn.in_flight() > 0) {
+                    while (more() && conn.in_flight() < static_cast<std::size_t>(opts.pipeline)) {
+                        conn.send(commands[index]);
+                        index = (index + 1) % commands.size();
+                        sent += 1;
+                    }
+                    samples.push_back(conn.receive());
+                }
+            } catch (std::exception& e) {
+                errors += 1;
+                std::cerr << "connection " << c << ": " << e.what() << "\n";
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& s : samples) {
+                latencies[s.type].push_back(s.latency);
+                failures[s.type] += s.failed ? 1 : 0;
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    const auto elapsed = std::chrono::duration<double>(clock_type::now() - started).count();
+
+    std::vector<double> all;
+    int64_t             failed = 0;
+    for (auto& l : latencies) {
+        all.insert(all.end(), l.second.begin(), l.second.end());
+        failed += failures[l.first];
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << opts.connections << " connections, pipeline " << opts.pipeline << ", " << all.size()
+              << " commands in " << elapsed << " s: " << static_cast<double>(all.size()) / elapsed << " commands/s\n\n";
+
+    std::cout << std::left << std::setw(24) << "command" << std::right << std::setw(10) << "count" << std::setw(8)
+              << "failed" << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms"
+              << std::setw(10) << "max ms"
+              << "\n";
+
+    auto print_row = [](const std::string& type, std::vector<double>& values, int64_t failed) {
+        std::cout << std::left << std::setw(24) << type << std::right << std::setw(10) << values.size()
+                  << std::setw(8) << failed << std::setw(10) << percentile(values, 0.5) << std::setw(10)
+                  << percentile(values, 0.9) << std::setw(10) << percentile(values, 0.99) << std::setw(10)
+                  << (values.empty() ? 0.0 : *std::max_element(values.begin(), values.end())) << "\n";
+    };
+
+    for (auto& l : latencies) {
+        print_row(l.first, l.second, failures[l.first]);
+    }
+    print_row("TOTAL", all, failed);
+
+    return errors > 0 ? 1 : 0;
+}